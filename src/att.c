@@ -29,44 +29,413 @@
 #include "globals.h"
 
 #include <errno.h>
-#include <unistd.h>
-#include <sys/socket.h>
+#include <poll.h>
+#include <string.h>
+
+void ucpu_connection_init(ucpu_connection_t *ucpu_connection)
+{
+	ucpu_connection->sock = -1;
+	ucpu_connection->transport = &ucpu_socket_transport;
+	ucpu_connection->transport_data = NULL;
+	ucpu_connection->event_loop = NULL;
+	ucpu_connection->tx_queue = NULL;
+	ucpu_connection->feedback_tracker = NULL;
+	ucpu_connection->pipeline = NULL;
+	ucpu_connection->port_registry = NULL;
+	ucpu_connection->subscription_manager = NULL;
+	ucpu_connection->recorder = NULL;
+	ucpu_connection->value_cache = NULL;
+	ucpu_connection->supervisor = NULL;
+	ucpu_connection->connection_id = 0;
+}
+
+/* Updates the optional components of the connection from a received packet. */
+static void ucpu_observe_packet(ucpu_connection_t *ucpu_connection, const uint8_t *packet, int packet_len,
+	uint64_t timestamp_ns)
+{
+	const hub_common_message_header_t *common_message_header = (const hub_common_message_header_t*)packet;
+
+	if (packet_len < sizeof(hub_common_message_header_t)
+			|| common_message_header->opcode != ATT_HANDLE_VALUE_NTF) {
+		return;
+	}
+
+	switch (common_message_header->message_type) {
+	case HUB_ATTACHED_IO:
+		if (ucpu_connection->port_registry != NULL) {
+			ucpu_port_registry_update(ucpu_connection, packet, packet_len);
+		}
+		if (ucpu_connection->value_cache != NULL) {
+			ucpu_value_cache_update(ucpu_connection, packet, packet_len, timestamp_ns);
+		}
+		if (ucpu_connection->supervisor != NULL) {
+			ucpu_supervisor_update(ucpu_connection, packet, packet_len);
+		}
+		break;
+	case HUB_PORT_VALUE_SINGLE:
+		if (ucpu_connection->value_cache != NULL) {
+			ucpu_value_cache_update(ucpu_connection, packet, packet_len, timestamp_ns);
+		}
+		break;
+	case HUB_PORT_INPUT_FORMAT_SINGLE:
+		if (ucpu_connection->value_cache != NULL) {
+			ucpu_value_cache_update(ucpu_connection, packet, packet_len, timestamp_ns);
+		}
+		if (ucpu_connection->supervisor != NULL) {
+			ucpu_supervisor_update(ucpu_connection, packet, packet_len);
+		}
+		break;
+	case PORT_OUTPUT_COMMAND_FEEDBACK:
+		if (ucpu_connection->feedback_tracker != NULL) {
+			ucpu_feedback_process(ucpu_connection, packet, packet_len);
+
+			if (ucpu_connection->pipeline != NULL) {
+				ucpu_pipeline_refill(ucpu_connection);
+			}
+		}
+		break;
+	}
+}
+
+/* Closes the connection after a transport error. */
+static void ucpu_connection_lost(ucpu_connection_t *ucpu_connection)
+{
+	ucpu_connection->transport->close(ucpu_connection);
+
+	if (ucpu_connection->supervisor != NULL) {
+		ucpu_supervisor_connection_lost(ucpu_connection);
+	}
+}
 
 int ucpu_att_send(ucpu_connection_t *ucpu_connection, void *req_buf, uint16_t req_buf_len)
 {
-	ssize_t ret;
+	struct pollfd poll_fd;
+	uint64_t deadline_ns = 0, now_ns;
+	int ret;
 
 	while (1) {
-		ret = send(ucpu_connection->sock, req_buf, req_buf_len, 0);
+		ret = ucpu_connection->transport->send(ucpu_connection, req_buf, req_buf_len);
+
+		if (ret == UCPU_TRANSPORT_AGAIN) {
+			/* Sleep until the controller has free buffers. Use
+			 * a transmit queue to avoid blocking completely. */
+			now_ns = ucpu_get_time_ns();
+			if (deadline_ns == 0) {
+				deadline_ns = now_ns + (uint64_t)UCPU_ATT_SEND_TIMEOUT_MS * 1000000;
+			} else if (now_ns >= deadline_ns) {
+				return UCPU_TX_QUEUE_FULL;
+			}
+
+			poll_fd.fd = ucpu_connection->sock;
+			poll_fd.events = POLLOUT;
+			ret = poll(&poll_fd, 1, (int)((deadline_ns - now_ns + 999999) / 1000000));
 
-		if (ret != (int)req_buf_len) {
-			if (errno == EWOULDBLOCK || errno == EAGAIN) {
-				continue;
+			if ((ret < 0 && errno != EINTR) || (ret > 0 && (poll_fd.revents & (POLLERR | POLLHUP | POLLNVAL)))) {
+				ucpu_connection_lost(ucpu_connection);
+				return 1;
 			}
+			continue;
+		}
 
-			close(ucpu_connection->sock);
-			ucpu_connection->sock = -1;
+		if (ret != 0) {
+			ucpu_connection_lost(ucpu_connection);
 			return 1;
 		}
+
+		if (ucpu_connection->recorder != NULL) {
+			ucpu_recorder_write(ucpu_connection->recorder, ucpu_connection->connection_id,
+				UCPU_RECORD_SENT, ucpu_get_time_ns(), (const uint8_t*)req_buf, req_buf_len);
+		}
 		return 0;
 	}
 }
 
 int ucpu_att_receive(ucpu_connection_t *ucpu_connection)
 {
-	ssize_t ret = recv(ucpu_connection->sock, ucpu_connection->rsp_buf, sizeof(ucpu_connection->rsp_buf), 0);
+	uint64_t timestamp_ns = 0;
+	int ret = ucpu_connection->transport->receive(ucpu_connection,
+		ucpu_connection->rsp_buf, sizeof(ucpu_connection->rsp_buf));
 
 	if (ret <= 0) {
-		if (errno == EWOULDBLOCK || errno == EAGAIN) {
-			return 0;
+		if (ret < 0) {
+			ucpu_connection_lost(ucpu_connection);
 		}
+		return ret;
+	}
+
+	if (ucpu_connection->recorder != NULL || ucpu_connection->value_cache != NULL) {
+		timestamp_ns = ucpu_get_time_ns();
+	}
+
+	if (ucpu_connection->recorder != NULL) {
+		ucpu_recorder_write(ucpu_connection->recorder, ucpu_connection->connection_id,
+			UCPU_RECORD_RECEIVED, timestamp_ns, ucpu_connection->rsp_buf, ret);
+	}
+
+	ucpu_observe_packet(ucpu_connection, ucpu_connection->rsp_buf, ret, timestamp_ns);
+	return ret;
+}
+
+void ucpu_rx_ring_init(ucpu_rx_ring_t *ring)
+{
+	int i;
 
-		close(ucpu_connection->sock);
-		ucpu_connection->sock = -1;
+	ring->head = 0;
+	ring->tail = 0;
+
+	for (i = 0; i < UCPU_RX_RING_SIZE; i++) {
+		ring->packets[i].data = ring->packets[i].storage;
+	}
+}
+
+int ucpu_att_receive_batch(ucpu_connection_t *ucpu_connection, ucpu_rx_ring_t *ring)
+{
+	ucpu_rx_packet_t *packets[UCPU_RX_RING_SIZE];
+	ucpu_rx_packet_t *packet;
+	uint64_t timestamp_ns;
+	int i, free_count, ret;
+
+	free_count = UCPU_RX_RING_SIZE - UCPU_RX_RING_COUNT(ring);
+
+	if (free_count == 0) {
+		return 0;
+	}
+
+	/* Packets are received directly into the free slots of the ring. */
+	for (i = 0; i < free_count; i++) {
+		packets[i] = ring->packets + ((ring->tail + (uint32_t)i) & (UCPU_RX_RING_SIZE - 1));
+	}
+
+	ret = ucpu_connection->transport->receive_batch(ucpu_connection, packets, free_count);
+
+	if (ret < 0) {
+		ucpu_connection_lost(ucpu_connection);
 		return -1;
 	}
 
-	return (int)ret;
+	/* A single timestamp is used for the whole batch. */
+	timestamp_ns = ucpu_get_time_ns();
+
+	for (i = 0; i < ret; i++) {
+		packet = packets[i];
+		packet->timestamp_ns = timestamp_ns;
+
+		if (ucpu_connection->recorder != NULL) {
+			ucpu_recorder_write(ucpu_connection->recorder, ucpu_connection->connection_id,
+				UCPU_RECORD_RECEIVED, timestamp_ns, packet->data, packet->length);
+		}
+
+		ucpu_observe_packet(ucpu_connection, packet->data, packet->length, timestamp_ns);
+	}
+
+	ring->tail += (uint32_t)ret;
+	return ret;
+}
+
+void ucpu_tx_queue_init(ucpu_tx_queue_t *tx_queue, uint32_t high_watermark, uint32_t low_watermark)
+{
+	if (high_watermark > UCPU_TX_QUEUE_SIZE) {
+		high_watermark = UCPU_TX_QUEUE_SIZE;
+	}
+
+	if (low_watermark > high_watermark) {
+		low_watermark = high_watermark;
+	}
+
+	tx_queue->head = 0;
+	tx_queue->tail = 0;
+	tx_queue->high_watermark = high_watermark;
+	tx_queue->low_watermark = low_watermark;
+	tx_queue->congested = 0;
+	tx_queue->write_wait = 0;
+	tx_queue->coalesce = 0;
+	tx_queue->superseded = 0;
+}
+
+void ucpu_tx_queue_set_coalescing(ucpu_tx_queue_t *tx_queue, uint8_t coalesce)
+{
+	tx_queue->coalesce = coalesce;
+}
+
+static int ucpu_is_coalescable(ucpu_tx_queue_t *tx_queue, const hub_port_output_command_t *port_output_command)
+{
+	switch (port_output_command->sub_command) {
+	case WRITE_DIRECT_MODE_DATA:
+	case HUB_MOTOR_START_SPEED:
+		return (tx_queue->coalesce & UCPU_TX_COALESCE_SETPOINTS) != 0;
+	case HUB_MOTOR_GOTO_ABSOLUTE_POSITION:
+		return (tx_queue->coalesce & UCPU_TX_COALESCE_POSITIONS) != 0;
+	}
+	return 0;
+}
+
+static const hub_port_output_command_t *ucpu_get_port_output_command(const uint8_t *packet, uint16_t packet_len)
+{
+	const hub_port_output_command_t *port_output_command = (const hub_port_output_command_t*)packet;
+
+	/* The mode byte of WRITE_DIRECT_MODE_DATA must also be present. */
+	if (packet_len <= sizeof(hub_port_output_command_t)
+			|| port_output_command->common_message_header.opcode != ATT_WRITE_CMD
+			|| port_output_command->common_message_header.message_type != PORT_OUTPUT_COMMAND) {
+		return NULL;
+	}
+	return port_output_command;
+}
+
+/* Returns with non-zero if the packet replaced a queued packet. */
+static int ucpu_tx_queue_coalesce(ucpu_connection_t *ucpu_connection, const uint8_t *packet, uint16_t packet_len)
+{
+	ucpu_tx_queue_t *tx_queue = ucpu_connection->tx_queue;
+	const hub_port_output_command_t *new_command = ucpu_get_port_output_command(packet, packet_len);
+	const hub_port_output_command_t *queued_command;
+	ucpu_tx_packet_t *tx_packet;
+	uint32_t index;
+
+	if (new_command == NULL || !ucpu_is_coalescable(tx_queue, new_command)) {
+		return 0;
+	}
+
+	/* Each pipelined command is expected to be executed. */
+	if (ucpu_connection->pipeline != NULL
+			&& UCPU_PIPELINE_HAS_PORT(ucpu_connection->pipeline, new_command->port_id)) {
+		return 0;
+	}
+
+	/* Search the last queued command of the same port. */
+	for (index = tx_queue->tail; index != tx_queue->head; index--) {
+		tx_packet = tx_queue->packets + ((index - 1) & (UCPU_TX_QUEUE_SIZE - 1));
+		queued_command = ucpu_get_port_output_command(tx_packet->data, tx_packet->length);
+
+		if (queued_command == NULL || queued_command->port_id != new_command->port_id) {
+			continue;
+		}
+
+		/* A replaced command with different flags would leave a feedback token unfinished. */
+		if (queued_command->sub_command != new_command->sub_command
+				|| queued_command->startup_and_complete != new_command->startup_and_complete
+				|| (new_command->sub_command == WRITE_DIRECT_MODE_DATA
+					&& tx_packet->data[sizeof(hub_port_output_command_t)] != packet[sizeof(hub_port_output_command_t)])) {
+			return 0;
+		}
+
+		tx_packet->length = (uint8_t)packet_len;
+		memcpy(tx_packet->data, packet, packet_len);
+		tx_queue->superseded++;
+		return 1;
+	}
+
+	return 0;
+}
+
+int ucpu_set_tx_queue(ucpu_connection_t *ucpu_connection, ucpu_tx_queue_t *tx_queue)
+{
+	int ret = 0;
+
+	/* Queued packets are sent before the queue is detached. */
+	if (ucpu_connection->tx_queue != NULL) {
+		while (ret == 0 && UCPU_TX_QUEUE_DEPTH(ucpu_connection->tx_queue) > 0) {
+			ret = ucpu_tx_flush(ucpu_connection);
+		}
+	}
+
+	ucpu_connection->tx_queue = tx_queue;
+
+	if (ucpu_connection->event_loop != NULL) {
+		ucpu_event_loop_update(ucpu_connection);
+	}
+	return ret;
+}
+
+int ucpu_tx_queue_push(ucpu_connection_t *ucpu_connection, const void *packet, uint16_t packet_len)
+{
+	ucpu_tx_queue_t *tx_queue = ucpu_connection->tx_queue;
+	ucpu_tx_packet_t *tx_packet;
+	uint32_t depth = tx_queue->tail - tx_queue->head;
+
+	if (packet_len > sizeof(tx_packet->data)) {
+		return 1;
+	}
+
+	if (tx_queue->coalesce != 0 && depth > 0
+			&& ucpu_tx_queue_coalesce(ucpu_connection, (const uint8_t*)packet, packet_len)) {
+		return 0;
+	}
+
+	if (depth >= UCPU_TX_QUEUE_SIZE) {
+		tx_queue->congested = 1;
+		return UCPU_TX_QUEUE_FULL;
+	}
+
+	tx_packet = tx_queue->packets + (tx_queue->tail & (UCPU_TX_QUEUE_SIZE - 1));
+	tx_packet->length = (uint8_t)packet_len;
+	memcpy(tx_packet->data, packet, packet_len);
+	tx_queue->tail++;
+
+	if (ucpu_connection->feedback_tracker != NULL) {
+		ucpu_feedback_register(ucpu_connection, (const uint8_t*)packet, packet_len);
+	}
+
+	if (depth + 1 >= tx_queue->high_watermark) {
+		tx_queue->congested = 1;
+	}
+
+	/* Only the first packet enables waiting for writable events. */
+	if (depth == 0 && ucpu_connection->event_loop != NULL) {
+		return ucpu_event_loop_update(ucpu_connection);
+	}
+	return 0;
+}
+
+int ucpu_tx_flush(ucpu_connection_t *ucpu_connection)
+{
+	ucpu_tx_queue_t *tx_queue = ucpu_connection->tx_queue;
+	struct iovec iovecs[UCPU_TX_QUEUE_SIZE];
+	ucpu_tx_packet_t *tx_packet;
+	uint64_t timestamp_ns;
+	int i, depth, ret;
+
+	if (ucpu_connection->sock < 0) {
+		return 1;
+	}
+
+	depth = UCPU_TX_QUEUE_DEPTH(tx_queue);
+
+	if (depth > 0) {
+		for (i = 0; i < depth; i++) {
+			tx_packet = tx_queue->packets + ((tx_queue->head + (uint32_t)i) & (UCPU_TX_QUEUE_SIZE - 1));
+
+			iovecs[i].iov_base = tx_packet->data;
+			iovecs[i].iov_len = tx_packet->length;
+		}
+
+		/* The packets are passed to the transport without copying. */
+		ret = ucpu_connection->transport->send_batch(ucpu_connection, iovecs, depth);
+
+		if (ret < 0) {
+			ucpu_connection_lost(ucpu_connection);
+			return 1;
+		}
+
+		if (ucpu_connection->recorder != NULL && ret > 0) {
+			timestamp_ns = ucpu_get_time_ns();
+
+			for (i = 0; i < ret; i++) {
+				ucpu_recorder_write(ucpu_connection->recorder, ucpu_connection->connection_id, UCPU_RECORD_SENT,
+					timestamp_ns, (const uint8_t*)iovecs[i].iov_base, (int)iovecs[i].iov_len);
+			}
+		}
+
+		tx_queue->head += (uint32_t)ret;
+
+		if (UCPU_TX_QUEUE_DEPTH(tx_queue) <= (int)tx_queue->low_watermark) {
+			tx_queue->congested = 0;
+		}
+	}
+
+	if (ucpu_connection->event_loop != NULL) {
+		return ucpu_event_loop_update(ucpu_connection);
+	}
+	return 0;
 }
 
 int ucpu_send_command(ucpu_connection_t *ucpu_connection, hub_common_message_header_t *message, uint16_t message_len)
@@ -77,5 +446,34 @@ int ucpu_send_command(ucpu_connection_t *ucpu_connection, hub_common_message_hea
 	message->length = (uint8_t)(message_len - 3);
 	message->hub_id = 0;
 
-	return ucpu_att_send(ucpu_connection, message, message_len);
+	if (ucpu_connection->pipeline != NULL && message->message_type == PORT_OUTPUT_COMMAND
+			&& message_len >= sizeof(hub_port_output_command_t)
+			&& UCPU_PIPELINE_HAS_PORT(ucpu_connection->pipeline, ((hub_port_output_command_t*)message)->port_id)) {
+		return ucpu_pipeline_push(ucpu_connection, (hub_port_output_command_t*)message, message_len);
+	}
+
+	return ucpu_transmit(ucpu_connection, message, message_len);
+}
+
+int ucpu_transmit(ucpu_connection_t *ucpu_connection, hub_common_message_header_t *message, uint16_t message_len)
+{
+	int ret;
+
+	if (ucpu_connection->supervisor != NULL && !UCPU_SUPERVISOR_CAN_SEND(ucpu_connection->supervisor)) {
+		return 1;
+	}
+
+	if (ucpu_connection->tx_queue != NULL) {
+		return ucpu_tx_queue_push(ucpu_connection, message, message_len);
+	}
+
+	ret = ucpu_att_send(ucpu_connection, message, message_len);
+	if (ret != 0) {
+		return ret;
+	}
+
+	if (ucpu_connection->feedback_tracker != NULL) {
+		ucpu_feedback_register(ucpu_connection, (const uint8_t*)message, message_len);
+	}
+	return 0;
 }
@@ -0,0 +1,121 @@
+/*
+ *    uc-powered-up (micro/universal c implementation of powered up, you see powered up, ...)
+ *
+ *    Copyright Zoltan Herczeg (hzmester@freemail.hu). All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright notice, this list of
+ *      conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *      of conditions and the following disclaimer in the documentation and/or other materials
+ *      provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER(S) AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER(S) OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef BROKER_H_
+#define BROKER_H_
+
+#include "globals.h"
+
+#include <stdatomic.h>
+
+/* Hub broker. A Hub accepts only one connection, so the broker daemon (see
+ * tools/broker.c) owns the connections, and local clients access the Hubs
+ * through it. Clients connect to the UNIX SOCK_SEQPACKET socket of the daemon,
+ * and send their commands as ATT packets, which are merged into the transmit
+ * queue of the Hub. The received notifications of all Hubs are written once
+ * into a ring in shared memory, which is mapped by each client, and the
+ * clients are woken by a short message on their socket after each batch.
+ *
+ * Clients use the broker transport, so the library functions work the same
+ * way as with a direct connection. The notifications are shared, except the
+ * command feedbacks: the daemon tracks which client sent the commands of each
+ * port, and a feedback is only delivered to the client whose command it
+ * reports. A client whose queued command is replaced by a coalesced command
+ * receives a discarded feedback from the daemon. */
+
+/* Must be a power of 2. */
+#define UCPU_BROKER_RING_SIZE 4096
+#define UCPU_BROKER_MESSAGE_LENGTH 64
+#define UCPU_BROKER_DEFAULT_PATH "/tmp/ucpu-broker.sock"
+/* Client index of the notifications delivered to all clients. */
+#define UCPU_BROKER_ALL_CLIENTS 0xff
+
+/* Protocol. The first message of a client is a hello message, and the daemon
+ * replies with a hello message, which carries the file descriptor of the
+ * shared ring. Then the client sends ATT packets, and the daemon sends wakeup
+ * messages. A client can also send a wakeup message, which requests a wakeup
+ * message from the daemon. */
+
+#define UCPU_BROKER_STATUS_OK 0
+#define UCPU_BROKER_STATUS_INVALID_HUB 1
+
+typedef struct {
+	uint8_t magic[4];
+	uint8_t hub_index;
+	/* Valid in replies. */
+	uint8_t status;
+	uint8_t handle[2];
+	uint8_t client_index;
+	uint8_t reserved[3];
+} ucpu_broker_hello_t;
+
+typedef struct {
+	uint8_t wakeup;
+} ucpu_broker_wakeup_t;
+
+/* A slot is valid when its sequence is equal to its position + 1. The daemon
+ * sets the sequence to zero while the slot is written. */
+typedef struct {
+	_Atomic uint64_t sequence;
+	uint64_t timestamp_ns;
+	uint8_t hub_index;
+	/* The only client which receives the notification, or UCPU_BROKER_ALL_CLIENTS. */
+	uint8_t client_index;
+	uint8_t length;
+	uint8_t reserved[5];
+	uint8_t data[UCPU_BROKER_MESSAGE_LENGTH];
+} ucpu_broker_slot_t;
+
+typedef struct {
+	uint8_t magic[8];
+	uint32_t size;
+	uint32_t reserved;
+	/* Number of slots written since the daemon is started. */
+	_Alignas(64) _Atomic uint64_t tail;
+	_Alignas(64) ucpu_broker_slot_t slots[UCPU_BROKER_RING_SIZE];
+} ucpu_broker_ring_t;
+
+extern const uint8_t ucpu_broker_magic[8];
+
+typedef struct {
+	const char *path;
+	uint8_t hub_index;
+	/* Assigned by the daemon. */
+	uint8_t client_index;
+	const ucpu_broker_ring_t *ring;
+	uint64_t position;
+	/* Number of notifications overwritten before they were read. */
+	uint64_t lost_count;
+} ucpu_broker_client_t;
+
+extern const ucpu_transport_t ucpu_broker_transport;
+
+/* Connects to a Hub through the broker. The client must be valid until the
+ * connection is closed by ucpu_disconnect. Returns with 0 on success. */
+int ucpu_broker_connect(ucpu_connection_t *ucpu_connection, ucpu_broker_client_t *broker_client,
+	const char *path, uint8_t hub_index);
+
+#endif /* BROKER_H_ */
@@ -0,0 +1,287 @@
+/*
+ *    uc-powered-up (micro/universal c implementation of powered up, you see powered up, ...)
+ *
+ *    Copyright Zoltan Herczeg (hzmester@freemail.hu). All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright notice, this list of
+ *      conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *      of conditions and the following disclaimer in the documentation and/or other materials
+ *      provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER(S) AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER(S) OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Client side of the Hub broker. */
+
+#include "broker.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+const uint8_t ucpu_broker_magic[8] = { 'U', 'C', 'P', 'U', 'B', 'R', 'K', '2' };
+
+/* Receives the hello reply with the file descriptor of the ring. Returns with the descriptor, or -1 on error. */
+static int ucpu_broker_receive_hello(int sock, ucpu_broker_hello_t *hello)
+{
+	struct msghdr msg;
+	struct iovec iovec;
+	struct cmsghdr *cmsg;
+	union {
+		char buffer[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} control;
+	int fd = -1;
+
+	iovec.iov_base = hello;
+	iovec.iov_len = sizeof(ucpu_broker_hello_t);
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iovec;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buffer;
+	msg.msg_controllen = sizeof(control.buffer);
+
+	if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != sizeof(ucpu_broker_hello_t)) {
+		return -1;
+	}
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+		memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+	}
+	return fd;
+}
+
+static int ucpu_broker_open(ucpu_connection_t *ucpu_connection, const void *parameters)
+{
+	ucpu_broker_client_t *broker_client = (ucpu_broker_client_t*)parameters;
+	struct sockaddr_un address;
+	ucpu_broker_hello_t hello;
+	void *ring;
+	int sock, fd;
+
+	if (strlen(broker_client->path) >= sizeof(address.sun_path)) {
+		return 1;
+	}
+
+	sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (sock < 0) {
+		return 1;
+	}
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, broker_client->path);
+
+	memset(&hello, 0, sizeof(hello));
+	memcpy(hello.magic, ucpu_broker_magic, sizeof(hello.magic));
+	hello.hub_index = broker_client->hub_index;
+
+	/* The socket is blocking until the hello reply is received. */
+	if (connect(sock, (struct sockaddr*)&address, sizeof(address)) != 0
+			|| send(sock, &hello, sizeof(hello), MSG_NOSIGNAL) != sizeof(hello)) {
+		close(sock);
+		return 1;
+	}
+
+	fd = ucpu_broker_receive_hello(sock, &hello);
+	if (fd < 0) {
+		close(sock);
+		return 1;
+	}
+
+	ring = mmap(NULL, sizeof(ucpu_broker_ring_t), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (ring == MAP_FAILED) {
+		close(sock);
+		return 1;
+	}
+
+	if (hello.status != UCPU_BROKER_STATUS_OK
+			|| memcmp(hello.magic, ucpu_broker_magic, sizeof(hello.magic)) != 0
+			|| memcmp(((const ucpu_broker_ring_t*)ring)->magic, ucpu_broker_magic, sizeof(ucpu_broker_magic)) != 0
+			|| fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK) != 0) {
+		munmap(ring, sizeof(ucpu_broker_ring_t));
+		close(sock);
+		return 1;
+	}
+
+	broker_client->ring = (const ucpu_broker_ring_t*)ring;
+	broker_client->client_index = hello.client_index;
+	/* Only new notifications are received. */
+	broker_client->position = atomic_load_explicit(&broker_client->ring->tail, memory_order_acquire);
+	broker_client->lost_count = 0;
+
+	ucpu_connection->sock = sock;
+	ucpu_connection->transport_data = broker_client;
+	ucpu_connection->handle[0] = hello.handle[0];
+	ucpu_connection->handle[1] = hello.handle[1];
+	return 0;
+}
+
+/* Copies the next notification of the Hub. Returns with 1 on success, 0 when no more notifications are available. */
+static int ucpu_broker_pop(ucpu_broker_client_t *broker_client, ucpu_rx_packet_t *packet)
+{
+	const ucpu_broker_ring_t *ring = broker_client->ring;
+	const ucpu_broker_slot_t *slot;
+	uint64_t tail, position;
+	uint8_t hub_index, client_index;
+	int length;
+
+	while (1) {
+		tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+		position = broker_client->position;
+
+		if (position >= tail) {
+			return 0;
+		}
+
+		slot = ring->slots + (position & (UCPU_BROKER_RING_SIZE - 1));
+
+		if (atomic_load_explicit(&slot->sequence, memory_order_acquire) == position + 1) {
+			hub_index = slot->hub_index;
+			client_index = slot->client_index;
+			length = slot->length;
+			if (length > UCPU_BROKER_MESSAGE_LENGTH) {
+				length = UCPU_BROKER_MESSAGE_LENGTH;
+			}
+			memcpy(packet->storage, slot->data, (size_t)length);
+
+			atomic_thread_fence(memory_order_acquire);
+			if (atomic_load_explicit(&slot->sequence, memory_order_relaxed) == position + 1) {
+				broker_client->position = position + 1;
+
+				if (hub_index != broker_client->hub_index
+						|| (client_index != UCPU_BROKER_ALL_CLIENTS && client_index != broker_client->client_index)) {
+					continue;
+				}
+
+				packet->data = packet->storage;
+				packet->length = length;
+				return 1;
+			}
+		}
+
+		/* The slot is overwritten by the daemon: the client skips to the oldest slot. */
+		position = (tail > UCPU_BROKER_RING_SIZE) ? tail - UCPU_BROKER_RING_SIZE + 1 : 0;
+		if (position <= broker_client->position) {
+			position = broker_client->position + 1;
+		}
+
+		broker_client->lost_count += position - broker_client->position;
+		broker_client->position = position;
+	}
+}
+
+static int ucpu_broker_receive_batch(ucpu_connection_t *ucpu_connection, ucpu_rx_packet_t **packets, int count)
+{
+	ucpu_broker_client_t *broker_client = (ucpu_broker_client_t*)ucpu_connection->transport_data;
+	ucpu_broker_wakeup_t wakeup;
+	ssize_t ret;
+	int received = 0;
+
+	/* The wakeups are consumed before the ring is read, so a notification
+	 * written after this point always makes the socket readable again. */
+	while (1) {
+		ret = recv(ucpu_connection->sock, &wakeup, sizeof(wakeup), MSG_DONTWAIT);
+
+		if (ret > 0) {
+			continue;
+		}
+
+		/* Zero means the daemon is stopped. */
+		if (ret < 0 && (errno == EWOULDBLOCK || errno == EAGAIN)) {
+			break;
+		}
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		}
+		return -1;
+	}
+
+	while (received < count && ucpu_broker_pop(broker_client, packets[received])) {
+		received++;
+	}
+
+	/* Notifications are left in the ring, so the daemon is asked for another wakeup. */
+	if (received == count && broker_client->position != atomic_load_explicit(&broker_client->ring->tail, memory_order_acquire)) {
+		wakeup.wakeup = 1;
+		send(ucpu_connection->sock, &wakeup, sizeof(wakeup), MSG_DONTWAIT | MSG_NOSIGNAL);
+	}
+
+	return received;
+}
+
+static int ucpu_broker_receive(ucpu_connection_t *ucpu_connection, uint8_t *buffer, int buffer_size)
+{
+	ucpu_rx_packet_t packet;
+	ucpu_rx_packet_t *packets[1];
+	int ret;
+
+	packets[0] = &packet;
+	ret = ucpu_broker_receive_batch(ucpu_connection, packets, 1);
+
+	if (ret <= 0) {
+		return ret;
+	}
+
+	if (packet.length > buffer_size) {
+		packet.length = buffer_size;
+	}
+
+	memcpy(buffer, packet.data, (size_t)packet.length);
+	return packet.length;
+}
+
+static void ucpu_broker_close(ucpu_connection_t *ucpu_connection)
+{
+	ucpu_broker_client_t *broker_client = (ucpu_broker_client_t*)ucpu_connection->transport_data;
+
+	if (broker_client != NULL && broker_client->ring != NULL) {
+		munmap((void*)broker_client->ring, sizeof(ucpu_broker_ring_t));
+		broker_client->ring = NULL;
+	}
+
+	ucpu_socket_close(ucpu_connection);
+}
+
+/* Commands are sent to the daemon as they would be sent to the Hub. */
+const ucpu_transport_t ucpu_broker_transport = {
+	ucpu_broker_open,
+	ucpu_socket_send,
+	ucpu_socket_send_batch,
+	ucpu_broker_receive,
+	ucpu_broker_receive_batch,
+	ucpu_broker_close,
+};
+
+int ucpu_broker_connect(ucpu_connection_t *ucpu_connection, ucpu_broker_client_t *broker_client,
+	const char *path, uint8_t hub_index)
+{
+	broker_client->path = path;
+	broker_client->hub_index = hub_index;
+	broker_client->ring = NULL;
+	broker_client->position = 0;
+	broker_client->lost_count = 0;
+
+	return ucpu_transport_open(ucpu_connection, &ucpu_broker_transport, broker_client);
+}
@@ -35,6 +35,12 @@
 		(target)[3] = (uint8_t)((value) >> 24); \
 	} while (0)
 
+#define UCPU_SET_16BIT_VALUE(target, value) \
+	do { \
+		(target)[0] = (uint8_t)(value); \
+		(target)[1] = (uint8_t)((value) >> 8); \
+	} while (0)
+
 #define UCPU_INIT_PORT_OUTPUT(message, port_id_, startup_and_complete_, sub_command_) \
 	do { \
 		(message).port_output_command.common_message_header.message_type = PORT_OUTPUT_COMMAND; \
@@ -43,15 +49,15 @@
 		(message).port_output_command.sub_command = (sub_command_); \
 	} while (0)
 
-int ucpu_is_notification(ucpu_connection_t *ucpu_connection, int message_length)
+int ucpu_is_notification_packet(ucpu_connection_t *ucpu_connection, const uint8_t *packet, int message_length)
 {
-	hub_common_message_header_t *common_message_header;
+	const hub_common_message_header_t *common_message_header;
 
 	if (message_length < sizeof(hub_common_message_header_t)) {
 		return 0;
 	}
 
-	common_message_header = (hub_common_message_header_t*)ucpu_connection->rsp_buf;
+	common_message_header = (const hub_common_message_header_t*)packet;
 
 	return (common_message_header->opcode == ATT_HANDLE_VALUE_NTF
 		&& common_message_header->handle[0] == ucpu_connection->handle[0]
@@ -60,16 +66,21 @@ int ucpu_is_notification(ucpu_connection_t *ucpu_connection, int message_length)
 		&& common_message_header->hub_id == 0);
 }
 
-int ucpu_is_attached_io_update(ucpu_connection_t *ucpu_connection, int message_length)
+int ucpu_is_notification(ucpu_connection_t *ucpu_connection, int message_length)
 {
-	hub_attached_io_t *attached_io;
+	return ucpu_is_notification_packet(ucpu_connection, ucpu_connection->rsp_buf, message_length);
+}
+
+int ucpu_is_attached_io_update_packet(const uint8_t *packet, int message_length)
+{
+	const hub_attached_io_t *attached_io;
 	int expected_length;
 
 	if (message_length < sizeof(hub_attached_io_t)) {
 		return -1;
 	}
 
-	attached_io = (hub_attached_io_t*)ucpu_connection->rsp_buf;
+	attached_io = (const hub_attached_io_t*)packet;
 
 	if (attached_io->common_message_header.message_type != HUB_ATTACHED_IO
 			|| attached_io->event > HUB_ATTACHED_IO_ATTACHED_VIRTUAL) {
@@ -94,15 +105,20 @@ int ucpu_is_attached_io_update(ucpu_connection_t *ucpu_connection, int message_l
 	return -1;
 }
 
-int ucpu_is_port_value_single(ucpu_connection_t *ucpu_connection, int message_length)
+int ucpu_is_attached_io_update(ucpu_connection_t *ucpu_connection, int message_length)
 {
-	hub_port_value_single_t *port_value_single;
+	return ucpu_is_attached_io_update_packet(ucpu_connection->rsp_buf, message_length);
+}
+
+int ucpu_is_port_value_single_packet(const uint8_t *packet, int message_length)
+{
+	const hub_port_value_single_t *port_value_single;
 
 	if (message_length <= sizeof(hub_port_value_single_t)) {
 		return -1;
 	}
 
-	port_value_single = (hub_port_value_single_t*)ucpu_connection->rsp_buf;
+	port_value_single = (const hub_port_value_single_t*)packet;
 
 	if (port_value_single->common_message_header.message_type == HUB_PORT_VALUE_SINGLE) {
 		return port_value_single->port_id;
@@ -111,6 +127,83 @@ int ucpu_is_port_value_single(ucpu_connection_t *ucpu_connection, int message_le
 	return -1;
 }
 
+int ucpu_is_port_value_single(ucpu_connection_t *ucpu_connection, int message_length)
+{
+	return ucpu_is_port_value_single_packet(ucpu_connection->rsp_buf, message_length);
+}
+
+int ucpu_is_port_value_combined_packet(const uint8_t *packet, int message_length)
+{
+	const hub_port_value_combined_t *port_value_combined;
+
+	if (message_length <= sizeof(hub_port_value_combined_t)) {
+		return -1;
+	}
+
+	port_value_combined = (const hub_port_value_combined_t*)packet;
+
+	if (port_value_combined->common_message_header.message_type == HUB_PORT_VALUE_COMBINED) {
+		return port_value_combined->port_id;
+	}
+
+	return -1;
+}
+
+int ucpu_is_port_value_combined(ucpu_connection_t *ucpu_connection, int message_length)
+{
+	return ucpu_is_port_value_combined_packet(ucpu_connection->rsp_buf, message_length);
+}
+
+int ucpu_decode_port_value_combined(const ucpu_combined_format_t *format,
+	const uint8_t *packet, int message_length, ucpu_combined_values_t *values)
+{
+	const hub_port_value_combined_t *port_value_combined = (const hub_port_value_combined_t*)packet;
+	const uint8_t *src = packet + sizeof(hub_port_value_combined_t);
+	const uint8_t *src_end = packet + message_length;
+	uint32_t pointer;
+	int i;
+
+	pointer = (uint32_t)port_value_combined->dataset_pointer[0]
+		| ((uint32_t)port_value_combined->dataset_pointer[1] << 8);
+
+	/* Bits which are not part of the combination. */
+	if (pointer >> format->count) {
+		return 1;
+	}
+
+	values->present = (uint16_t)pointer;
+
+	/* The values are stored in the order of the combination. */
+	for (i = 0; i < format->count; i++) {
+		if (!(pointer & (1u << i))) {
+			continue;
+		}
+
+		if (src + format->values[i].value_size > src_end) {
+			return 1;
+		}
+
+		switch (format->values[i].value_size) {
+		case 1:
+			values->values[i] = (int8_t)src[0];
+			break;
+		case 2:
+			values->values[i] = (int16_t)((uint32_t)src[0] | ((uint32_t)src[1] << 8));
+			break;
+		case 4:
+			values->values[i] = (int32_t)((uint32_t)src[0] | ((uint32_t)src[1] << 8)
+				| ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24));
+			break;
+		default:
+			return 1;
+		}
+
+		src += format->values[i].value_size;
+	}
+
+	return src != src_end;
+}
+
 int ucpu_port_information_request(ucpu_connection_t *ucpu_connection, uint8_t port_id, uint8_t information_type)
 {
 	hub_port_information_request_t port_information_request;
@@ -123,6 +216,20 @@ int ucpu_port_information_request(ucpu_connection_t *ucpu_connection, uint8_t po
 		&port_information_request.common_message_header, sizeof(hub_port_information_request_t));
 }
 
+int ucpu_port_mode_information_request(ucpu_connection_t *ucpu_connection, uint8_t port_id,
+	uint8_t mode, uint8_t mode_information_type)
+{
+	hub_port_mode_information_request_t port_mode_information_request;
+
+	port_mode_information_request.common_message_header.message_type = HUB_PORT_MODE_INFORMATION_REQUEST;
+	port_mode_information_request.port_id = port_id;
+	port_mode_information_request.mode = mode;
+	port_mode_information_request.mode_information_type = mode_information_type;
+
+	return ucpu_send_command(ucpu_connection,
+		&port_mode_information_request.common_message_header, sizeof(hub_port_mode_information_request_t));
+}
+
 int ucpu_port_input_format_setup(ucpu_connection_t *ucpu_connection, uint8_t port_id, uint8_t mode,
 	uint32_t delta_interval, uint8_t notification_enabled)
 {
@@ -138,6 +245,74 @@ int ucpu_port_input_format_setup(ucpu_connection_t *ucpu_connection, uint8_t por
 		&port_input_format_setup.common_message_header, sizeof(hub_port_input_format_setup_t));
 }
 
+int ucpu_port_input_format_setup_combined(ucpu_connection_t *ucpu_connection, uint8_t port_id, uint8_t sub_command)
+{
+	hub_port_input_format_setup_combined_t setup_combined;
+
+	setup_combined.common_message_header.message_type = HUB_PORT_INPUT_FORMAT_SETUP_COMBINED;
+	setup_combined.port_id = port_id;
+	setup_combined.sub_command = sub_command;
+
+	return ucpu_send_command(ucpu_connection,
+		&setup_combined.common_message_header, sizeof(hub_port_input_format_setup_combined_t));
+}
+
+int ucpu_port_set_mode_combination(ucpu_connection_t *ucpu_connection, uint8_t port_id,
+	uint8_t combination_index, const ucpu_combined_format_t *format)
+{
+	hub_port_set_mode_combination_t set_mode_combination;
+	int i;
+
+	if (format->count == 0 || format->count > HUB_COMBINED_MAX_MODE_DATASETS) {
+		return 1;
+	}
+
+	set_mode_combination.setup_combined.common_message_header.message_type = HUB_PORT_INPUT_FORMAT_SETUP_COMBINED;
+	set_mode_combination.setup_combined.port_id = port_id;
+	set_mode_combination.setup_combined.sub_command = HUB_COMBINED_SET_MODE_AND_DATASET;
+	set_mode_combination.combination_index = combination_index;
+
+	for (i = 0; i < format->count; i++) {
+		set_mode_combination.mode_dataset[i] = (uint8_t)((format->values[i].mode << 4)
+			| (format->values[i].dataset & 0xf));
+	}
+
+	/* Only the used part of mode_dataset is sent. */
+	return ucpu_send_command(ucpu_connection, &set_mode_combination.setup_combined.common_message_header,
+		(uint16_t)(sizeof(hub_port_set_mode_combination_t) - HUB_COMBINED_MAX_MODE_DATASETS + format->count));
+}
+
+int ucpu_port_subscribe_combined(ucpu_connection_t *ucpu_connection, uint8_t port_id,
+	uint8_t combination_index, const ucpu_combined_format_t *format, uint32_t delta_interval)
+{
+	uint32_t modes = 0;
+	int i;
+
+	if (ucpu_port_input_format_setup_combined(ucpu_connection, port_id, HUB_COMBINED_LOCK) != 0) {
+		return 1;
+	}
+
+	/* Each mode of the combination must be configured while the port is locked. */
+	for (i = 0; i < format->count; i++) {
+		if (modes & (1u << format->values[i].mode)) {
+			continue;
+		}
+
+		modes |= 1u << format->values[i].mode;
+
+		if (ucpu_port_input_format_setup(ucpu_connection, port_id, format->values[i].mode, delta_interval, 1) != 0) {
+			return 1;
+		}
+	}
+
+	if (ucpu_port_set_mode_combination(ucpu_connection, port_id, combination_index, format) != 0) {
+		return 1;
+	}
+
+	return ucpu_port_input_format_setup_combined(ucpu_connection, port_id,
+		HUB_COMBINED_UNLOCK_AND_START_MULTI_ENABLED);
+}
+
 int ucpu_virtual_port_connect(ucpu_connection_t *ucpu_connection, uint8_t port_id_a, uint8_t port_id_b)
 {
 	hub_virtual_port_connect_t virtual_port_connect;
@@ -167,7 +342,7 @@ int ucpu_set_led_color(ucpu_connection_t *ucpu_connection, uint8_t port_id, uint
 {
 	hub_led_color_t led_color;
 
-	UCPU_INIT_PORT_OUTPUT(led_color, port_id, 0x00, WRITE_DIRECT_MODE_DATA);
+	UCPU_INIT_PORT_OUTPUT(led_color, port_id, PORT_OUTPUT_STARTUP_BUFFER, WRITE_DIRECT_MODE_DATA);
 
 	led_color.mode = 0x0; /* Indexed mode. */
 	led_color.color_id = color_id;
@@ -180,7 +355,7 @@ int ucpu_set_led_rgb(ucpu_connection_t *ucpu_connection, uint8_t port_id, uint8_
 {
 	hub_led_rgb_t led_rgb;
 
-	UCPU_INIT_PORT_OUTPUT(led_rgb, port_id, 0x00, WRITE_DIRECT_MODE_DATA);
+	UCPU_INIT_PORT_OUTPUT(led_rgb, port_id, PORT_OUTPUT_STARTUP_BUFFER, WRITE_DIRECT_MODE_DATA);
 
 	led_rgb.mode = 0x1;
 	led_rgb.rgb[0] = r;
@@ -196,7 +371,8 @@ int ucpu_motor_start_speed(ucpu_connection_t *ucpu_connection, uint8_t port_id,
 {
 	hub_motor_start_speed_t motor_start_speed;
 
-	UCPU_INIT_PORT_OUTPUT(motor_start_speed, port_id, 0x10, HUB_MOTOR_START_SPEED);
+	UCPU_INIT_PORT_OUTPUT(motor_start_speed, port_id,
+		PORT_OUTPUT_STARTUP_IMMEDIATE | PORT_OUTPUT_COMPLETION_FEEDBACK, HUB_MOTOR_START_SPEED);
 	motor_start_speed.speed = speed;
 	motor_start_speed.max_power = max_power;
 	motor_start_speed.use_profile = use_profile;
@@ -210,7 +386,8 @@ int ucpu_motor_goto_absolute_position(ucpu_connection_t *ucpu_connection, uint8_
 {
 	hub_motor_goto_absolute_position_t motor_goto_absolute_position;
 
-	UCPU_INIT_PORT_OUTPUT(motor_goto_absolute_position, port_id, 0x10, HUB_MOTOR_GOTO_ABSOLUTE_POSITION);
+	UCPU_INIT_PORT_OUTPUT(motor_goto_absolute_position, port_id,
+		PORT_OUTPUT_STARTUP_IMMEDIATE | PORT_OUTPUT_COMPLETION_FEEDBACK, HUB_MOTOR_GOTO_ABSOLUTE_POSITION);
 	UCPU_SET_32BIT_VALUE(motor_goto_absolute_position.absolute_pos, absolute_pos);
 	motor_goto_absolute_position.speed = speed;
 	motor_goto_absolute_position.max_power = max_power;
@@ -220,3 +397,165 @@ int ucpu_motor_goto_absolute_position(ucpu_connection_t *ucpu_connection, uint8_
 	return ucpu_send_command(ucpu_connection,
 		&motor_goto_absolute_position.port_output_command.common_message_header, sizeof(hub_motor_goto_absolute_position_t));
 }
+
+static int ucpu_motor_set_acc_dec_time(ucpu_connection_t *ucpu_connection, uint8_t port_id,
+	uint8_t sub_command, uint16_t time_ms, int8_t profile_number)
+{
+	hub_motor_set_acc_dec_time_t motor_set_acc_dec_time;
+
+	UCPU_INIT_PORT_OUTPUT(motor_set_acc_dec_time, port_id,
+		PORT_OUTPUT_STARTUP_IMMEDIATE | PORT_OUTPUT_COMPLETION_FEEDBACK, sub_command);
+	UCPU_SET_16BIT_VALUE(motor_set_acc_dec_time.time, time_ms);
+	motor_set_acc_dec_time.profile_number = profile_number;
+
+	return ucpu_send_command(ucpu_connection,
+		&motor_set_acc_dec_time.port_output_command.common_message_header, sizeof(hub_motor_set_acc_dec_time_t));
+}
+
+int ucpu_motor_set_acc_time(ucpu_connection_t *ucpu_connection, uint8_t port_id,
+	uint16_t time_ms, int8_t profile_number)
+{
+	return ucpu_motor_set_acc_dec_time(ucpu_connection, port_id, HUB_MOTOR_SET_ACC_TIME, time_ms, profile_number);
+}
+
+int ucpu_motor_set_dec_time(ucpu_connection_t *ucpu_connection, uint8_t port_id,
+	uint16_t time_ms, int8_t profile_number)
+{
+	return ucpu_motor_set_acc_dec_time(ucpu_connection, port_id, HUB_MOTOR_SET_DEC_TIME, time_ms, profile_number);
+}
+
+int ucpu_motor_start_speed_dual(ucpu_connection_t *ucpu_connection, uint8_t port_id,
+	int8_t speed_1, int8_t speed_2, int8_t max_power, uint8_t use_profile)
+{
+	hub_motor_start_speed_dual_t motor_start_speed_dual;
+
+	UCPU_INIT_PORT_OUTPUT(motor_start_speed_dual, port_id,
+		PORT_OUTPUT_STARTUP_IMMEDIATE | PORT_OUTPUT_COMPLETION_FEEDBACK, HUB_MOTOR_START_SPEED_DUAL);
+	motor_start_speed_dual.speed_1 = speed_1;
+	motor_start_speed_dual.speed_2 = speed_2;
+	motor_start_speed_dual.max_power = max_power;
+	motor_start_speed_dual.use_profile = use_profile;
+
+	return ucpu_send_command(ucpu_connection,
+		&motor_start_speed_dual.port_output_command.common_message_header, sizeof(hub_motor_start_speed_dual_t));
+}
+
+int ucpu_motor_start_speed_for_time(ucpu_connection_t *ucpu_connection, uint8_t port_id,
+	uint16_t time_ms, int8_t speed, int8_t max_power, int8_t end_state, uint8_t use_profile)
+{
+	hub_motor_start_speed_for_time_t motor_start_speed_for_time;
+
+	UCPU_INIT_PORT_OUTPUT(motor_start_speed_for_time, port_id,
+		PORT_OUTPUT_STARTUP_IMMEDIATE | PORT_OUTPUT_COMPLETION_FEEDBACK, HUB_MOTOR_START_SPEED_FOR_TIME);
+	UCPU_SET_16BIT_VALUE(motor_start_speed_for_time.time, time_ms);
+	motor_start_speed_for_time.speed = speed;
+	motor_start_speed_for_time.max_power = max_power;
+	motor_start_speed_for_time.end_state = end_state;
+	motor_start_speed_for_time.use_profile = use_profile;
+
+	return ucpu_send_command(ucpu_connection,
+		&motor_start_speed_for_time.port_output_command.common_message_header, sizeof(hub_motor_start_speed_for_time_t));
+}
+
+int ucpu_motor_start_speed_for_time_dual(ucpu_connection_t *ucpu_connection, uint8_t port_id,
+	uint16_t time_ms, int8_t speed_1, int8_t speed_2, int8_t max_power, int8_t end_state, uint8_t use_profile)
+{
+	hub_motor_start_speed_for_time_dual_t motor_start_speed_for_time_dual;
+
+	UCPU_INIT_PORT_OUTPUT(motor_start_speed_for_time_dual, port_id,
+		PORT_OUTPUT_STARTUP_IMMEDIATE | PORT_OUTPUT_COMPLETION_FEEDBACK, HUB_MOTOR_START_SPEED_FOR_TIME_DUAL);
+	UCPU_SET_16BIT_VALUE(motor_start_speed_for_time_dual.time, time_ms);
+	motor_start_speed_for_time_dual.speed_1 = speed_1;
+	motor_start_speed_for_time_dual.speed_2 = speed_2;
+	motor_start_speed_for_time_dual.max_power = max_power;
+	motor_start_speed_for_time_dual.end_state = end_state;
+	motor_start_speed_for_time_dual.use_profile = use_profile;
+
+	return ucpu_send_command(ucpu_connection,
+		&motor_start_speed_for_time_dual.port_output_command.common_message_header,
+		sizeof(hub_motor_start_speed_for_time_dual_t));
+}
+
+int ucpu_motor_start_speed_for_degrees(ucpu_connection_t *ucpu_connection, uint8_t port_id,
+	int32_t degrees, int8_t speed, int8_t max_power, int8_t end_state, uint8_t use_profile)
+{
+	hub_motor_start_speed_for_degrees_t motor_start_speed_for_degrees;
+
+	UCPU_INIT_PORT_OUTPUT(motor_start_speed_for_degrees, port_id,
+		PORT_OUTPUT_STARTUP_IMMEDIATE | PORT_OUTPUT_COMPLETION_FEEDBACK, HUB_MOTOR_START_SPEED_FOR_DEGREES);
+	UCPU_SET_32BIT_VALUE(motor_start_speed_for_degrees.degrees, degrees);
+	motor_start_speed_for_degrees.speed = speed;
+	motor_start_speed_for_degrees.max_power = max_power;
+	motor_start_speed_for_degrees.end_state = end_state;
+	motor_start_speed_for_degrees.use_profile = use_profile;
+
+	return ucpu_send_command(ucpu_connection,
+		&motor_start_speed_for_degrees.port_output_command.common_message_header,
+		sizeof(hub_motor_start_speed_for_degrees_t));
+}
+
+int ucpu_motor_start_speed_for_degrees_dual(ucpu_connection_t *ucpu_connection, uint8_t port_id,
+	int32_t degrees, int8_t speed_1, int8_t speed_2, int8_t max_power, int8_t end_state, uint8_t use_profile)
+{
+	hub_motor_start_speed_for_degrees_dual_t motor_start_speed_for_degrees_dual;
+
+	UCPU_INIT_PORT_OUTPUT(motor_start_speed_for_degrees_dual, port_id,
+		PORT_OUTPUT_STARTUP_IMMEDIATE | PORT_OUTPUT_COMPLETION_FEEDBACK, HUB_MOTOR_START_SPEED_FOR_DEGREES_DUAL);
+	UCPU_SET_32BIT_VALUE(motor_start_speed_for_degrees_dual.degrees, degrees);
+	motor_start_speed_for_degrees_dual.speed_1 = speed_1;
+	motor_start_speed_for_degrees_dual.speed_2 = speed_2;
+	motor_start_speed_for_degrees_dual.max_power = max_power;
+	motor_start_speed_for_degrees_dual.end_state = end_state;
+	motor_start_speed_for_degrees_dual.use_profile = use_profile;
+
+	return ucpu_send_command(ucpu_connection,
+		&motor_start_speed_for_degrees_dual.port_output_command.common_message_header,
+		sizeof(hub_motor_start_speed_for_degrees_dual_t));
+}
+
+int ucpu_motor_goto_absolute_position_dual(ucpu_connection_t *ucpu_connection, uint8_t port_id,
+	int32_t absolute_pos_1, int32_t absolute_pos_2, int8_t speed, int8_t max_power, int8_t end_state, uint8_t use_profile)
+{
+	hub_motor_goto_absolute_position_dual_t motor_goto_absolute_position_dual;
+
+	UCPU_INIT_PORT_OUTPUT(motor_goto_absolute_position_dual, port_id,
+		PORT_OUTPUT_STARTUP_IMMEDIATE | PORT_OUTPUT_COMPLETION_FEEDBACK, HUB_MOTOR_GOTO_ABSOLUTE_POSITION_DUAL);
+	UCPU_SET_32BIT_VALUE(motor_goto_absolute_position_dual.absolute_pos_1, absolute_pos_1);
+	UCPU_SET_32BIT_VALUE(motor_goto_absolute_position_dual.absolute_pos_2, absolute_pos_2);
+	motor_goto_absolute_position_dual.speed = speed;
+	motor_goto_absolute_position_dual.max_power = max_power;
+	motor_goto_absolute_position_dual.end_state = end_state;
+	motor_goto_absolute_position_dual.use_profile = use_profile;
+
+	return ucpu_send_command(ucpu_connection,
+		&motor_goto_absolute_position_dual.port_output_command.common_message_header,
+		sizeof(hub_motor_goto_absolute_position_dual_t));
+}
+
+int ucpu_motor_preset_encoder(ucpu_connection_t *ucpu_connection, uint8_t port_id, int32_t position)
+{
+	hub_motor_preset_encoder_t motor_preset_encoder;
+
+	UCPU_INIT_PORT_OUTPUT(motor_preset_encoder, port_id,
+		PORT_OUTPUT_STARTUP_IMMEDIATE | PORT_OUTPUT_COMPLETION_FEEDBACK, WRITE_DIRECT_MODE_DATA);
+	motor_preset_encoder.mode = HUB_MOTOR_PRESET_ENCODER_MODE;
+	UCPU_SET_32BIT_VALUE(motor_preset_encoder.position, position);
+
+	return ucpu_send_command(ucpu_connection,
+		&motor_preset_encoder.port_output_command.common_message_header, sizeof(hub_motor_preset_encoder_t));
+}
+
+int ucpu_motor_preset_encoder_dual(ucpu_connection_t *ucpu_connection, uint8_t port_id,
+	int32_t position_1, int32_t position_2)
+{
+	hub_motor_preset_encoder_dual_t motor_preset_encoder_dual;
+
+	UCPU_INIT_PORT_OUTPUT(motor_preset_encoder_dual, port_id,
+		PORT_OUTPUT_STARTUP_IMMEDIATE | PORT_OUTPUT_COMPLETION_FEEDBACK, HUB_MOTOR_PRESET_ENCODER_DUAL);
+	UCPU_SET_32BIT_VALUE(motor_preset_encoder_dual.position_1, position_1);
+	UCPU_SET_32BIT_VALUE(motor_preset_encoder_dual.position_2, position_2);
+
+	return ucpu_send_command(ucpu_connection,
+		&motor_preset_encoder_dual.port_output_command.common_message_header,
+		sizeof(hub_motor_preset_encoder_dual_t));
+}
@@ -67,6 +67,14 @@ typedef struct {
 	uint8_t port_id_b;
 } hub_attached_io_attached_virtual_t;
 
+#define HUB_GENERIC_ERROR 0x05
+
+typedef struct {
+	hub_common_message_header_t common_message_header;
+	uint8_t command_type;
+	uint8_t error_code;
+} hub_generic_error_t;
+
 #define HUB_PORT_INFORMATION_REQUEST 0x21
 
 #define HUB_PORT_INFORMATION_PORT_VALUE 0x00
@@ -79,6 +87,93 @@ typedef struct {
 	uint8_t information_type;
 } hub_port_information_request_t;
 
+#define HUB_PORT_MODE_INFORMATION_REQUEST 0x22
+
+#define HUB_MODE_INFORMATION_NAME 0x00
+#define HUB_MODE_INFORMATION_RAW 0x01
+#define HUB_MODE_INFORMATION_PCT 0x02
+#define HUB_MODE_INFORMATION_SI 0x03
+#define HUB_MODE_INFORMATION_SYMBOL 0x04
+#define HUB_MODE_INFORMATION_MAPPING 0x05
+#define HUB_MODE_INFORMATION_VALUE_FORMAT 0x80
+
+typedef struct {
+	hub_common_message_header_t common_message_header;
+	uint8_t port_id;
+	uint8_t mode;
+	uint8_t mode_information_type;
+} hub_port_mode_information_request_t;
+
+#define HUB_PORT_INFORMATION 0x43
+
+#define HUB_PORT_CAPABILITY_OUTPUT 0x01
+#define HUB_PORT_CAPABILITY_INPUT 0x02
+#define HUB_PORT_CAPABILITY_LOGICAL_COMBINABLE 0x04
+#define HUB_PORT_CAPABILITY_LOGICAL_SYNCHRONIZABLE 0x08
+
+typedef struct {
+	hub_common_message_header_t common_message_header;
+	uint8_t port_id;
+	uint8_t information_type;
+} hub_port_information_t;
+
+typedef struct {
+	hub_port_information_t port_information;
+	uint8_t capabilities;
+	uint8_t total_mode_count;
+	uint8_t input_modes[2];
+	uint8_t output_modes[2];
+} hub_port_information_mode_info_t;
+
+#define HUB_MAX_MODE_COMBINATIONS 8
+
+/* The list of combinations may be shorter. */
+typedef struct {
+	hub_port_information_t port_information;
+	uint8_t mode_combinations[HUB_MAX_MODE_COMBINATIONS][2];
+} hub_port_information_mode_combinations_t;
+
+#define HUB_PORT_MODE_INFORMATION 0x44
+
+typedef struct {
+	hub_common_message_header_t common_message_header;
+	uint8_t port_id;
+	uint8_t mode;
+	uint8_t mode_information_type;
+} hub_port_mode_information_t;
+
+/* Reply for NAME (max 11 characters) and SYMBOL (max 5 characters), not zero terminated. */
+typedef struct {
+	hub_port_mode_information_t port_mode_information;
+	uint8_t text[11];
+} hub_port_mode_information_text_t;
+
+/* Reply for RAW, PCT and SI. The values are floats. */
+typedef struct {
+	hub_port_mode_information_t port_mode_information;
+	uint8_t min[4];
+	uint8_t max[4];
+} hub_port_mode_information_range_t;
+
+typedef struct {
+	hub_port_mode_information_t port_mode_information;
+	uint8_t input_mapping;
+	uint8_t output_mapping;
+} hub_port_mode_information_mapping_t;
+
+#define HUB_DATASET_TYPE_INT8 0x00
+#define HUB_DATASET_TYPE_INT16 0x01
+#define HUB_DATASET_TYPE_INT32 0x02
+#define HUB_DATASET_TYPE_FLOAT 0x03
+
+typedef struct {
+	hub_port_mode_information_t port_mode_information;
+	uint8_t dataset_count;
+	uint8_t dataset_type;
+	uint8_t total_figures;
+	uint8_t decimals;
+} hub_port_mode_information_value_format_t;
+
 #define HUB_PORT_INPUT_FORMAT_SETUP 0x41
 
 typedef struct {
@@ -89,6 +184,30 @@ typedef struct {
 	uint8_t notification_enabled;
 } hub_port_input_format_setup_t;
 
+#define HUB_PORT_INPUT_FORMAT_SETUP_COMBINED 0x42
+
+#define HUB_COMBINED_SET_MODE_AND_DATASET 0x01
+#define HUB_COMBINED_LOCK 0x02
+#define HUB_COMBINED_UNLOCK_AND_START_MULTI_ENABLED 0x03
+#define HUB_COMBINED_UNLOCK_AND_START_MULTI_DISABLED 0x04
+#define HUB_COMBINED_RESET 0x06
+
+typedef struct {
+	hub_common_message_header_t common_message_header;
+	uint8_t port_id;
+	uint8_t sub_command;
+} hub_port_input_format_setup_combined_t;
+
+/* The combination can be 1-8 bytes long, each byte
+ * contains a mode (high nibble) and a dataset (low nibble). */
+#define HUB_COMBINED_MAX_MODE_DATASETS 8
+
+typedef struct {
+	hub_port_input_format_setup_combined_t setup_combined;
+	uint8_t combination_index;
+	uint8_t mode_dataset[HUB_COMBINED_MAX_MODE_DATASETS];
+} hub_port_set_mode_combination_t;
+
 #define HUB_PORT_VALUE_SINGLE 0x45
 
 typedef struct {
@@ -96,6 +215,27 @@ typedef struct {
 	uint8_t port_id;
 } hub_port_value_single_t;
 
+#define HUB_PORT_VALUE_COMBINED 0x46
+
+/* Followed by the values of those mode/dataset pairs
+ * of the combination whose bit is set in the pointer. */
+typedef struct {
+	hub_common_message_header_t common_message_header;
+	uint8_t port_id;
+	uint8_t dataset_pointer[2];
+} hub_port_value_combined_t;
+
+/* Acknowledges a HUB_PORT_INPUT_FORMAT_SETUP message. */
+#define HUB_PORT_INPUT_FORMAT_SINGLE 0x47
+
+typedef struct {
+	hub_common_message_header_t common_message_header;
+	uint8_t port_id;
+	uint8_t mode;
+	uint8_t delta_interval[4];
+	uint8_t notification_enabled;
+} hub_port_input_format_single_t;
+
 #define HUB_VIRTUAL_PORT_SETUP 0x61
 
 typedef struct {
@@ -116,6 +256,12 @@ typedef struct {
 #define PORT_OUTPUT_COMMAND 0x81
 #define WRITE_DIRECT_MODE_DATA 0x51
 
+/* Startup (high nibble) and completion (low nibble) information. */
+#define PORT_OUTPUT_STARTUP_BUFFER 0x00
+#define PORT_OUTPUT_STARTUP_IMMEDIATE 0x10
+#define PORT_OUTPUT_COMPLETION_NONE 0x00
+#define PORT_OUTPUT_COMPLETION_FEEDBACK 0x01
+
 typedef struct {
 	hub_common_message_header_t common_message_header;
 	uint8_t port_id;
@@ -123,6 +269,21 @@ typedef struct {
 	uint8_t sub_command;
 } hub_port_output_command_t;
 
+#define PORT_OUTPUT_COMMAND_FEEDBACK 0x82
+
+#define PORT_FEEDBACK_BUFFER_EMPTY_IN_PROGRESS 0x01
+#define PORT_FEEDBACK_BUFFER_EMPTY_COMPLETED 0x02
+#define PORT_FEEDBACK_DISCARDED 0x04
+#define PORT_FEEDBACK_IDLE 0x08
+#define PORT_FEEDBACK_BUSY_FULL 0x10
+
+/* A message may contain multiple port_id / feedback pairs. */
+typedef struct {
+	hub_common_message_header_t common_message_header;
+	uint8_t port_id;
+	uint8_t feedback;
+} hub_port_output_command_feedback_t;
+
 /* The built-in led uses the first internal port ID */
 #define HUB_BUILT_IN_LED_PORT_ID 50
 
@@ -138,6 +299,25 @@ typedef struct {
 	uint8_t rgb[3];
 } hub_led_rgb_t;
 
+/* End states of the motor commands. */
+#define HUB_MOTOR_END_STATE_FLOAT 0
+#define HUB_MOTOR_END_STATE_HOLD 126
+#define HUB_MOTOR_END_STATE_BRAKE 127
+
+/* Bits of the use_profile fields. */
+#define HUB_MOTOR_USE_ACC_PROFILE 0x01
+#define HUB_MOTOR_USE_DEC_PROFILE 0x02
+
+#define HUB_MOTOR_SET_ACC_TIME 0x05
+#define HUB_MOTOR_SET_DEC_TIME 0x06
+
+/* Time is in milliseconds. */
+typedef struct {
+	hub_port_output_command_t port_output_command;
+	uint8_t time[2];
+	int8_t profile_number;
+} hub_motor_set_acc_dec_time_t;
+
 #define HUB_MOTOR_START_SPEED 0x07
 
 typedef struct {
@@ -147,6 +327,62 @@ typedef struct {
 	uint8_t use_profile;
 } hub_motor_start_speed_t;
 
+#define HUB_MOTOR_START_SPEED_DUAL 0x08
+
+typedef struct {
+	hub_port_output_command_t port_output_command;
+	int8_t speed_1;
+	int8_t speed_2;
+	int8_t max_power;
+	uint8_t use_profile;
+} hub_motor_start_speed_dual_t;
+
+#define HUB_MOTOR_START_SPEED_FOR_TIME 0x09
+
+typedef struct {
+	hub_port_output_command_t port_output_command;
+	uint8_t time[2];
+	int8_t speed;
+	int8_t max_power;
+	int8_t end_state;
+	uint8_t use_profile;
+} hub_motor_start_speed_for_time_t;
+
+#define HUB_MOTOR_START_SPEED_FOR_TIME_DUAL 0x0a
+
+typedef struct {
+	hub_port_output_command_t port_output_command;
+	uint8_t time[2];
+	int8_t speed_1;
+	int8_t speed_2;
+	int8_t max_power;
+	int8_t end_state;
+	uint8_t use_profile;
+} hub_motor_start_speed_for_time_dual_t;
+
+#define HUB_MOTOR_START_SPEED_FOR_DEGREES 0x0b
+
+typedef struct {
+	hub_port_output_command_t port_output_command;
+	uint8_t degrees[4];
+	int8_t speed;
+	int8_t max_power;
+	int8_t end_state;
+	uint8_t use_profile;
+} hub_motor_start_speed_for_degrees_t;
+
+#define HUB_MOTOR_START_SPEED_FOR_DEGREES_DUAL 0x0c
+
+typedef struct {
+	hub_port_output_command_t port_output_command;
+	uint8_t degrees[4];
+	int8_t speed_1;
+	int8_t speed_2;
+	int8_t max_power;
+	int8_t end_state;
+	uint8_t use_profile;
+} hub_motor_start_speed_for_degrees_dual_t;
+
 #define HUB_MOTOR_GOTO_ABSOLUTE_POSITION 0x0d
 
 typedef struct {
@@ -158,4 +394,34 @@ typedef struct {
 	uint8_t use_profile;
 } hub_motor_goto_absolute_position_t;
 
+#define HUB_MOTOR_GOTO_ABSOLUTE_POSITION_DUAL 0x0e
+
+typedef struct {
+	hub_port_output_command_t port_output_command;
+	uint8_t absolute_pos_1[4];
+	uint8_t absolute_pos_2[4];
+	int8_t speed;
+	int8_t max_power;
+	int8_t end_state;
+	uint8_t use_profile;
+} hub_motor_goto_absolute_position_dual_t;
+
+/* Sent as WRITE_DIRECT_MODE_DATA. */
+#define HUB_MOTOR_PRESET_ENCODER_MODE 0x02
+
+typedef struct {
+	hub_port_output_command_t port_output_command;
+	uint8_t mode;
+	uint8_t position[4];
+} hub_motor_preset_encoder_t;
+
+/* Presets both encoders of a virtual port. */
+#define HUB_MOTOR_PRESET_ENCODER_DUAL 0x14
+
+typedef struct {
+	hub_port_output_command_t port_output_command;
+	uint8_t position_1[4];
+	uint8_t position_2[4];
+} hub_motor_preset_encoder_dual_t;
+
 #endif /* DEVICES_H_ */
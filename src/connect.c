@@ -30,6 +30,7 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/hci.h>
@@ -79,7 +80,19 @@ static int ucpu_check_advertising_info(le_advertising_info *advertising_info)
 	return 0;
 }
 
-static int ucpu_discover_hub(int hci_fd, struct sockaddr_l2 *dest_addr)
+static int ucpu_find_hub_address(ucpu_hub_info_t *hubs, int hub_count, le_advertising_info *advertising_info)
+{
+	int i;
+
+	for (i = 0; i < hub_count; i++) {
+		if (memcmp(hubs[i].address.address, &advertising_info->bdaddr, sizeof(bdaddr_t)) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static int ucpu_discover_hubs(int hci_fd, ucpu_hub_info_t *hubs, int max_hubs, int timeout_ms)
 {
 	int retry = 3;
 	struct hci_filter old_filter, new_filter;
@@ -87,8 +100,11 @@ static int ucpu_discover_hub(int hci_fd, struct sockaddr_l2 *dest_addr)
 	evt_le_meta_event *meta_event;
 	le_advertising_info *advertising_info;
 	socklen_t old_filter_len;
+	struct pollfd poll_fd;
+	uint64_t deadline = 0;
 	uint8_t buf[HCI_MAX_EVENT_SIZE];
-	int buf_fill, len;
+	int buf_fill, len, wait_ms, index;
+	int hub_count = 0;
 
 	/* Enable scanning to discover the 6 byte address of a nearby Hub. Passive
 	 * scanning is enough, because the Hub periodically repeats its advertising
@@ -109,17 +125,17 @@ static int ucpu_discover_hub(int hci_fd, struct sockaddr_l2 *dest_addr)
 		}
 
 		if (errno != EIO) {
-			return 1;
+			return -1;
 		}
 
 		if (hci_le_set_scan_enable(hci_fd, 0x00, 0x00, 10000) < 0) {
-			return 1;
+			return -1;
 		}
 	}
 
 	old_filter_len = sizeof(old_filter);
 	if (getsockopt(hci_fd, SOL_HCI, HCI_FILTER, &old_filter, &old_filter_len) < 0) {
-		return 1;
+		return -1;
 	}
 
 	hci_filter_clear(&new_filter);
@@ -127,24 +143,54 @@ static int ucpu_discover_hub(int hci_fd, struct sockaddr_l2 *dest_addr)
 	hci_filter_set_event(EVT_LE_META_EVENT, &new_filter);
 
 	if (setsockopt(hci_fd, SOL_HCI, HCI_FILTER, &new_filter, sizeof(new_filter)) < 0) {
-		return 1;
+		return -1;
 	}
 
 	if (hci_le_set_scan_enable(hci_fd, 0x01, 0x0, 10000) < 0) {
-		return 1;
+		return -1;
 	}
 
 	printf("Start scanning...\n");
 
+	if (timeout_ms >= 0) {
+		deadline = ucpu_get_time_ns() + (uint64_t)timeout_ms * 1000000;
+	}
+
+	poll_fd.fd = hci_fd;
+	poll_fd.events = POLLIN;
+
 	buf_fill = 0;
-	while (1) {
+	while (hub_count < max_hubs) {
+		wait_ms = -1;
+
+		if (timeout_ms >= 0) {
+			uint64_t now = ucpu_get_time_ns();
+
+			if (now >= deadline) {
+				break;
+			}
+			wait_ms = (int)((deadline - now + 999999) / 1000000);
+		}
+
+		len = poll(&poll_fd, 1, wait_ms);
+
+		if (len < 0 && errno != EINTR) {
+			hub_count = -1;
+			break;
+		}
+
+		if (len <= 0) {
+			continue;
+		}
+
 		len = read(hci_fd, buf + buf_fill, (int)sizeof(buf) - buf_fill);
 
 		if (len < 0) {
-			if (errno == EAGAIN) {
+			if (errno == EAGAIN || errno == EINTR) {
 				continue;
 			}
-			return 1;
+			hub_count = -1;
+			break;
 		}
 
 		buf_fill += len;
@@ -162,7 +208,7 @@ static int ucpu_discover_hub(int hci_fd, struct sockaddr_l2 *dest_addr)
 
 		len = event_hdr->plen + HCI_TYPE_LEN + HCI_EVENT_HDR_SIZE;
 
-		if (len < buf_fill) {
+		if (buf_fill < len) {
 			continue;
 		}
 
@@ -172,10 +218,20 @@ static int ucpu_discover_hub(int hci_fd, struct sockaddr_l2 *dest_addr)
 		if (meta_event->subevent == EVT_LE_ADVERTISING_REPORT
 				&& meta_event->data[0] == 1) {
 			advertising_info = (le_advertising_info*)(meta_event->data + 1);
+
+			/* Hubs repeat their advertising reports, so only the signal
+			 * strength is updated for Hubs which are already found. */
 			if (ucpu_check_advertising_info(advertising_info) != 0) {
-				memcpy(&dest_addr->l2_bdaddr, &advertising_info->bdaddr, sizeof(bdaddr_t));
-				dest_addr->l2_bdaddr_type = advertising_info->bdaddr_type;
-				break;
+				index = ucpu_find_hub_address(hubs, hub_count, advertising_info);
+
+				if (index < 0) {
+					index = hub_count++;
+					memcpy(hubs[index].address.address, &advertising_info->bdaddr, sizeof(bdaddr_t));
+					hubs[index].address.address_type = advertising_info->bdaddr_type;
+				}
+
+				/* The RSSI follows the advertising data. */
+				hubs[index].rssi = (int8_t)advertising_info->data[advertising_info->length];
 			}
 		}
 
@@ -189,29 +245,160 @@ static int ucpu_discover_hub(int hci_fd, struct sockaddr_l2 *dest_addr)
 	}
 
 	if (hci_le_set_scan_enable(hci_fd, 0x00, 0x00, 10000) < 0) {
-		return 1;
+		return -1;
 	}
 
 	if (setsockopt(hci_fd, SOL_HCI, HCI_FILTER, &old_filter, sizeof(old_filter)) < 0) {
-		return 1;
+		return -1;
 	}
 
-	return 0;
+	return hub_count;
+}
+
+int ucpu_scan_hubs(ucpu_hub_info_t *hubs, int max_hubs, int timeout_ms)
+{
+	int dev_id, hci_fd, hub_count;
+
+	dev_id = hci_get_route(NULL);
+	if (dev_id < 0) {
+		printf("Cannot open device\n");
+		return -1;
+	}
+
+	hci_fd = hci_open_dev(dev_id);
+	if (hci_fd < 0) {
+		printf("Cannot open HCI device\n");
+		return -1;
+	}
+
+	hub_count = ucpu_discover_hubs(hci_fd, hubs, max_hubs, timeout_ms);
+
+	if (hub_count < 0) {
+		/* Note: scanning requires administrator rights (sudo) because
+		 * it can be used to gather all information about the network. */
+		printf("Scanning failed (sudo might be needed)\n");
+	}
+
+	close(hci_fd);
+	return hub_count;
 }
 
 #define HUB_SERVICE_CHARACTERISTIC_FOUND 0x1
 #define CLIENT_CHARACTERISTIC_CONFIG_FOUND 0x2
 #define ALL_CHARACTERISTICS_FOUND (HUB_SERVICE_CHARACTERISTIC_FOUND | CLIENT_CHARACTERISTIC_CONFIG_FOUND)
 
-static int ucpu_get_characteristic_handle(ucpu_connection_t *ucpu_connection, uint8_t *client_config_handle)
+static int ucpu_send_find_info_request(ucpu_connection_t *ucpu_connection, uint16_t starting_handle)
 {
 	att_op_find_info_req_t find_info_req;
-	uint32_t characteristics_found = 0;
-	uint16_t starting_handle = 0x0001;
-	uint16_t prev_starting_handle = 0;
-	int received_len;
-	uint8_t *src, *src_end;
 
+	find_info_req.opcode = ATT_OP_FIND_INFO_REQ;
+	/* Little endian format. */
+	find_info_req.starting_handle[0] = (uint8_t)(starting_handle & 0xff);
+	find_info_req.starting_handle[1] = (uint8_t)(starting_handle >> 8);
+	find_info_req.ending_handle[0] = 0xff; /* 0xffff */
+	find_info_req.ending_handle[1] = 0xff;
+
+	return ucpu_att_send(ucpu_connection, &find_info_req, sizeof(att_op_find_info_req_t));
+}
+
+static int ucpu_discovery_search(ucpu_connection_t *ucpu_connection, ucpu_discovery_t *discovery)
+{
+	discovery->stage = UCPU_DISCOVERY_STAGE_SEARCH;
+	discovery->starting_handle = 0x0001;
+	discovery->characteristics_found = 0;
+
+	if (ucpu_send_find_info_request(ucpu_connection, discovery->starting_handle) != 0) {
+		return UCPU_DISCOVERY_FAILED;
+	}
+	return UCPU_DISCOVERY_IN_PROGRESS;
+}
+
+static int ucpu_write_client_configuration(ucpu_connection_t *ucpu_connection, ucpu_discovery_t *discovery)
+{
+	gatt_client_characteristic_configuration_t client_configuration;
+
+	discovery->stage = UCPU_DISCOVERY_STAGE_ENABLE;
+
+	/* A write request is used instead of a write command, since its
+	 * response confirms that the handle is valid. */
+	client_configuration.opcode = ATT_WRITE_REQ;
+	client_configuration.handle[0] = discovery->client_config_handle[0];
+	client_configuration.handle[1] = discovery->client_config_handle[1];
+	/* Set bit 0 to 1: enable server notifications */
+	client_configuration.configuration[0] = 0x1;
+	client_configuration.configuration[1] = 0x0;
+
+	if (ucpu_att_send(ucpu_connection, &client_configuration,
+			sizeof(gatt_client_characteristic_configuration_t)) != 0) {
+		return UCPU_DISCOVERY_FAILED;
+	}
+	return UCPU_DISCOVERY_IN_PROGRESS;
+}
+
+static int ucpu_discovery_enable_response(ucpu_connection_t *ucpu_connection, ucpu_discovery_t *discovery, int received_len)
+{
+	if (received_len >= 1 && ucpu_connection->rsp_buf[0] == ATT_WRITE_RSP) {
+		if (!discovery->from_cache) {
+			ucpu_handle_cache_store(&ucpu_connection->address, ucpu_connection->handle,
+				discovery->client_config_handle);
+		}
+		return UCPU_DISCOVERY_COMPLETED;
+	}
+
+	if (received_len < 1 || ucpu_connection->rsp_buf[0] != ATT_ERROR_RSP) {
+		return UCPU_DISCOVERY_FAILED;
+	}
+
+	if (!discovery->from_cache) {
+		return UCPU_DISCOVERY_FAILED;
+	}
+
+	/* The cached handles are not valid anymore. */
+	ucpu_handle_cache_invalidate(&ucpu_connection->address);
+	discovery->from_cache = 0;
+	return ucpu_discovery_search(ucpu_connection, discovery);
+}
+
+static int ucpu_discovery_verify(ucpu_connection_t *ucpu_connection, ucpu_discovery_t *discovery)
+{
+	att_read_req_t read_req;
+
+	discovery->stage = UCPU_DISCOVERY_STAGE_VERIFY;
+
+	/* Reading the characteristic is not necessarily permitted, but the
+	 * error response tells whether the handle exists. */
+	read_req.opcode = ATT_READ_REQ;
+	read_req.handle[0] = ucpu_connection->handle[0];
+	read_req.handle[1] = ucpu_connection->handle[1];
+
+	if (ucpu_att_send(ucpu_connection, &read_req, sizeof(att_read_req_t)) != 0) {
+		return UCPU_DISCOVERY_FAILED;
+	}
+	return UCPU_DISCOVERY_IN_PROGRESS;
+}
+
+static int ucpu_discovery_verify_response(ucpu_connection_t *ucpu_connection, ucpu_discovery_t *discovery, int received_len)
+{
+	if (received_len >= 1 && ucpu_connection->rsp_buf[0] == ATT_READ_RSP) {
+		return ucpu_write_client_configuration(ucpu_connection, discovery);
+	}
+
+	if (received_len < 5 || ucpu_connection->rsp_buf[0] != ATT_ERROR_RSP) {
+		return UCPU_DISCOVERY_FAILED;
+	}
+
+	if (ucpu_connection->rsp_buf[4] != ATT_ERROR_INVALID_HANDLE) {
+		return ucpu_write_client_configuration(ucpu_connection, discovery);
+	}
+
+	/* The cached characteristic handle is not valid anymore. */
+	ucpu_handle_cache_invalidate(&ucpu_connection->address);
+	discovery->from_cache = 0;
+	return ucpu_discovery_search(ucpu_connection, discovery);
+}
+
+int ucpu_discovery_start(ucpu_connection_t *ucpu_connection, ucpu_discovery_t *discovery)
+{
 	/* Instead of the 128 bit UUIDs, Blutooth uses 16 bit handles to
 	 * access attributes. The following code obtains the handle of the
 	 * single attribute defined by LEGO GATT service. */
@@ -221,67 +408,83 @@ static int ucpu_get_characteristic_handle(ucpu_connection_t *ucpu_connection, ui
 	 * Hub Characteristic. To enable notifications, the Client Characteristic
 	 * Configuration Descriptor (CCCD) is searched as well. */
 
-	while (1) {
-		if (starting_handle <= prev_starting_handle) {
-			break;
-		}
-		prev_starting_handle = starting_handle;
+	/* The search is split into a start and a process step, so multiple
+	 * Hubs can be discovered at the same time by the connection manager. */
+
+	/* The search is skipped when the handles are found in the cache. The
+	 * characteristic handle is verified by a read request, and the descriptor
+	 * handle by enabling notifications with a write request. When either
+	 * fails, the cache entry is dropped and the search is started from the
+	 * beginning. */
+	if (ucpu_handle_cache_lookup(&ucpu_connection->address, ucpu_connection->handle,
+			discovery->client_config_handle) == 0) {
+		discovery->from_cache = 1;
+		return ucpu_discovery_verify(ucpu_connection, discovery);
+	}
 
-		find_info_req.opcode = ATT_OP_FIND_INFO_REQ;
-		/* Little endian format. */
-		find_info_req.starting_handle[0] = (uint8_t)(starting_handle & 0xff);
-		find_info_req.starting_handle[1] = (uint8_t)(starting_handle >> 8);
-		find_info_req.ending_handle[0] = 0xff; /* 0xffff */
-		find_info_req.ending_handle[1] = 0xff;
+	discovery->from_cache = 0;
+	return ucpu_discovery_search(ucpu_connection, discovery);
+}
 
-		if (ucpu_att_send(ucpu_connection, &find_info_req, sizeof(att_op_find_info_req_t)) != 0) {
-			return 1;
-		}
+int ucpu_discovery_process(ucpu_connection_t *ucpu_connection, ucpu_discovery_t *discovery, int received_len)
+{
+	uint16_t prev_starting_handle = discovery->starting_handle;
+	uint8_t *src, *src_end;
 
-		received_len = ucpu_att_receive(ucpu_connection);
+	/* Notifications are not responses. The Hub may send them as soon
+	 * as they are enabled, even before the write response. */
+	if (received_len >= 1 && ucpu_connection->rsp_buf[0] == ATT_HANDLE_VALUE_NTF) {
+		return UCPU_DISCOVERY_IN_PROGRESS;
+	}
 
-		if (received_len < 2 + 4 || ucpu_connection->rsp_buf[0] != ATT_OP_FIND_INFO_RESP) {
-			break;
-		}
+	if (discovery->stage == UCPU_DISCOVERY_STAGE_ENABLE) {
+		return ucpu_discovery_enable_response(ucpu_connection, discovery, received_len);
+	}
 
-		src_end = ucpu_connection->rsp_buf + received_len;
+	if (discovery->stage == UCPU_DISCOVERY_STAGE_VERIFY) {
+		return ucpu_discovery_verify_response(ucpu_connection, discovery, received_len);
+	}
 
-		if (ucpu_connection->rsp_buf[1] == 1) {
-			/* Length of 16 bit handle and 16 bit UUID pairs should be divisible by 4. */
-			if (((received_len - 2) % 4) != 0) {
-				break;
-			}
+	if (received_len < 2 + 4 || ucpu_connection->rsp_buf[0] != ATT_OP_FIND_INFO_RESP) {
+		return UCPU_DISCOVERY_FAILED;
+	}
 
-			src = ucpu_connection->rsp_buf + 2;
-			do {
-				if (src[3] == 0x28 && (src[2] | 0x1) == 0x01) {
-					/* Clear status when a new primary or secondary service starts. */
-					characteristics_found = 0;
-				}
-				else if (src[3] == 0x29 && src[2] == 0x02) {
-					/* Found a Client Characteristic Configuration Descriptor */
-					client_config_handle[0] = src[0];
-					client_config_handle[1] = src[1];
-
-					characteristics_found |= CLIENT_CHARACTERISTIC_CONFIG_FOUND;
-					if (characteristics_found == ALL_CHARACTERISTICS_FOUND) {
-						return 0;
-					}
-				}
-				src += 2 + 2;
-			} while (src < src_end);
+	src_end = ucpu_connection->rsp_buf + received_len;
 
-			/* Since handles should be returned in ascending order, the highest handle should be the last value. */
-			starting_handle = (uint16_t)(((uint32_t)src_end[-4] | ((uint32_t)src_end[-3] << 8)) + 1);
-			continue;
+	if (ucpu_connection->rsp_buf[1] == 1) {
+		/* Length of 16 bit handle and 16 bit UUID pairs should be divisible by 4. */
+		if (((received_len - 2) % 4) != 0) {
+			return UCPU_DISCOVERY_FAILED;
 		}
 
+		src = ucpu_connection->rsp_buf + 2;
+		do {
+			if (src[3] == 0x28 && (src[2] | 0x1) == 0x01) {
+				/* Clear status when a new primary or secondary service starts. */
+				discovery->characteristics_found = 0;
+			}
+			else if (src[3] == 0x29 && src[2] == 0x02) {
+				/* Found a Client Characteristic Configuration Descriptor */
+				discovery->client_config_handle[0] = src[0];
+				discovery->client_config_handle[1] = src[1];
+
+				discovery->characteristics_found |= CLIENT_CHARACTERISTIC_CONFIG_FOUND;
+				if (discovery->characteristics_found == ALL_CHARACTERISTICS_FOUND) {
+					return ucpu_write_client_configuration(ucpu_connection, discovery);
+				}
+			}
+			src += 2 + 2;
+		} while (src < src_end);
+
+		/* Since handles should be returned in ascending order, the highest handle should be the last value. */
+		discovery->starting_handle = (uint16_t)(((uint32_t)src_end[-4] | ((uint32_t)src_end[-3] << 8)) + 1);
+	} else {
 		/* Length of 16 bit handle and 128 bit UUID pairs should be divisible by 18. */
 		if (ucpu_connection->rsp_buf[1] != 2 || ((received_len - 2) % 18) != 0) {
-			break;
+			return UCPU_DISCOVERY_FAILED;
 		}
 
-		if (!(characteristics_found & HUB_SERVICE_CHARACTERISTIC_FOUND)) {
+		if (!(discovery->characteristics_found & HUB_SERVICE_CHARACTERISTIC_FOUND)) {
 			src = ucpu_connection->rsp_buf + 2;
 			do {
 				/* The characteristic and service UUIDs are nearly the same except one byte. */
@@ -292,9 +495,9 @@ static int ucpu_get_characteristic_handle(ucpu_connection_t *ucpu_connection, ui
 						ucpu_connection->handle[0] = src[0];
 						ucpu_connection->handle[1] = src[1];
 
-						characteristics_found |= HUB_SERVICE_CHARACTERISTIC_FOUND;
-						if (characteristics_found == ALL_CHARACTERISTICS_FOUND) {
-							return 0;
+						discovery->characteristics_found |= HUB_SERVICE_CHARACTERISTIC_FOUND;
+						if (discovery->characteristics_found == ALL_CHARACTERISTICS_FOUND) {
+							return ucpu_write_client_configuration(ucpu_connection, discovery);
 						}
 					}
 				}
@@ -302,52 +505,53 @@ static int ucpu_get_characteristic_handle(ucpu_connection_t *ucpu_connection, ui
 			} while (src < src_end);
 		}
 
-		starting_handle = (uint16_t)(((uint32_t)src_end[-18] | ((uint32_t)src_end[-17] << 8)) + 1);
+		discovery->starting_handle = (uint16_t)(((uint32_t)src_end[-18] | ((uint32_t)src_end[-17] << 8)) + 1);
 	}
 
-	/* Close socket when service is not found. */
-	close(ucpu_connection->sock);
-	ucpu_connection->sock = -1;
-	return 1;
+	/* The handle wrapped around: the end of the attribute table is reached. */
+	if (discovery->starting_handle <= prev_starting_handle) {
+		return UCPU_DISCOVERY_FAILED;
+	}
+
+	if (ucpu_send_find_info_request(ucpu_connection, discovery->starting_handle) != 0) {
+		return UCPU_DISCOVERY_FAILED;
+	}
+	return UCPU_DISCOVERY_IN_PROGRESS;
 }
 
-int ucpu_connect_to_hub(ucpu_connection_t *ucpu_connection)
+static int ucpu_get_characteristic_handle(ucpu_connection_t *ucpu_connection)
 {
-	int sock, dev_id, hci_fd, flags;
-	struct sockaddr_l2 src_addr;
-	struct sockaddr_l2 dest_addr;
-	gatt_client_characteristic_configuration_t client_configuration;
+	ucpu_discovery_t discovery;
+	int status = ucpu_discovery_start(ucpu_connection, &discovery);
 
-	dev_id = hci_get_route(NULL);
-	if (dev_id < 0) {
-		printf("Cannot open device\n");
-		return 1;
+	/* The socket is in blocking mode, so ucpu_att_receive waits for the response. */
+	while (status == UCPU_DISCOVERY_IN_PROGRESS) {
+		status = ucpu_discovery_process(ucpu_connection, &discovery,
+			ucpu_att_receive(ucpu_connection));
 	}
 
-	hci_fd = hci_open_dev(dev_id);
-	if (hci_fd < 0) {
-		printf("Cannot open HCI device\n");
-		return 1;
+	if (status == UCPU_DISCOVERY_COMPLETED) {
+		return 0;
 	}
 
-	if (ucpu_discover_hub(hci_fd, &dest_addr) != 0) {
-		/* Note: scanning requires administrator rights (sudo) because
-		 * it can be used to gather all information about the network. */
-		printf("Scanning failed (sudo might be needed)\n");
-		return 1;
-	}
-
-	close(hci_fd);
+	/* Close socket when service is not found. */
+	ucpu_disconnect(ucpu_connection);
+	return 1;
+}
 
-	printf("Connecting to LEGO Hub\n");
+int ucpu_l2cap_connect(const ucpu_hub_address_t *hub, int non_blocking)
+{
+	int sock;
+	struct sockaddr_l2 src_addr;
+	struct sockaddr_l2 dest_addr;
 
 	/* Bluetooth provides a reliable transfer protocol called L2CAP (logical link
 	 * control and adaptation protocol). Raw sockets are not recommended to use. */
-	sock = socket(PF_BLUETOOTH, SOCK_SEQPACKET /*| SOCK_NONBLOCK*/, BTPROTO_L2CAP);
+	sock = socket(PF_BLUETOOTH, SOCK_SEQPACKET | (non_blocking ? SOCK_NONBLOCK : 0), BTPROTO_L2CAP);
 
 	if (sock == -1) {
 		printf("Cannot create socket\n");
-		return 1;
+		return -1;
 	}
 
 	/* Bluetooth uses logical channels for communication. Each channel represents
@@ -356,56 +560,101 @@ int ucpu_connect_to_hub(ucpu_connection_t *ucpu_connection)
 	 * channel (0x4) which can be used to communicate with the Hub. */
 
 	/* Noth: both the source and destination must use the same cid (channel identifier). */
+	memset(&src_addr, 0, sizeof(struct sockaddr_l2));
 	src_addr.l2_family = AF_BLUETOOTH;
 	src_addr.l2_psm = 0;
-	memset(&src_addr.l2_bdaddr, 0, sizeof(bdaddr_t));
 	src_addr.l2_cid = htobs(0x4);
 	src_addr.l2_bdaddr_type = BDADDR_LE_PUBLIC;
 
 	if (bind(sock, (struct sockaddr*)&src_addr, sizeof(struct sockaddr_l2)) != 0) {
 		close(sock);
 		printf("Cannot bind socket\n");
-		return 1;
+		return -1;
 	}
 
+	/* Advertising reports use a different address type encoding than sockets. */
+	memset(&dest_addr, 0, sizeof(struct sockaddr_l2));
 	dest_addr.l2_family = AF_BLUETOOTH;
 	dest_addr.l2_psm = 0;
+	memcpy(&dest_addr.l2_bdaddr, hub->address, sizeof(bdaddr_t));
 	dest_addr.l2_cid = htobs(0x4);
-	dest_addr.l2_bdaddr_type = BDADDR_LE_PUBLIC;
+	dest_addr.l2_bdaddr_type = (hub->address_type == UCPU_ADDRESS_RANDOM) ? BDADDR_LE_RANDOM : BDADDR_LE_PUBLIC;
 
 	if (connect(sock, (struct sockaddr*)&dest_addr, sizeof(struct sockaddr_l2)) != 0) {
+		/* Non-blocking sockets complete the connection in the background. */
+		if (non_blocking && errno == EINPROGRESS) {
+			return sock;
+		}
+
 		close(sock);
 		printf("Cannot connect to the device\n");
-		return 1;
+		return -1;
 	}
 
-	ucpu_connection->sock = sock;
+	return sock;
+}
 
-	if (ucpu_get_characteristic_handle(ucpu_connection, client_configuration.handle) != 0) {
-		printf("Cannot communicate with the device\n");
-		return 1;
+int ucpu_set_non_blocking(int sock)
+{
+	int flags = fcntl(sock, F_GETFL, 0);
+
+	if (flags != -1) {
+		flags = fcntl(sock, F_SETFL, flags | O_NONBLOCK);
 	}
 
-	client_configuration.opcode = ATT_WRITE_CMD;
-	/* Set bit 0 to 1: enable server notifications */
-	client_configuration.configuration[0] = 0x1;
-	client_configuration.configuration[1] = 0x0;
+	return flags == -1;
+}
 
-	if (ucpu_att_send(ucpu_connection, &client_configuration,
-			sizeof(gatt_client_characteristic_configuration_t)) != 0) {
-		printf("Cannot set client configuration\n");
+static int ucpu_l2cap_open(ucpu_connection_t *ucpu_connection, const void *parameters)
+{
+	const ucpu_hub_address_t *hub = (const ucpu_hub_address_t*)parameters;
+
+	/* The socket is blocking until the discovery is completed. */
+	ucpu_connection->address = *hub;
+	ucpu_connection->sock = ucpu_l2cap_connect(hub, 0);
+	return ucpu_connection->sock < 0;
+}
+
+/* L2CAP sockets are SOCK_SEQPACKET sockets. */
+const ucpu_transport_t ucpu_l2cap_transport = {
+	ucpu_l2cap_open,
+	ucpu_socket_send,
+	ucpu_socket_send_batch,
+	ucpu_socket_receive,
+	ucpu_socket_receive_batch,
+	ucpu_socket_close,
+};
+
+int ucpu_parse_hub_address(const char *str, uint8_t address_type, ucpu_hub_address_t *hub)
+{
+	bdaddr_t address;
+
+	if (str2ba(str, &address) != 0) {
 		return 1;
 	}
 
-	flags = fcntl(sock, F_GETFL, 0);
+	memcpy(hub->address, &address, sizeof(bdaddr_t));
+	hub->address_type = address_type;
+	return 0;
+}
 
-	if (flags != -1) {
-		flags = fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+int ucpu_connect_to_hub_address(ucpu_connection_t *ucpu_connection, const ucpu_hub_address_t *hub)
+{
+	/* Connecting to a known address does not need administrator rights. */
+	printf("Connecting to LEGO Hub\n");
+
+	if (ucpu_transport_open(ucpu_connection, &ucpu_l2cap_transport, hub) != 0) {
+		return 1;
 	}
 
-	if (flags == -1) {
-		close(sock);
-		ucpu_connection->sock = -1;
+	/* Notifications are enabled by the discovery. */
+	if (ucpu_get_characteristic_handle(ucpu_connection) != 0) {
+		printf("Cannot communicate with the device\n");
+		return 1;
+	}
+
+	if (ucpu_set_non_blocking(ucpu_connection->sock) != 0) {
+		ucpu_disconnect(ucpu_connection);
 		printf("Cannot set socket non-blocking\n");
 		return 1;
 	}
@@ -413,3 +662,30 @@ int ucpu_connect_to_hub(ucpu_connection_t *ucpu_connection)
 	printf("Connection completed\n");
 	return 0;
 }
+
+int ucpu_connect_to_hub(ucpu_connection_t *ucpu_connection)
+{
+	ucpu_hub_info_t hub;
+
+	if (ucpu_scan_hubs(&hub, 1, -1) != 1) {
+		return 1;
+	}
+
+	return ucpu_connect_to_hub_address(ucpu_connection, &hub.address);
+}
+
+int ucpu_connect_to_hub_arg(ucpu_connection_t *ucpu_connection, int argc, char **argv)
+{
+	ucpu_hub_address_t hub;
+
+	/* The address of the Hub can be passed as an argument to skip scanning. */
+	if (argc > 1) {
+		if (ucpu_parse_hub_address(argv[1], UCPU_ADDRESS_PUBLIC, &hub) != 0) {
+			printf("Invalid Hub address: %s\n", argv[1]);
+			return 1;
+		}
+		return ucpu_connect_to_hub_address(ucpu_connection, &hub);
+	}
+
+	return ucpu_connect_to_hub(ucpu_connection);
+}
@@ -0,0 +1,221 @@
+/*
+ *    uc-powered-up (micro/universal c implementation of powered up, you see powered up, ...)
+ *
+ *    Copyright Zoltan Herczeg (hzmester@freemail.hu). All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright notice, this list of
+ *      conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *      of conditions and the following disclaimer in the documentation and/or other materials
+ *      provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER(S) AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER(S) OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Decoding the datasets of port value messages. */
+
+#include "globals.h"
+
+#include <string.h>
+
+static void ucpu_decode_int8(const ucpu_value_decoder_t *value_decoder, const uint8_t *data, int32_t *values)
+{
+	int i;
+
+	for (i = 0; i < value_decoder->dataset_count; i++) {
+		values[i] = (int8_t)data[i];
+	}
+}
+
+static void ucpu_decode_int16(const ucpu_value_decoder_t *value_decoder, const uint8_t *data, int32_t *values)
+{
+	int i;
+
+	for (i = 0; i < value_decoder->dataset_count; i++, data += 2) {
+		values[i] = (int16_t)((uint32_t)data[0] | ((uint32_t)data[1] << 8));
+	}
+}
+
+static void ucpu_decode_int32(const ucpu_value_decoder_t *value_decoder, const uint8_t *data, int32_t *values)
+{
+	int i;
+
+	for (i = 0; i < value_decoder->dataset_count; i++, data += 4) {
+		values[i] = (int32_t)((uint32_t)data[0] | ((uint32_t)data[1] << 8)
+			| ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24));
+	}
+}
+
+static float ucpu_get_float(const uint8_t *data)
+{
+	uint32_t value = (uint32_t)data[0] | ((uint32_t)data[1] << 8)
+		| ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+	float result;
+
+	memcpy(&result, &value, sizeof(float));
+	return result;
+}
+
+static void ucpu_decode_float(const ucpu_value_decoder_t *value_decoder, const uint8_t *data, int32_t *values)
+{
+	int i;
+
+	for (i = 0; i < value_decoder->dataset_count; i++, data += 4) {
+		values[i] = (int32_t)ucpu_get_float(data);
+	}
+}
+
+static void ucpu_decode_int8_scaled(const ucpu_value_decoder_t *value_decoder, const uint8_t *data, float *values)
+{
+	int i;
+
+	for (i = 0; i < value_decoder->dataset_count; i++) {
+		values[i] = (float)(int8_t)data[i] * value_decoder->scale + value_decoder->offset;
+	}
+}
+
+static void ucpu_decode_int16_scaled(const ucpu_value_decoder_t *value_decoder, const uint8_t *data, float *values)
+{
+	int i;
+
+	for (i = 0; i < value_decoder->dataset_count; i++, data += 2) {
+		values[i] = (float)(int16_t)((uint32_t)data[0] | ((uint32_t)data[1] << 8))
+			* value_decoder->scale + value_decoder->offset;
+	}
+}
+
+static void ucpu_decode_int32_scaled(const ucpu_value_decoder_t *value_decoder, const uint8_t *data, float *values)
+{
+	int i;
+
+	for (i = 0; i < value_decoder->dataset_count; i++, data += 4) {
+		values[i] = (float)(int32_t)((uint32_t)data[0] | ((uint32_t)data[1] << 8)
+			| ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24))
+			* value_decoder->scale + value_decoder->offset;
+	}
+}
+
+static void ucpu_decode_float_scaled(const ucpu_value_decoder_t *value_decoder, const uint8_t *data, float *values)
+{
+	int i;
+
+	for (i = 0; i < value_decoder->dataset_count; i++, data += 4) {
+		values[i] = ucpu_get_float(data) * value_decoder->scale + value_decoder->offset;
+	}
+}
+
+int ucpu_value_decoder_init(ucpu_value_decoder_t *value_decoder, uint8_t dataset_type, uint8_t dataset_count)
+{
+	if (dataset_count == 0 || dataset_count > UCPU_MAX_DATASETS) {
+		return 1;
+	}
+
+	switch (dataset_type) {
+	case HUB_DATASET_TYPE_INT8:
+		value_decoder->decode = ucpu_decode_int8;
+		value_decoder->decode_scaled = ucpu_decode_int8_scaled;
+		value_decoder->dataset_size = 1;
+		break;
+	case HUB_DATASET_TYPE_INT16:
+		value_decoder->decode = ucpu_decode_int16;
+		value_decoder->decode_scaled = ucpu_decode_int16_scaled;
+		value_decoder->dataset_size = 2;
+		break;
+	case HUB_DATASET_TYPE_INT32:
+		value_decoder->decode = ucpu_decode_int32;
+		value_decoder->decode_scaled = ucpu_decode_int32_scaled;
+		value_decoder->dataset_size = 4;
+		break;
+	case HUB_DATASET_TYPE_FLOAT:
+		value_decoder->decode = ucpu_decode_float;
+		value_decoder->decode_scaled = ucpu_decode_float_scaled;
+		value_decoder->dataset_size = 4;
+		break;
+	default:
+		return 1;
+	}
+
+	value_decoder->dataset_count = dataset_count;
+	value_decoder->scale = 1.0f;
+	value_decoder->offset = 0.0f;
+	return 0;
+}
+
+int ucpu_value_decoder_init_mode(ucpu_value_decoder_t *value_decoder, const ucpu_mode_info_t *mode_info, int unit)
+{
+	float min, max;
+
+	if (ucpu_value_decoder_init(value_decoder, mode_info->dataset_type, mode_info->dataset_count) != 0) {
+		return 1;
+	}
+
+	if (unit == UCPU_VALUE_UNIT_RAW) {
+		return 0;
+	}
+
+	if (unit == UCPU_VALUE_UNIT_PCT) {
+		min = mode_info->pct_min;
+		max = mode_info->pct_max;
+	} else {
+		min = mode_info->si_min;
+		max = mode_info->si_max;
+	}
+
+	/* Linear mapping from the raw range to the target range. */
+	if (mode_info->raw_max != mode_info->raw_min) {
+		value_decoder->scale = (max - min) / (mode_info->raw_max - mode_info->raw_min);
+		value_decoder->offset = min - mode_info->raw_min * value_decoder->scale;
+	}
+	return 0;
+}
+
+/* Returns with the start of the datasets, or NULL if the message is too short. */
+static const uint8_t *ucpu_get_port_value_data(const ucpu_value_decoder_t *value_decoder,
+	const uint8_t *packet, int message_length)
+{
+	if (ucpu_is_port_value_single_packet(packet, message_length) < 0
+			|| message_length < (int)(sizeof(hub_port_value_single_t)
+				+ value_decoder->dataset_count * value_decoder->dataset_size)) {
+		return NULL;
+	}
+
+	return packet + sizeof(hub_port_value_single_t);
+}
+
+int ucpu_decode_port_value(const ucpu_value_decoder_t *value_decoder,
+	const uint8_t *packet, int message_length, int32_t *values)
+{
+	const uint8_t *data = ucpu_get_port_value_data(value_decoder, packet, message_length);
+
+	if (data == NULL) {
+		return -1;
+	}
+
+	value_decoder->decode(value_decoder, data, values);
+	return value_decoder->dataset_count;
+}
+
+int ucpu_decode_port_value_scaled(const ucpu_value_decoder_t *value_decoder,
+	const uint8_t *packet, int message_length, float *values)
+{
+	const uint8_t *data = ucpu_get_port_value_data(value_decoder, packet, message_length);
+
+	if (data == NULL) {
+		return -1;
+	}
+
+	value_decoder->decode_scaled(value_decoder, data, values);
+	return value_decoder->dataset_count;
+}
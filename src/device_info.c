@@ -0,0 +1,482 @@
+/*
+ *    uc-powered-up (micro/universal c implementation of powered up, you see powered up, ...)
+ *
+ *    Copyright Zoltan Herczeg (hzmester@freemail.hu). All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright notice, this list of
+ *      conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *      of conditions and the following disclaimer in the documentation and/or other materials
+ *      provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER(S) AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER(S) OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Querying and caching the mode information of devices. */
+
+#include "globals.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+
+#define UCPU_DEVICE_QUERY_STAGE_MODE_INFO 0
+#define UCPU_DEVICE_QUERY_STAGE_MODES 1
+
+/* Number of mode information requests sent for each mode. */
+#define UCPU_MODE_INFORMATION_TYPES 7
+
+/* Passed to ucpu_device_query_send to send a port information request. */
+#define UCPU_PORT_INFORMATION_REQUEST 0xff
+
+static const uint8_t ucpu_mode_information_types[UCPU_MODE_INFORMATION_TYPES] = {
+	HUB_MODE_INFORMATION_NAME,
+	HUB_MODE_INFORMATION_RAW,
+	HUB_MODE_INFORMATION_PCT,
+	HUB_MODE_INFORMATION_SI,
+	HUB_MODE_INFORMATION_SYMBOL,
+	HUB_MODE_INFORMATION_MAPPING,
+	HUB_MODE_INFORMATION_VALUE_FORMAT,
+};
+
+/* The cache file starts with a magic value followed by ucpu_device_info_t
+ * records in host byte order. The file is only used on the same machine. */
+static const char ucpu_device_info_cache_magic[8] = { 'U', 'C', 'P', 'U', 'D', 'I', '0', '1' };
+
+static char ucpu_device_info_cache_path[PATH_MAX];
+
+void ucpu_device_info_cache_set_path(const char *path)
+{
+	if (path == NULL || strlen(path) >= sizeof(ucpu_device_info_cache_path) - 4) {
+		ucpu_device_info_cache_path[0] = '\0';
+		return;
+	}
+
+	strcpy(ucpu_device_info_cache_path, path);
+}
+
+static int ucpu_device_info_same_device(const ucpu_device_info_t *a, const ucpu_device_info_t *b)
+{
+	return (a->io_type_id == b->io_type_id
+		&& a->hardware_revision == b->hardware_revision
+		&& a->software_revision == b->software_revision);
+}
+
+static FILE *ucpu_device_info_cache_open(void)
+{
+	FILE *file;
+	char magic[8];
+
+	if (ucpu_device_info_cache_path[0] == '\0') {
+		return NULL;
+	}
+
+	file = fopen(ucpu_device_info_cache_path, "rb");
+	if (file == NULL) {
+		return NULL;
+	}
+
+	if (fread(magic, sizeof(magic), 1, file) != 1
+			|| memcmp(magic, ucpu_device_info_cache_magic, sizeof(magic)) != 0) {
+		fclose(file);
+		return NULL;
+	}
+	return file;
+}
+
+int ucpu_device_info_cache_lookup(ucpu_device_info_t *device_info)
+{
+	FILE *file = ucpu_device_info_cache_open();
+	ucpu_device_info_t entry;
+	int ret = 1;
+
+	if (file == NULL) {
+		return 1;
+	}
+
+	while (fread(&entry, sizeof(ucpu_device_info_t), 1, file) == 1) {
+		if (ucpu_device_info_same_device(&entry, device_info)) {
+			*device_info = entry;
+			ret = 0;
+			break;
+		}
+	}
+
+	fclose(file);
+	return ret;
+}
+
+void ucpu_device_info_cache_store(const ucpu_device_info_t *device_info)
+{
+	FILE *file, *new_file;
+	char new_path[PATH_MAX + 4];
+	ucpu_device_info_t entry;
+	int failed;
+
+	if (ucpu_device_info_cache_path[0] == '\0') {
+		return;
+	}
+
+	/* The file is replaced atomically, so concurrent readers never see partial data. */
+	snprintf(new_path, sizeof(new_path), "%s.new", ucpu_device_info_cache_path);
+
+	new_file = fopen(new_path, "wb");
+	if (new_file == NULL) {
+		return;
+	}
+
+	failed = fwrite(ucpu_device_info_cache_magic, sizeof(ucpu_device_info_cache_magic), 1, new_file) != 1;
+
+	file = ucpu_device_info_cache_open();
+	if (file != NULL) {
+		while (!failed && fread(&entry, sizeof(ucpu_device_info_t), 1, file) == 1) {
+			if (!ucpu_device_info_same_device(&entry, device_info)) {
+				failed = fwrite(&entry, sizeof(ucpu_device_info_t), 1, new_file) != 1;
+			}
+		}
+		fclose(file);
+	}
+
+	if (!failed) {
+		failed = fwrite(device_info, sizeof(ucpu_device_info_t), 1, new_file) != 1;
+	}
+
+	if (fclose(new_file) != 0 || failed || rename(new_path, ucpu_device_info_cache_path) != 0) {
+		remove(new_path);
+	}
+}
+
+static int ucpu_device_query_send(ucpu_connection_t *ucpu_connection, uint8_t port_id,
+	uint8_t mode, uint8_t mode_information_type)
+{
+	struct pollfd poll_fd;
+	int ret;
+
+	while (1) {
+		if (mode_information_type == UCPU_PORT_INFORMATION_REQUEST) {
+			ret = ucpu_port_information_request(ucpu_connection, port_id, mode);
+		} else {
+			ret = ucpu_port_mode_information_request(ucpu_connection, port_id, mode, mode_information_type);
+		}
+
+		if (ret != UCPU_TX_QUEUE_FULL) {
+			return ret;
+		}
+
+		/* Many requests are sent at once, so the transmit queue may become full. */
+		poll_fd.fd = ucpu_connection->sock;
+		poll_fd.events = POLLOUT;
+		if (poll(&poll_fd, 1, -1) < 0 && errno != EINTR) {
+			return 1;
+		}
+
+		if (ucpu_connection->tx_queue != NULL && ucpu_tx_flush(ucpu_connection) != 0) {
+			return 1;
+		}
+	}
+}
+
+int ucpu_device_query_start(ucpu_connection_t *ucpu_connection, ucpu_device_query_t *device_query,
+	uint8_t port_id, ucpu_device_info_t *device_info)
+{
+	const ucpu_port_info_t *port_info = ucpu_port_lookup(ucpu_connection, port_id);
+
+	if (port_info == NULL) {
+		return UCPU_DISCOVERY_FAILED;
+	}
+
+	memset(device_info, 0, sizeof(ucpu_device_info_t));
+	device_info->io_type_id = port_info->io_type_id;
+	device_info->hardware_revision = port_info->hardware_revision;
+	device_info->software_revision = port_info->software_revision;
+
+	if (ucpu_device_info_cache_lookup(device_info) == 0) {
+		return UCPU_DISCOVERY_COMPLETED;
+	}
+
+	device_query->port_id = port_id;
+	device_query->stage = UCPU_DEVICE_QUERY_STAGE_MODE_INFO;
+	device_query->pending = 1;
+	device_query->device_info = device_info;
+
+	if (ucpu_device_query_send(ucpu_connection, port_id,
+			HUB_PORT_INFORMATION_MODE_INFO, UCPU_PORT_INFORMATION_REQUEST) != 0) {
+		return UCPU_DISCOVERY_FAILED;
+	}
+	return UCPU_DISCOVERY_IN_PROGRESS;
+}
+
+static int ucpu_device_query_send_all(ucpu_connection_t *ucpu_connection, ucpu_device_query_t *device_query)
+{
+	ucpu_device_info_t *device_info = device_query->device_info;
+	uint8_t mode;
+	int i;
+
+	device_query->stage = UCPU_DEVICE_QUERY_STAGE_MODES;
+	device_query->pending = (uint16_t)(device_info->mode_count * UCPU_MODE_INFORMATION_TYPES);
+
+	if (device_info->capabilities & HUB_PORT_CAPABILITY_LOGICAL_COMBINABLE) {
+		device_query->pending++;
+
+		if (ucpu_device_query_send(ucpu_connection, device_query->port_id,
+				HUB_PORT_INFORMATION_POSSIBLE_MODE_COMBINATIONS, UCPU_PORT_INFORMATION_REQUEST) != 0) {
+			return 1;
+		}
+	}
+
+	/* The replies are not awaited, so the round trips overlap. */
+	for (mode = 0; mode < device_info->mode_count; mode++) {
+		for (i = 0; i < UCPU_MODE_INFORMATION_TYPES; i++) {
+			if (ucpu_device_query_send(ucpu_connection, device_query->port_id,
+					mode, ucpu_mode_information_types[i]) != 0) {
+				return 1;
+			}
+		}
+	}
+
+	if (ucpu_connection->tx_queue != NULL) {
+		return ucpu_tx_flush(ucpu_connection);
+	}
+	return 0;
+}
+
+static float ucpu_get_float_value(const uint8_t *source)
+{
+	uint32_t value = (uint32_t)source[0] | ((uint32_t)source[1] << 8)
+		| ((uint32_t)source[2] << 16) | ((uint32_t)source[3] << 24);
+	float result;
+
+	memcpy(&result, &value, sizeof(float));
+	return result;
+}
+
+static void ucpu_copy_text(char *target, int target_size, const uint8_t *source, int length)
+{
+	if (length > target_size - 1) {
+		length = target_size - 1;
+	}
+
+	memcpy(target, source, (size_t)length);
+	target[length] = '\0';
+}
+
+static void ucpu_device_query_mode_information(ucpu_device_info_t *device_info, const uint8_t *packet, int message_length)
+{
+	const hub_port_mode_information_t *port_mode_information = (const hub_port_mode_information_t*)packet;
+	const hub_port_mode_information_range_t *range = (const hub_port_mode_information_range_t*)packet;
+	const hub_port_mode_information_mapping_t *mapping = (const hub_port_mode_information_mapping_t*)packet;
+	const hub_port_mode_information_value_format_t *value_format = (const hub_port_mode_information_value_format_t*)packet;
+	int payload_length = message_length - (int)sizeof(hub_port_mode_information_t);
+	ucpu_mode_info_t *mode_info;
+
+	if (port_mode_information->mode >= UCPU_MAX_MODES) {
+		return;
+	}
+
+	mode_info = device_info->modes + port_mode_information->mode;
+
+	switch (port_mode_information->mode_information_type) {
+	case HUB_MODE_INFORMATION_NAME:
+		ucpu_copy_text(mode_info->name, sizeof(mode_info->name), packet + sizeof(hub_port_mode_information_t), payload_length);
+		break;
+	case HUB_MODE_INFORMATION_SYMBOL:
+		ucpu_copy_text(mode_info->symbol, sizeof(mode_info->symbol), packet + sizeof(hub_port_mode_information_t), payload_length);
+		break;
+	case HUB_MODE_INFORMATION_RAW:
+	case HUB_MODE_INFORMATION_PCT:
+	case HUB_MODE_INFORMATION_SI:
+		if (message_length != sizeof(hub_port_mode_information_range_t)) {
+			return;
+		}
+
+		if (port_mode_information->mode_information_type == HUB_MODE_INFORMATION_RAW) {
+			mode_info->raw_min = ucpu_get_float_value(range->min);
+			mode_info->raw_max = ucpu_get_float_value(range->max);
+		} else if (port_mode_information->mode_information_type == HUB_MODE_INFORMATION_PCT) {
+			mode_info->pct_min = ucpu_get_float_value(range->min);
+			mode_info->pct_max = ucpu_get_float_value(range->max);
+		} else {
+			mode_info->si_min = ucpu_get_float_value(range->min);
+			mode_info->si_max = ucpu_get_float_value(range->max);
+		}
+		break;
+	case HUB_MODE_INFORMATION_MAPPING:
+		if (message_length == sizeof(hub_port_mode_information_mapping_t)) {
+			mode_info->input_mapping = mapping->input_mapping;
+			mode_info->output_mapping = mapping->output_mapping;
+		}
+		break;
+	case HUB_MODE_INFORMATION_VALUE_FORMAT:
+		if (message_length == sizeof(hub_port_mode_information_value_format_t)) {
+			mode_info->dataset_count = value_format->dataset_count;
+			mode_info->dataset_type = value_format->dataset_type;
+			mode_info->total_figures = value_format->total_figures;
+			mode_info->decimals = value_format->decimals;
+		}
+		break;
+	}
+}
+
+int ucpu_device_query_process(ucpu_connection_t *ucpu_connection, ucpu_device_query_t *device_query,
+	const uint8_t *packet, int message_length)
+{
+	const hub_common_message_header_t *common_message_header = (const hub_common_message_header_t*)packet;
+	const hub_port_information_mode_info_t *mode_info = (const hub_port_information_mode_info_t*)packet;
+	const hub_port_information_mode_combinations_t *mode_combinations = (const hub_port_information_mode_combinations_t*)packet;
+	const hub_generic_error_t *generic_error = (const hub_generic_error_t*)packet;
+	ucpu_device_info_t *device_info = device_query->device_info;
+	int i, count;
+
+	if (!ucpu_is_notification_packet(ucpu_connection, packet, message_length)) {
+		return UCPU_DISCOVERY_IN_PROGRESS;
+	}
+
+	switch (common_message_header->message_type) {
+	case HUB_PORT_INFORMATION:
+		if (message_length < sizeof(hub_port_information_t)
+				|| mode_info->port_information.port_id != device_query->port_id) {
+			return UCPU_DISCOVERY_IN_PROGRESS;
+		}
+
+		if (mode_info->port_information.information_type == HUB_PORT_INFORMATION_MODE_INFO) {
+			if (device_query->stage != UCPU_DEVICE_QUERY_STAGE_MODE_INFO
+					|| message_length != sizeof(hub_port_information_mode_info_t)) {
+				return UCPU_DISCOVERY_IN_PROGRESS;
+			}
+
+			device_info->capabilities = mode_info->capabilities;
+			device_info->mode_count = mode_info->total_mode_count;
+			if (device_info->mode_count > UCPU_MAX_MODES) {
+				device_info->mode_count = UCPU_MAX_MODES;
+			}
+			device_info->input_modes = (uint16_t)(mode_info->input_modes[0] | (mode_info->input_modes[1] << 8));
+			device_info->output_modes = (uint16_t)(mode_info->output_modes[0] | (mode_info->output_modes[1] << 8));
+
+			if (ucpu_device_query_send_all(ucpu_connection, device_query) != 0) {
+				return UCPU_DISCOVERY_FAILED;
+			}
+			break;
+		}
+
+		if (mode_info->port_information.information_type != HUB_PORT_INFORMATION_POSSIBLE_MODE_COMBINATIONS
+				|| device_query->stage != UCPU_DEVICE_QUERY_STAGE_MODES) {
+			return UCPU_DISCOVERY_IN_PROGRESS;
+		}
+
+		count = (message_length - (int)sizeof(hub_port_information_t)) / 2;
+		if (count > HUB_MAX_MODE_COMBINATIONS) {
+			count = HUB_MAX_MODE_COMBINATIONS;
+		}
+
+		for (i = 0; i < count; i++) {
+			device_info->mode_combinations[i] = (uint16_t)(mode_combinations->mode_combinations[i][0]
+				| (mode_combinations->mode_combinations[i][1] << 8));
+		}
+		device_query->pending--;
+		break;
+	case HUB_PORT_MODE_INFORMATION:
+		if (message_length < sizeof(hub_port_mode_information_t)
+				|| device_query->stage != UCPU_DEVICE_QUERY_STAGE_MODES
+				|| ((const hub_port_mode_information_t*)packet)->port_id != device_query->port_id) {
+			return UCPU_DISCOVERY_IN_PROGRESS;
+		}
+
+		ucpu_device_query_mode_information(device_info, packet, message_length);
+		device_query->pending--;
+		break;
+	case HUB_GENERIC_ERROR:
+		/* Unsupported information is left zero. */
+		if (message_length != sizeof(hub_generic_error_t)) {
+			return UCPU_DISCOVERY_IN_PROGRESS;
+		}
+
+		if (generic_error->command_type == HUB_PORT_INFORMATION_REQUEST
+				&& device_query->stage == UCPU_DEVICE_QUERY_STAGE_MODE_INFO) {
+			return UCPU_DISCOVERY_FAILED;
+		}
+
+		if ((generic_error->command_type != HUB_PORT_INFORMATION_REQUEST
+				&& generic_error->command_type != HUB_PORT_MODE_INFORMATION_REQUEST)
+				|| device_query->stage != UCPU_DEVICE_QUERY_STAGE_MODES) {
+			return UCPU_DISCOVERY_IN_PROGRESS;
+		}
+
+		device_query->pending--;
+		break;
+	default:
+		return UCPU_DISCOVERY_IN_PROGRESS;
+	}
+
+	if (device_query->stage != UCPU_DEVICE_QUERY_STAGE_MODES || device_query->pending > 0) {
+		return UCPU_DISCOVERY_IN_PROGRESS;
+	}
+
+	ucpu_device_info_cache_store(device_info);
+	return UCPU_DISCOVERY_COMPLETED;
+}
+
+int ucpu_get_device_info(ucpu_connection_t *ucpu_connection, uint8_t port_id,
+	ucpu_device_info_t *device_info, int timeout_ms, ucpu_dispatcher_t *dispatcher)
+{
+	ucpu_device_query_t device_query;
+	uint64_t deadline_ns = 0;
+	uint64_t now_ns;
+	int status, received_len, wait_ms, stage, pending;
+
+	if (timeout_ms >= 0) {
+		deadline_ns = ucpu_get_time_ns() + (uint64_t)timeout_ms * 1000000;
+	}
+
+	status = ucpu_device_query_start(ucpu_connection, &device_query, port_id, device_info);
+
+	while (status == UCPU_DISCOVERY_IN_PROGRESS) {
+		wait_ms = -1;
+		if (timeout_ms >= 0) {
+			now_ns = ucpu_get_time_ns();
+
+			if (now_ns >= deadline_ns) {
+				return 1;
+			}
+			wait_ms = (int)((deadline_ns - now_ns + 999999) / 1000000);
+		}
+
+		if (ucpu_wait_for_notification(ucpu_connection, wait_ms) < 0) {
+			return 1;
+		}
+
+		while (status == UCPU_DISCOVERY_IN_PROGRESS
+				&& (received_len = ucpu_att_receive(ucpu_connection)) > 0) {
+			stage = device_query.stage;
+			pending = device_query.pending;
+
+			status = ucpu_device_query_process(ucpu_connection, &device_query,
+				ucpu_connection->rsp_buf, received_len);
+
+			/* Other notifications are passed to the dispatcher, so they are not lost. */
+			if (status == UCPU_DISCOVERY_IN_PROGRESS && stage == device_query.stage
+					&& pending == device_query.pending && dispatcher != NULL) {
+				ucpu_dispatch(dispatcher, ucpu_connection, ucpu_connection->rsp_buf, received_len);
+			}
+		}
+
+		if (received_len < 0) {
+			return 1;
+		}
+	}
+
+	return status != UCPU_DISCOVERY_COMPLETED;
+}
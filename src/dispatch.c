@@ -0,0 +1,99 @@
+/*
+ *    uc-powered-up (micro/universal c implementation of powered up, you see powered up, ...)
+ *
+ *    Copyright Zoltan Herczeg (hzmester@freemail.hu). All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright notice, this list of
+ *      conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *      of conditions and the following disclaimer in the documentation and/or other materials
+ *      provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER(S) AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER(S) OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Table driven dispatching of notifications. */
+
+#include "globals.h"
+
+#include <string.h>
+
+void ucpu_dispatcher_init(ucpu_dispatcher_t *dispatcher)
+{
+	memset(dispatcher, 0, sizeof(ucpu_dispatcher_t));
+}
+
+void ucpu_dispatcher_set_handler(ucpu_dispatcher_t *dispatcher, uint8_t message_type,
+	ucpu_message_handler_t handler, void *user_data)
+{
+	dispatcher->message_types[message_type].handler = handler;
+	dispatcher->message_types[message_type].user_data = user_data;
+}
+
+void ucpu_dispatcher_set_port_value_handler(ucpu_dispatcher_t *dispatcher, uint8_t port_id,
+	ucpu_message_handler_t handler, void *user_data)
+{
+	dispatcher->port_values[port_id].handler = handler;
+	dispatcher->port_values[port_id].user_data = user_data;
+}
+
+int ucpu_dispatch(ucpu_dispatcher_t *dispatcher, ucpu_connection_t *ucpu_connection,
+	const uint8_t *packet, int message_length)
+{
+	const hub_common_message_header_t *common_message_header = (const hub_common_message_header_t*)packet;
+	const ucpu_dispatch_entry_t *entry;
+
+	/* The common header is checked only once, the handlers
+	 * only need to check the message specific fields. */
+	if (!ucpu_is_notification_packet(ucpu_connection, packet, message_length)) {
+		return 0;
+	}
+
+	entry = dispatcher->message_types + common_message_header->message_type;
+
+	/* Both port value messages start with a port id. */
+	if ((common_message_header->message_type == HUB_PORT_VALUE_SINGLE
+			|| common_message_header->message_type == HUB_PORT_VALUE_COMBINED)
+			&& message_length > sizeof(hub_port_value_single_t)) {
+		const ucpu_dispatch_entry_t *port_entry = dispatcher->port_values
+			+ ((const hub_port_value_single_t*)packet)->port_id;
+
+		/* Falls back to the message type handler when no port handler is set. */
+		if (port_entry->handler != NULL) {
+			entry = port_entry;
+		}
+	}
+
+	if (entry->handler == NULL) {
+		return 0;
+	}
+
+	entry->handler(ucpu_connection, common_message_header, message_length, entry->user_data);
+	return 1;
+}
+
+int ucpu_dispatch_ring(ucpu_dispatcher_t *dispatcher, ucpu_connection_t *ucpu_connection, ucpu_rx_ring_t *ring)
+{
+	ucpu_rx_packet_t *packet;
+	int count = 0;
+
+	while (ring->head != ring->tail) {
+		packet = ring->packets + (ring->head & (UCPU_RX_RING_SIZE - 1));
+		count += ucpu_dispatch(dispatcher, ucpu_connection, packet->data, packet->length);
+		ring->head++;
+	}
+
+	return count;
+}
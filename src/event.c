@@ -0,0 +1,277 @@
+/*
+ *    uc-powered-up (micro/universal c implementation of powered up, you see powered up, ...)
+ *
+ *    Copyright Zoltan Herczeg (hzmester@freemail.hu). All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright notice, this list of
+ *      conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *      of conditions and the following disclaimer in the documentation and/or other materials
+ *      provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER(S) AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER(S) OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Event loop which waits for incoming notifications. */
+
+#include "globals.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+/* Size of the epoll_event array used by a single ucpu_event_loop_wait call. */
+#define UCPU_EVENT_LOOP_MAX_EVENTS 16
+
+static uint32_t ucpu_convert_epoll_events(uint32_t epoll_events)
+{
+	uint32_t events = 0;
+
+	if (epoll_events & EPOLLIN) {
+		events |= UCPU_EVENT_READABLE;
+	}
+
+	if (epoll_events & EPOLLOUT) {
+		events |= UCPU_EVENT_WRITABLE;
+	}
+
+	if (epoll_events & (EPOLLERR | EPOLLHUP)) {
+		events |= UCPU_EVENT_ERROR;
+	}
+
+	return events;
+}
+
+int ucpu_event_loop_init(ucpu_event_loop_t *event_loop)
+{
+	int i;
+
+	for (i = 0; i < UCPU_EVENT_LOOP_MAX_FDS; i++) {
+		event_loop->fds[i].fd = -1;
+		event_loop->fds[i].user_data = NULL;
+	}
+
+	event_loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+	if (event_loop->epoll_fd < 0) {
+		return 1;
+	}
+	return 0;
+}
+
+void ucpu_event_loop_free(ucpu_event_loop_t *event_loop)
+{
+	if (event_loop->epoll_fd >= 0) {
+		close(event_loop->epoll_fd);
+		event_loop->epoll_fd = -1;
+	}
+}
+
+int ucpu_event_loop_add(ucpu_event_loop_t *event_loop, ucpu_connection_t *ucpu_connection)
+{
+	struct epoll_event event;
+	ucpu_tx_queue_t *tx_queue = ucpu_connection->tx_queue;
+
+	/* Level triggered mode is used, so the caller does not need to
+	 * drain all notifications before the next ucpu_event_loop_wait. */
+	event.events = EPOLLIN;
+	event.data.ptr = ucpu_connection;
+
+	if (tx_queue != NULL) {
+		tx_queue->write_wait = UCPU_TX_QUEUE_DEPTH(tx_queue) > 0;
+		if (tx_queue->write_wait) {
+			event.events |= EPOLLOUT;
+		}
+	}
+
+	if (epoll_ctl(event_loop->epoll_fd, EPOLL_CTL_ADD, ucpu_connection->sock, &event) != 0) {
+		return 1;
+	}
+
+	ucpu_connection->event_loop = event_loop;
+	return 0;
+}
+
+int ucpu_event_loop_update(ucpu_connection_t *ucpu_connection)
+{
+	struct epoll_event event;
+	ucpu_tx_queue_t *tx_queue = ucpu_connection->tx_queue;
+	uint8_t write_wait = 0;
+
+	if (tx_queue != NULL) {
+		write_wait = UCPU_TX_QUEUE_DEPTH(tx_queue) > 0;
+
+		/* Avoid system calls when nothing is changed. */
+		if (write_wait == tx_queue->write_wait) {
+			return 0;
+		}
+		tx_queue->write_wait = write_wait;
+	}
+
+	if (ucpu_connection->sock < 0) {
+		return 1;
+	}
+
+	event.events = EPOLLIN | (write_wait ? EPOLLOUT : 0);
+	event.data.ptr = ucpu_connection;
+
+	if (epoll_ctl(ucpu_connection->event_loop->epoll_fd, EPOLL_CTL_MOD, ucpu_connection->sock, &event) != 0) {
+		return 1;
+	}
+	return 0;
+}
+
+int ucpu_event_loop_remove(ucpu_event_loop_t *event_loop, ucpu_connection_t *ucpu_connection)
+{
+	ucpu_connection->event_loop = NULL;
+
+	/* Closed sockets are removed automatically. */
+	if (ucpu_connection->sock < 0) {
+		return 0;
+	}
+
+	if (epoll_ctl(event_loop->epoll_fd, EPOLL_CTL_DEL, ucpu_connection->sock, NULL) != 0) {
+		return 1;
+	}
+	return 0;
+}
+
+int ucpu_event_loop_add_fd(ucpu_event_loop_t *event_loop, int fd, uint32_t events, void *user_data)
+{
+	struct epoll_event event;
+	ucpu_event_fd_t *event_fd = NULL;
+	int i;
+
+	for (i = 0; i < UCPU_EVENT_LOOP_MAX_FDS; i++) {
+		if (event_loop->fds[i].fd < 0) {
+			event_fd = event_loop->fds + i;
+			break;
+		}
+	}
+
+	if (event_fd == NULL) {
+		return 1;
+	}
+
+	/* The entry is used to distinguish the file descriptors from the connections. */
+	event.events = ((events & UCPU_EVENT_READABLE) ? EPOLLIN : 0) | ((events & UCPU_EVENT_WRITABLE) ? EPOLLOUT : 0);
+	event.data.ptr = event_fd;
+
+	if (epoll_ctl(event_loop->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+		return 1;
+	}
+
+	event_fd->fd = fd;
+	event_fd->user_data = user_data;
+	return 0;
+}
+
+int ucpu_event_loop_remove_fd(ucpu_event_loop_t *event_loop, int fd)
+{
+	int i;
+
+	for (i = 0; i < UCPU_EVENT_LOOP_MAX_FDS; i++) {
+		if (event_loop->fds[i].fd == fd) {
+			event_loop->fds[i].fd = -1;
+			event_loop->fds[i].user_data = NULL;
+			return epoll_ctl(event_loop->epoll_fd, EPOLL_CTL_DEL, fd, NULL) != 0;
+		}
+	}
+	return 1;
+}
+
+int ucpu_event_loop_wait(ucpu_event_loop_t *event_loop, ucpu_event_t *events, int max_events, int timeout_ms)
+{
+	struct epoll_event epoll_events[UCPU_EVENT_LOOP_MAX_EVENTS];
+	int i, count;
+
+	if (max_events > UCPU_EVENT_LOOP_MAX_EVENTS) {
+		max_events = UCPU_EVENT_LOOP_MAX_EVENTS;
+	}
+
+	do {
+		count = epoll_wait(event_loop->epoll_fd, epoll_events, max_events, timeout_ms);
+	} while (count < 0 && errno == EINTR);
+
+	if (count < 0) {
+		return -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		ucpu_connection_t *ucpu_connection = (ucpu_connection_t*)epoll_events[i].data.ptr;
+		uintptr_t entry = (uintptr_t)epoll_events[i].data.ptr;
+
+		events[i].events = ucpu_convert_epoll_events(epoll_events[i].events);
+
+		if (entry >= (uintptr_t)event_loop->fds && entry < (uintptr_t)(event_loop->fds + UCPU_EVENT_LOOP_MAX_FDS)) {
+			events[i].connection = NULL;
+			events[i].fd = ((ucpu_event_fd_t*)epoll_events[i].data.ptr)->fd;
+			events[i].user_data = ((ucpu_event_fd_t*)epoll_events[i].data.ptr)->user_data;
+			continue;
+		}
+
+		events[i].connection = ucpu_connection;
+		events[i].fd = ucpu_connection->sock;
+		events[i].user_data = NULL;
+
+		if ((events[i].events & UCPU_EVENT_WRITABLE) && ucpu_connection->tx_queue != NULL
+				&& ucpu_tx_flush(ucpu_connection) != 0) {
+			events[i].events |= UCPU_EVENT_ERROR;
+		}
+	}
+
+	return count;
+}
+
+int ucpu_wait_for_notification(ucpu_connection_t *ucpu_connection, int timeout_ms)
+{
+	struct pollfd poll_fd;
+	int ret;
+
+	/* Simplified version of the event loop for a single connection. */
+	poll_fd.fd = ucpu_connection->sock;
+	poll_fd.events = POLLIN;
+	poll_fd.revents = 0;
+
+	do {
+		ret = poll(&poll_fd, 1, timeout_ms);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret < 0) {
+		return -1;
+	}
+
+	ret = 0;
+
+	if (poll_fd.revents & POLLIN) {
+		ret |= UCPU_EVENT_READABLE;
+	}
+
+	if (poll_fd.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+		ret |= UCPU_EVENT_ERROR;
+	}
+
+	return ret;
+}
+
+uint64_t ucpu_get_time_ns(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
@@ -0,0 +1,184 @@
+/*
+ *    uc-powered-up (micro/universal c implementation of powered up, you see powered up, ...)
+ *
+ *    Copyright Zoltan Herczeg (hzmester@freemail.hu). All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright notice, this list of
+ *      conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *      of conditions and the following disclaimer in the documentation and/or other materials
+ *      provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER(S) AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER(S) OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Tracking the completion of port output commands. */
+
+#include "globals.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+
+void ucpu_feedback_tracker_init(ucpu_feedback_tracker_t *feedback_tracker)
+{
+	memset(feedback_tracker, 0, sizeof(ucpu_feedback_tracker_t));
+}
+
+void ucpu_feedback_register(ucpu_connection_t *ucpu_connection, const uint8_t *packet, int packet_len)
+{
+	const hub_port_output_command_t *port_output_command = (const hub_port_output_command_t*)packet;
+
+	if (packet_len < sizeof(hub_port_output_command_t)
+			|| port_output_command->common_message_header.message_type != PORT_OUTPUT_COMMAND
+			|| !(port_output_command->startup_and_complete & PORT_OUTPUT_COMPLETION_FEEDBACK)) {
+		return;
+	}
+
+	ucpu_connection->feedback_tracker->ports[port_output_command->port_id].next_token++;
+}
+
+static void ucpu_feedback_finish(ucpu_port_feedback_t *port_feedback, uint32_t discarded)
+{
+	if (port_feedback->first_token == port_feedback->next_token) {
+		return;
+	}
+
+	port_feedback->first_token++;
+	port_feedback->in_progress = 0;
+	port_feedback->discarded_mask = (port_feedback->discarded_mask << 1) | discarded;
+}
+
+void ucpu_feedback_process(ucpu_connection_t *ucpu_connection, const uint8_t *packet, int message_length)
+{
+	const uint8_t *src = packet + sizeof(hub_common_message_header_t);
+	const uint8_t *src_end = packet + message_length;
+	ucpu_port_feedback_t *port_feedback;
+	uint8_t feedback;
+
+	/* The Hub has a command buffer with a single entry, and the commands of a port are
+	 * executed in order. Hence the commands sent to a port are finished in the same
+	 * order as they were sent, and it is enough to track the oldest unfinished one.
+	 * A discarded flag means that the running command is interrupted by a new one. */
+	while (src + 2 <= src_end) {
+		port_feedback = ucpu_connection->feedback_tracker->ports + src[0];
+		feedback = src[1];
+		src += 2;
+
+		port_feedback->last_feedback = feedback;
+
+		if (feedback & PORT_FEEDBACK_DISCARDED) {
+			ucpu_feedback_finish(port_feedback, 1);
+		}
+
+		if (feedback & PORT_FEEDBACK_BUFFER_EMPTY_COMPLETED) {
+			ucpu_feedback_finish(port_feedback, 0);
+		}
+
+		if (feedback & PORT_FEEDBACK_BUFFER_EMPTY_IN_PROGRESS) {
+			port_feedback->in_progress = port_feedback->first_token != port_feedback->next_token;
+		} else if ((feedback & PORT_FEEDBACK_IDLE) && port_feedback->in_progress) {
+			/* The running command is finished without a completed flag. */
+			ucpu_feedback_finish(port_feedback, 0);
+		}
+	}
+}
+
+uint32_t ucpu_feedback_last_token(ucpu_connection_t *ucpu_connection, uint8_t port_id)
+{
+	return ucpu_connection->feedback_tracker->ports[port_id].next_token - 1;
+}
+
+int ucpu_feedback_status(ucpu_connection_t *ucpu_connection, uint8_t port_id, uint32_t token)
+{
+	ucpu_port_feedback_t *port_feedback = ucpu_connection->feedback_tracker->ports + port_id;
+	uint32_t age;
+
+	/* Tokens are compared by their distance, so wrapping around is not an issue. */
+	if ((int32_t)(token - port_feedback->first_token) >= 0) {
+		if (token == port_feedback->first_token && port_feedback->in_progress) {
+			return UCPU_COMMAND_IN_PROGRESS;
+		}
+		return UCPU_COMMAND_PENDING;
+	}
+
+	/* Only the last 32 finished commands are remembered. */
+	age = port_feedback->first_token - 1 - token;
+	if (age < 32 && (port_feedback->discarded_mask & (1u << age))) {
+		return UCPU_COMMAND_DISCARDED;
+	}
+	return UCPU_COMMAND_COMPLETED;
+}
+
+int ucpu_feedback_wait(ucpu_connection_t *ucpu_connection, uint8_t port_id, uint32_t token,
+	int timeout_ms, ucpu_dispatcher_t *dispatcher)
+{
+	struct pollfd poll_fd;
+	uint64_t deadline_ns = 0;
+	int status, received_len, wait_ms, ret;
+
+	if (timeout_ms >= 0) {
+		deadline_ns = ucpu_get_time_ns() + (uint64_t)timeout_ms * 1000000;
+	}
+
+	while (1) {
+		status = ucpu_feedback_status(ucpu_connection, port_id, token);
+
+		if (status == UCPU_COMMAND_COMPLETED || status == UCPU_COMMAND_DISCARDED) {
+			return status;
+		}
+
+		wait_ms = -1;
+		if (timeout_ms >= 0) {
+			uint64_t now_ns = ucpu_get_time_ns();
+
+			if (now_ns >= deadline_ns) {
+				return status;
+			}
+			wait_ms = (int)((deadline_ns - now_ns + 999999) / 1000000);
+		}
+
+		/* The command might still be in the transmit queue. */
+		poll_fd.fd = ucpu_connection->sock;
+		poll_fd.events = POLLIN;
+		if (ucpu_connection->tx_queue != NULL && UCPU_TX_QUEUE_DEPTH(ucpu_connection->tx_queue) > 0) {
+			poll_fd.events |= POLLOUT;
+		}
+
+		ret = poll(&poll_fd, 1, wait_ms);
+		if (ret < 0 && errno != EINTR) {
+			return -1;
+		}
+
+		if (ret <= 0) {
+			continue;
+		}
+
+		if ((poll_fd.revents & POLLOUT) && ucpu_tx_flush(ucpu_connection) != 0) {
+			return -1;
+		}
+
+		/* Other notifications are passed to the dispatcher, so they are not lost. */
+		while ((received_len = ucpu_att_receive(ucpu_connection)) > 0) {
+			if (dispatcher != NULL) {
+				ucpu_dispatch(dispatcher, ucpu_connection, ucpu_connection->rsp_buf, received_len);
+			}
+		}
+
+		if (received_len < 0) {
+			return -1;
+		}
+	}
+}
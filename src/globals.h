@@ -27,7 +27,9 @@
 #ifndef GLOBALS_H_
 #define GLOBALS_H_
 
+#include <stddef.h>
 #include <stdint.h>
+#include <sys/uio.h>
 #include "commands.h"
 
 /* Attribute protocol (ATT) is not part of the bluetooth library.
@@ -42,7 +44,11 @@ typedef struct {
 	uint8_t ending_handle[2];
 } att_op_find_info_req_t;
 
+#define ATT_ERROR_RSP 0x01
+#define ATT_READ_REQ 0x0a
+#define ATT_READ_RSP 0x0b
 #define ATT_WRITE_REQ 0x12
+#define ATT_WRITE_RSP 0x13
 #define ATT_WRITE_CMD 0x52
 #define ATT_HANDLE_VALUE_NTF 0x1b
 
@@ -52,27 +58,927 @@ typedef struct {
 	uint8_t configuration[2];
 } gatt_client_characteristic_configuration_t;
 
+typedef struct {
+	uint8_t opcode;
+	uint8_t handle[2];
+} att_read_req_t;
+
+/* Error code of an ATT_ERROR_RSP (its fifth byte). */
+#define ATT_ERROR_INVALID_HANDLE 0x01
+
 /* General context. */
 
+#define UCPU_ADDRESS_PUBLIC 0x0
+#define UCPU_ADDRESS_RANDOM 0x1
+
+typedef struct {
+	/* Same byte order as bdaddr_t. */
+	uint8_t address[6];
+	uint8_t address_type;
+} ucpu_hub_address_t;
+
+/* Transmit queue, see ucpu_set_tx_queue. Must be a power of 2. */
+#define UCPU_TX_QUEUE_SIZE 64
+
+typedef struct {
+	uint8_t length;
+	uint8_t data[31];
+} ucpu_tx_packet_t;
+
+typedef struct {
+	/* The indicies are never wrapped, so the queue depth is tail - head. */
+	uint32_t head;
+	uint32_t tail;
+	uint32_t high_watermark;
+	uint32_t low_watermark;
+	/* Set when the depth reaches the high watermark, and cleared when it
+	 * drops to the low watermark. Callers should stop producing commands
+	 * while it is set. */
+	uint8_t congested;
+	/* Set when the event loop waits for the socket to become writable. */
+	uint8_t write_wait;
+	/* Combination of UCPU_TX_COALESCE_* flags. */
+	uint8_t coalesce;
+	/* Number of commands replaced by a newer command. */
+	uint32_t superseded;
+	ucpu_tx_packet_t packets[UCPU_TX_QUEUE_SIZE];
+} ucpu_tx_queue_t;
+
+/* Maximum number of file descriptors (other than connections) in an event loop. */
+#define UCPU_EVENT_LOOP_MAX_FDS 40
+
+typedef struct {
+	int fd;
+	void *user_data;
+} ucpu_event_fd_t;
+
+typedef struct {
+	int epoll_fd;
+	ucpu_event_fd_t fds[UCPU_EVENT_LOOP_MAX_FDS];
+} ucpu_event_loop_t;
+
+typedef struct {
+	/* Commands from first_token to next_token - 1 are not finished yet. */
+	uint32_t first_token;
+	uint32_t next_token;
+	/* Bit n is set if command first_token - 1 - n is discarded. */
+	uint32_t discarded_mask;
+	uint8_t in_progress;
+	uint8_t last_feedback;
+} ucpu_port_feedback_t;
+
+typedef struct {
+	ucpu_port_feedback_t ports[256];
+} ucpu_feedback_tracker_t;
+
+/* Must be a power of 2. */
+#define UCPU_PIPELINE_SIZE 32
+
+typedef struct {
+	/* The indicies are never wrapped, so the number of held commands is tail - head. */
+	uint32_t head;
+	uint32_t tail;
+	uint8_t depth;
+	uint8_t startup_and_complete;
+	/* Bit set of pipelined ports. */
+	uint32_t ports[8];
+	ucpu_tx_packet_t packets[UCPU_PIPELINE_SIZE];
+} ucpu_pipeline_t;
+
+#define UCPU_IO_CAPABILITY_OUTPUT 0x01
+#define UCPU_IO_CAPABILITY_INPUT 0x02
+#define UCPU_IO_CAPABILITY_MOTOR 0x04
+/* Reports speed and relative position, and supports the
+ * for degrees and goto absolute position commands. */
+#define UCPU_IO_CAPABILITY_TACHO 0x08
+#define UCPU_IO_CAPABILITY_ABSOLUTE_POSITION 0x10
+#define UCPU_IO_CAPABILITY_LIGHT 0x20
+
 typedef struct {
+	uint16_t io_type_id;
+	uint16_t capabilities;
+	const char *name;
+} ucpu_io_type_t;
+
+typedef struct {
+	/* One of the HUB_ATTACHED_IO_* event types. */
+	uint8_t state;
+	/* Member ports of a virtual port. */
+	uint8_t port_id_a;
+	uint8_t port_id_b;
+	uint16_t io_type_id;
+	/* Revisions are encoded as major (4 bit), minor (4 bit),
+	 * bug fix (8 bit) and build (16 bit) numbers. Zero for virtual ports. */
+	uint32_t hardware_revision;
+	uint32_t software_revision;
+	/* NULL for unknown devices. */
+	const ucpu_io_type_t *io_type;
+} ucpu_port_info_t;
+
+typedef struct {
+	ucpu_port_info_t ports[256];
+} ucpu_port_registry_t;
+
+#define UCPU_MAX_MODES 16
+
+typedef struct {
+	/* Zero terminated strings. */
+	char name[12];
+	char symbol[6];
+	uint8_t input_mapping;
+	uint8_t output_mapping;
+	uint8_t dataset_count;
+	/* One of the HUB_DATASET_TYPE_* values. */
+	uint8_t dataset_type;
+	uint8_t total_figures;
+	uint8_t decimals;
+	float raw_min;
+	float raw_max;
+	float pct_min;
+	float pct_max;
+	float si_min;
+	float si_max;
+} ucpu_mode_info_t;
+
+/* Device description, which only depends on the type and revisions of the device. */
+typedef struct {
+	uint16_t io_type_id;
+	uint32_t hardware_revision;
+	uint32_t software_revision;
+	/* HUB_PORT_CAPABILITY_* bits. */
+	uint8_t capabilities;
+	uint8_t mode_count;
+	uint16_t input_modes;
+	uint16_t output_modes;
+	/* Terminated by a zero entry when shorter than HUB_MAX_MODE_COMBINATIONS. */
+	uint16_t mode_combinations[HUB_MAX_MODE_COMBINATIONS];
+	ucpu_mode_info_t modes[UCPU_MAX_MODES];
+} ucpu_device_info_t;
+
+typedef struct {
+	uint8_t port_id;
+	uint8_t stage;
+	/* Number of unanswered requests. */
+	uint16_t pending;
+	ucpu_device_info_t *device_info;
+} ucpu_device_query_t;
+
+/* Maximum number of datasets in a port value message. */
+#define UCPU_MAX_DATASETS 8
+
+typedef struct ucpu_value_decoder ucpu_value_decoder_t;
+
+struct ucpu_value_decoder {
+	/* Selected by the init functions according to the dataset type. */
+	void (*decode)(const ucpu_value_decoder_t *value_decoder, const uint8_t *data, int32_t *values);
+	void (*decode_scaled)(const ucpu_value_decoder_t *value_decoder, const uint8_t *data, float *values);
+	uint8_t dataset_count;
+	uint8_t dataset_size;
+	/* Scaled value: raw value * scale + offset. */
+	float scale;
+	float offset;
+};
+
+#define UCPU_MAX_SUBSCRIPTIONS 64
+#define UCPU_SUBSCRIPTION_NO_MODE 0xff
+
+typedef struct {
+	uint8_t port_id;
+	uint8_t mode;
+	uint16_t ref_count;
+	uint32_t delta_interval;
+} ucpu_subscription_t;
+
+/* Configuration of a port sent to the Hub. */
+typedef struct {
+	uint8_t mode;
+	uint32_t delta_interval;
+} ucpu_subscription_port_t;
+
+typedef struct {
+	uint32_t count;
+	/* One entry for each different (port, mode, delta interval) triplet. */
+	ucpu_subscription_t subscriptions[UCPU_MAX_SUBSCRIPTIONS];
+	ucpu_subscription_port_t ports[256];
+} ucpu_subscription_manager_t;
+
+#define UCPU_RECORDER_BUFFER_SIZE 65536
+
+typedef struct {
+	int fd;
+	uint32_t used;
+	/* Aligned to 8 bytes, since records are built in place. */
+	uint64_t buffer[UCPU_RECORDER_BUFFER_SIZE / 8];
+} ucpu_recorder_t;
+
+typedef struct ucpu_transport ucpu_transport_t;
+/* Defined in value_cache.h. */
+typedef struct ucpu_value_cache ucpu_value_cache_t;
+typedef struct ucpu_supervisor ucpu_supervisor_t;
+
+typedef struct {
+	/* File descriptor which can be polled for readability and writability.
+	 * It is the socket of the connection for socket based transports. */
 	int sock;
 	uint8_t handle[2];
+	ucpu_hub_address_t address;
+	const ucpu_transport_t *transport;
+	/* Private data of the transport. */
+	void *transport_data;
+	/* Optional components, NULL when not used. */
+	ucpu_event_loop_t *event_loop;
+	ucpu_tx_queue_t *tx_queue;
+	ucpu_feedback_tracker_t *feedback_tracker;
+	ucpu_pipeline_t *pipeline;
+	ucpu_port_registry_t *port_registry;
+	ucpu_subscription_manager_t *subscription_manager;
+	/* The recorder can be shared between connections. */
+	ucpu_recorder_t *recorder;
+	ucpu_value_cache_t *value_cache;
+	/* Reconnects the connection when it is lost. */
+	ucpu_supervisor_t *supervisor;
+	/* Identifies the connection in the records. */
+	uint16_t connection_id;
 	uint8_t rsp_buf[64];
 } ucpu_connection_t;
 
+/* Must be called before a connection is created, the connect functions call it. */
+void ucpu_connection_init(ucpu_connection_t *ucpu_connection);
+
+typedef struct {
+	ucpu_hub_address_t address;
+	/* Signal strength of the last advertising report in dBm. */
+	int8_t rssi;
+} ucpu_hub_info_t;
+
+/* Connects to the first Hub found by scanning, which requires administrator rights. */
 int ucpu_connect_to_hub(ucpu_connection_t *ucpu_connection);
+/* Connects to a known Hub without scanning. */
+int ucpu_connect_to_hub_address(ucpu_connection_t *ucpu_connection, const ucpu_hub_address_t *hub);
+/* Converts an address string (e.g. 90:84:2B:01:02:03) to a Hub address. */
+int ucpu_parse_hub_address(const char *str, uint8_t address_type, ucpu_hub_address_t *hub);
+/* Used by the examples: connects to the Hub which address is passed as the
+ * first argument (scanning is skipped), or to the first Hub found by scanning. */
+int ucpu_connect_to_hub_arg(ucpu_connection_t *ucpu_connection, int argc, char **argv);
+/* Returns with the number of Hubs found, or -1 on error. Scanning stops
+ * when max_hubs Hubs are found or timeout_ms is elapsed (if non-negative). */
+int ucpu_scan_hubs(ucpu_hub_info_t *hubs, int max_hubs, int timeout_ms);
+/* Maximum time ucpu_att_send waits for the socket to become writable. */
+#define UCPU_ATT_SEND_TIMEOUT_MS 1000
+/* Returns with 0 on success, UCPU_TX_QUEUE_FULL when the packet cannot be sent in
+ * UCPU_ATT_SEND_TIMEOUT_MS, or 1 on error (the connection is closed). */
 int ucpu_att_send(ucpu_connection_t *ucpu_connection, void *req_buf, uint16_t req_buf_len);
 int ucpu_att_receive(ucpu_connection_t *ucpu_connection);
 int ucpu_send_command(ucpu_connection_t *ucpu_connection, hub_common_message_header_t *message, uint16_t message_len);
+/* Same as ucpu_send_command, except the header must be filled and the pipeline is bypassed. */
+int ucpu_transmit(ucpu_connection_t *ucpu_connection, hub_common_message_header_t *message, uint16_t message_len);
+
+/* Batched receiving: multiple packets are received into a ring buffer with a
+ * single system call. The packets stay in the ring until they are consumed. */
+
+/* Must be a power of 2. */
+#define UCPU_RX_RING_SIZE 32
+
+typedef struct {
+	/* Time of the system call which received the packet (CLOCK_MONOTONIC). */
+	uint64_t timestamp_ns;
+	int length;
+	/* Points to the storage of the packet, or to a buffer of the transport. */
+	uint8_t *data;
+	uint8_t storage[64];
+} ucpu_rx_packet_t;
+
+typedef struct {
+	/* The indicies are never wrapped, so the number of packets is tail - head. */
+	uint32_t head;
+	uint32_t tail;
+	ucpu_rx_packet_t packets[UCPU_RX_RING_SIZE];
+} ucpu_rx_ring_t;
+
+#define UCPU_RX_RING_COUNT(ring) \
+	((int)((ring)->tail - (ring)->head))
+/* Returns with a pointer to the index-th unconsumed packet. */
+#define UCPU_RX_RING_PEEK(ring, index) \
+	((ring)->packets + (((ring)->head + (uint32_t)(index)) & (UCPU_RX_RING_SIZE - 1)))
+#define UCPU_RX_RING_CONSUME(ring, count) \
+	((ring)->head += (uint32_t)(count))
+
+void ucpu_rx_ring_init(ucpu_rx_ring_t *ring);
+/* Receives all available packets (until the ring is full). Returns with the
+ * number of new packets, or -1 on error. Packets received before an error
+ * are still stored in the ring. */
+int ucpu_att_receive_batch(ucpu_connection_t *ucpu_connection, ucpu_rx_ring_t *ring);
+
+/* Transports. The packets of a connection are sent and received by its transport.
+ * The default transport uses a connected SOCK_SEQPACKET socket, and the L2CAP
+ * transport used by the connect functions is based on it. Other transports (e.g.
+ * replaying recorded traffic) can be implemented without changing the library.
+ * The operations must not block, except when the socket itself is blocking. */
+
+/* Returned by send when the packet cannot be sent now. */
+#define UCPU_TRANSPORT_AGAIN 2
+
+struct ucpu_transport {
+	/* Sets up the connection using the transport specific parameters, including
+	 * the sock member of the connection. Returns with 0 on success. */
+	int (*open)(ucpu_connection_t *ucpu_connection, const void *parameters);
+	/* Returns with 0 on success, UCPU_TRANSPORT_AGAIN, or 1 on error. */
+	int (*send)(ucpu_connection_t *ucpu_connection, const void *packet, uint16_t packet_len);
+	/* Returns with the number of packets sent (0 if none can be sent now), or -1 on error. */
+	int (*send_batch)(ucpu_connection_t *ucpu_connection, const struct iovec *packets, int count);
+	/* Returns with the length of the received packet, 0 if no packet is available, or -1 on error. */
+	int (*receive)(ucpu_connection_t *ucpu_connection, uint8_t *buffer, int buffer_size);
+	/* Sets the data and length members of the packets. To avoid copying, data may point
+	 * to a buffer of the transport, which must stay valid until the packet is consumed.
+	 * Returns with the number of received packets, or -1 on error. */
+	int (*receive_batch)(ucpu_connection_t *ucpu_connection, ucpu_rx_packet_t **packets, int count);
+	/* Releases the resources of the connection, and sets sock to -1. */
+	void (*close)(ucpu_connection_t *ucpu_connection);
+};
+
+/* The parameter of open is a pointer to a connected socket. */
+extern const ucpu_transport_t ucpu_socket_transport;
+/* The parameter of open is a pointer to a ucpu_hub_address_t. */
+extern const ucpu_transport_t ucpu_l2cap_transport;
+
+/* Operations of the socket transport, which can be reused by other transports. */
+int ucpu_socket_send(ucpu_connection_t *ucpu_connection, const void *packet, uint16_t packet_len);
+int ucpu_socket_send_batch(ucpu_connection_t *ucpu_connection, const struct iovec *packets, int count);
+int ucpu_socket_receive(ucpu_connection_t *ucpu_connection, uint8_t *buffer, int buffer_size);
+int ucpu_socket_receive_batch(ucpu_connection_t *ucpu_connection, ucpu_rx_packet_t **packets, int count);
+void ucpu_socket_close(ucpu_connection_t *ucpu_connection);
+
+/* Initializes the connection and opens the transport. Returns with 0 on success. */
+int ucpu_transport_open(ucpu_connection_t *ucpu_connection, const ucpu_transport_t *transport, const void *parameters);
+/* Closes the connection. It is also removed from its event loop. */
+void ucpu_disconnect(ucpu_connection_t *ucpu_connection);
+
+/* Transmit queue. When a queue is set, ucpu_send_command appends the commands to
+ * the queue instead of sending them. The queued commands are sent in batches by
+ * ucpu_tx_flush, which is called automatically by the event loop when the socket
+ * becomes writable. Other packets sent by ucpu_att_send bypass the queue. */
+
+#define UCPU_TX_QUEUE_FULL 2
+
+#define UCPU_TX_QUEUE_DEPTH(tx_queue) \
+	((int)((tx_queue)->tail - (tx_queue)->head))
+
+void ucpu_tx_queue_init(ucpu_tx_queue_t *tx_queue, uint32_t high_watermark, uint32_t low_watermark);
+/* Coalescing: a new port output command replaces the last queued command of
+ * the same port when both have the same sub command and startup and completion
+ * flags (and the same mode for WRITE_DIRECT_MODE_DATA). The replaced command keeps its place in the queue,
+ * so the newest setpoint is sent at the next opportunity. Any other queued
+ * command of the same port prevents coalescing, so ordering is preserved. */
+
+/* Coalesce WRITE_DIRECT_MODE_DATA and HUB_MOTOR_START_SPEED commands. */
+#define UCPU_TX_COALESCE_SETPOINTS 0x1
+/* Coalesce HUB_MOTOR_GOTO_ABSOLUTE_POSITION commands as well. */
+#define UCPU_TX_COALESCE_POSITIONS 0x2
+
+void ucpu_tx_queue_set_coalescing(ucpu_tx_queue_t *tx_queue, uint8_t coalesce);
+/* Passing NULL as tx_queue disables queuing. */
+int ucpu_set_tx_queue(ucpu_connection_t *ucpu_connection, ucpu_tx_queue_t *tx_queue);
+/* Returns with 0 on success, UCPU_TX_QUEUE_FULL if there is no space in the queue, or 1 on error. */
+int ucpu_tx_queue_push(ucpu_connection_t *ucpu_connection, const void *packet, uint16_t packet_len);
+/* Sends as many packets as possible without blocking. Returns with 0 on success
+ * (some packets might still remain in the queue), or 1 on error. */
+int ucpu_tx_flush(ucpu_connection_t *ucpu_connection);
+
+/* Event loop. The non-blocking socket of a connection returns with no data when no
+ * notification is available, so waiting for notifications should be done by these
+ * functions instead of calling ucpu_att_receive repeatedly. */
+
+#define UCPU_EVENT_READABLE 0x1
+#define UCPU_EVENT_WRITABLE 0x2
+#define UCPU_EVENT_ERROR 0x4
+
+/* The connection is NULL for file descriptors added by ucpu_event_loop_add_fd. */
+typedef struct {
+	ucpu_connection_t *connection;
+	uint32_t events;
+	int fd;
+	void *user_data;
+} ucpu_event_t;
+
+int ucpu_event_loop_init(ucpu_event_loop_t *event_loop);
+void ucpu_event_loop_free(ucpu_event_loop_t *event_loop);
+int ucpu_event_loop_add(ucpu_event_loop_t *event_loop, ucpu_connection_t *ucpu_connection);
+int ucpu_event_loop_remove(ucpu_event_loop_t *event_loop, ucpu_connection_t *ucpu_connection);
+/* Other file descriptors (e.g. an eventfd or a timerfd) can be waited together with the
+ * connections. The events argument is a combination of UCPU_EVENT_READABLE and
+ * UCPU_EVENT_WRITABLE. Returns with 0 on success. */
+int ucpu_event_loop_add_fd(ucpu_event_loop_t *event_loop, int fd, uint32_t events, void *user_data);
+int ucpu_event_loop_remove_fd(ucpu_event_loop_t *event_loop, int fd);
+/* Returns with the number of events (0 on timeout), or -1 on error.
+ * A negative timeout_ms waits forever. Transmit queues of writable connections are
+ * flushed before the function returns. */
+int ucpu_event_loop_wait(ucpu_event_loop_t *event_loop, ucpu_event_t *events, int max_events, int timeout_ms);
+/* Waits for writable events when the transmit queue of the connection is not empty. */
+int ucpu_event_loop_update(ucpu_connection_t *ucpu_connection);
+/* Returns with a combination of UCPU_EVENT_* flags (0 on timeout), or -1 on error. */
+int ucpu_wait_for_notification(ucpu_connection_t *ucpu_connection, int timeout_ms);
+/* Current value of CLOCK_MONOTONIC in nanoseconds. */
+uint64_t ucpu_get_time_ns(void);
+
+/* Stage scheduler. A model is controlled by a sequence of stages. A stage is
+ * completed when its duration expires, or when its trigger accepts a received
+ * notification. Actions (e.g. the frames of an LED animation) run once or
+ * periodically. All deadlines are absolute CLOCK_MONOTONIC times: a timed stage
+ * ends at its start time + duration, and a periodic action runs at its first
+ * deadline + n * period, so the timing does not drift. The deadlines are waited
+ * by a timerfd, which can be added to an event loop, so notifications are
+ * processed between the deadlines. */
+
+#define UCPU_SCHEDULER_MAX_ACTIONS 16
+
+typedef struct ucpu_scheduler ucpu_scheduler_t;
+
+/* Called when a stage is entered. The start_ns is the deadline of the previous stage. */
+typedef void (*ucpu_stage_handler_t)(ucpu_scheduler_t *scheduler, uint32_t stage,
+	uint64_t start_ns, void *user_data);
+/* Returns with non-zero if the notification completes the current stage. */
+typedef int (*ucpu_stage_trigger_t)(ucpu_connection_t *ucpu_connection,
+	const hub_common_message_header_t *message, int message_length, void *user_data);
+/* Called when the deadline of an action expires. */
+typedef void (*ucpu_action_handler_t)(ucpu_scheduler_t *scheduler, int action_id,
+	uint64_t deadline_ns, void *user_data);
+
+typedef struct {
+	/* Both callbacks are optional. */
+	ucpu_stage_handler_t enter;
+	ucpu_stage_trigger_t trigger;
+	/* Zero means the stage can only be completed by its trigger. */
+	uint32_t duration_ms;
+	void *user_data;
+} ucpu_stage_t;
+
+typedef struct {
+	/* NULL for unused entries. */
+	ucpu_action_handler_t handler;
+	void *user_data;
+	uint64_t deadline_ns;
+	/* Zero for actions which run once. */
+	uint64_t period_ns;
+} ucpu_scheduled_action_t;
+
+#define UCPU_DEADLINE_STAGE 0
+#define UCPU_DEADLINE_ACTION 1
+
+typedef struct {
+	uint8_t type;
+	/* Stage index or action id. */
+	uint32_t index;
+	uint64_t deadline_ns;
+	/* Time elapsed from the deadline until the stage or action was started. */
+	uint64_t late_ns;
+	/* Number of skipped periods. Missed periods are not executed later. */
+	uint32_t skipped;
+} ucpu_deadline_miss_t;
+
+typedef void (*ucpu_deadline_miss_handler_t)(ucpu_scheduler_t *scheduler,
+	const ucpu_deadline_miss_t *miss, void *user_data);
+
+struct ucpu_scheduler {
+	int timer_fd;
+	/* Expiration of the timerfd, zero when it is disarmed. */
+	uint64_t armed_ns;
+	const ucpu_stage_t *stages;
+	uint32_t stage_count;
+	/* Index of the current stage, equal to stage_count when all stages are completed. */
+	uint32_t stage;
+	uint64_t stage_start_ns;
+	/* Zero when the current stage is not timed. */
+	uint64_t stage_deadline_ns;
+	/* Deadlines are missed when the delay is greater than this threshold. */
+	uint64_t miss_threshold_ns;
+	ucpu_deadline_miss_handler_t miss_handler;
+	void *miss_user_data;
+	uint32_t miss_count;
+	uint64_t max_late_ns;
+	ucpu_scheduled_action_t actions[UCPU_SCHEDULER_MAX_ACTIONS];
+};
+
+#define UCPU_SCHEDULER_FINISHED(scheduler) ((scheduler)->stage >= (scheduler)->stage_count)
+
+/* Returns with 0 on success. The timer_fd member of the scheduler should be added to
+ * the event loop by ucpu_event_loop_add_fd, and ucpu_scheduler_process must be called
+ * when it becomes readable. */
+int ucpu_scheduler_init(ucpu_scheduler_t *scheduler, uint32_t miss_threshold_us);
+void ucpu_scheduler_free(ucpu_scheduler_t *scheduler);
+/* The handler is called for each missed deadline. */
+void ucpu_scheduler_set_miss_handler(ucpu_scheduler_t *scheduler,
+	ucpu_deadline_miss_handler_t miss_handler, void *user_data);
+/* Enters the first stage, which start time is start_ns (zero means now). The stages
+ * array must be kept until the stages are completed. Returns with 0 on success. */
+int ucpu_scheduler_start(ucpu_scheduler_t *scheduler, const ucpu_stage_t *stages,
+	uint32_t stage_count, uint64_t start_ns);
+/* Enters the given stage immediately (stage_count completes the sequence). */
+int ucpu_scheduler_set_stage(ucpu_scheduler_t *scheduler, uint32_t stage);
+/* Returns with the action id, or -1 if there is no free entry. */
+int ucpu_scheduler_add_action(ucpu_scheduler_t *scheduler, uint64_t deadline_ns,
+	uint32_t period_us, ucpu_action_handler_t handler, void *user_data);
+/* Can be called from the handler of the action. */
+void ucpu_scheduler_remove_action(ucpu_scheduler_t *scheduler, int action_id);
+/* Runs the stages and actions which deadlines expired. Returns with 0 on success. */
+int ucpu_scheduler_process(ucpu_scheduler_t *scheduler);
+/* Passes a received notification to the trigger of the current stage. Returns
+ * with non-zero if the stage is completed. */
+int ucpu_scheduler_notify(ucpu_scheduler_t *scheduler, ucpu_connection_t *ucpu_connection,
+	const uint8_t *packet, int packet_len);
+
+/* Optional cache of characteristic handles stored in a file. It is disabled
+ * by default, and can be disabled again by passing NULL as path. */
+void ucpu_handle_cache_set_path(const char *path);
+/* Returns with 0 if the handles of the Hub are found. */
+int ucpu_handle_cache_lookup(const ucpu_hub_address_t *hub, uint8_t *handle, uint8_t *client_config_handle);
+void ucpu_handle_cache_store(const ucpu_hub_address_t *hub, const uint8_t *handle, const uint8_t *client_config_handle);
+void ucpu_handle_cache_invalidate(const ucpu_hub_address_t *hub);
+
+/* Connection manager: connects to multiple Hubs at the same time. */
+
+#define UCPU_MAX_HUBS 16
+
+#define UCPU_HUB_CONNECTING 0
+#define UCPU_HUB_DISCOVERING 1
+#define UCPU_HUB_READY 2
+#define UCPU_HUB_FAILED 3
+
+typedef struct {
+	uint8_t stage;
+	uint8_t from_cache;
+	uint16_t starting_handle;
+	uint32_t characteristics_found;
+	uint8_t client_config_handle[2];
+} ucpu_discovery_t;
+
+typedef struct {
+	ucpu_hub_address_t address;
+	int state;
+	/* Index of the connection when state is UCPU_HUB_READY, -1 otherwise. */
+	int connection_index;
+	/* Nanoseconds elapsed from the start of ucpu_hub_manager_connect. */
+	uint64_t connected_ns;
+	uint64_t ready_ns;
+	ucpu_discovery_t discovery;
+} ucpu_hub_status_t;
+
+typedef struct {
+	int hub_count;
+	uint64_t scan_ns;
+	ucpu_hub_status_t hubs[UCPU_MAX_HUBS];
+} ucpu_hub_manager_t;
+
+/* Scans for Hubs, and connects to all of them in parallel. Returns with the number of
+ * ready connections stored in the connections array, or -1 on error. The timeouts
+ * limit the duration of the scanning and connecting (including discovery) phases,
+ * negative timeouts mean no limit. */
+int ucpu_hub_manager_connect(ucpu_hub_manager_t *manager, ucpu_connection_t *connections,
+	int max_hubs, int scan_timeout_ms, int connect_timeout_ms);
+
+/* Building blocks of connecting, used by the connection manager. */
+
+#define UCPU_DISCOVERY_COMPLETED 0
+#define UCPU_DISCOVERY_FAILED 1
+#define UCPU_DISCOVERY_IN_PROGRESS 2
+
+#define UCPU_DISCOVERY_STAGE_SEARCH 0
+#define UCPU_DISCOVERY_STAGE_ENABLE 1
+#define UCPU_DISCOVERY_STAGE_VERIFY 2
+
+int ucpu_l2cap_connect(const ucpu_hub_address_t *hub, int non_blocking);
+int ucpu_discovery_start(ucpu_connection_t *ucpu_connection, ucpu_discovery_t *discovery);
+int ucpu_discovery_process(ucpu_connection_t *ucpu_connection, ucpu_discovery_t *discovery, int received_len);
+int ucpu_set_non_blocking(int sock);
+
+/* Reconnect supervisor. When a supervisor is set for an L2CAP connection, a lost
+ * connection is not final: it is reconnected in the background with exponential
+ * backoff. The enabled notifications (acknowledged by the Hub) and the virtual
+ * ports are recorded while the connection works, and restored after reconnecting.
+ * Combined mode setups are not recorded. */
+
+#define UCPU_SUPERVISOR_CONNECTED 0
+#define UCPU_SUPERVISOR_BACKOFF 1
+#define UCPU_SUPERVISOR_CONNECTING 2
+#define UCPU_SUPERVISOR_DISCOVERING 3
+/* Commands can be sent again, but some virtual ports are not restored yet. */
+#define UCPU_SUPERVISOR_RESTORING 4
+
+#define UCPU_SUPERVISOR_MAX_VIRTUAL_PORTS 16
+
+typedef struct {
+	uint8_t enabled;
+	uint8_t mode;
+	uint32_t delta_interval;
+} ucpu_supervised_port_t;
+
+typedef struct {
+	uint8_t port_id;
+	uint8_t port_id_a;
+	uint8_t port_id_b;
+	/* Set until the virtual port is attached again. The Hub may
+	 * assign a different port id to the restored virtual port. */
+	uint8_t pending;
+	/* Notifications of the virtual port while it is pending. */
+	ucpu_supervised_port_t port;
+} ucpu_supervised_virtual_port_t;
+
+typedef struct {
+	/* CLOCK_MONOTONIC time of the connection loss. */
+	uint64_t lost_ns;
+	/* Nanoseconds elapsed from the connection loss. */
+	uint64_t connected_ns;
+	uint64_t ready_ns;
+	uint64_t restored_ns;
+	uint32_t attempts;
+	uint32_t restored_subscriptions;
+	uint32_t restored_virtual_ports;
+} ucpu_reconnect_report_t;
+
+struct ucpu_supervisor {
+	uint8_t state;
+	uint32_t min_backoff_ms;
+	uint32_t max_backoff_ms;
+	uint32_t attempt_timeout_ms;
+	uint32_t backoff_ms;
+	/* Start of the next attempt in UCPU_SUPERVISOR_BACKOFF state,
+	 * the deadline of the current attempt otherwise. */
+	uint64_t deadline_ns;
+	/* The event loop of the lost connection. The socket of an attempt is added
+	 * to it as a file descriptor, which user data is the connection. */
+	ucpu_event_loop_t *event_loop;
+	int registered_fd;
+	ucpu_discovery_t discovery;
+	uint32_t virtual_port_count;
+	ucpu_supervised_virtual_port_t virtual_ports[UCPU_SUPERVISOR_MAX_VIRTUAL_PORTS];
+	ucpu_supervised_port_t ports[256];
+	/* Number of completed reconnects, and the report of the last one. */
+	uint32_t reconnect_count;
+	ucpu_reconnect_report_t report;
+};
+
+/* Commands are dropped while the connection is reconnected. */
+#define UCPU_SUPERVISOR_CAN_SEND(supervisor) \
+	((supervisor)->state == UCPU_SUPERVISOR_CONNECTED || (supervisor)->state == UCPU_SUPERVISOR_RESTORING)
+
+/* Each attempt (connecting and discovery) is limited by attempt_timeout_ms. The
+ * first attempt starts immediately, and the delay before the next ones starts
+ * from min_backoff_ms and doubled after each failure up to max_backoff_ms. */
+void ucpu_supervisor_init(ucpu_supervisor_t *supervisor, uint32_t min_backoff_ms,
+	uint32_t max_backoff_ms, uint32_t attempt_timeout_ms);
+/* Advances the reconnect without blocking, and returns with the state. It must be
+ * called when the event loop reports the socket of an attempt (the event has no
+ * connection, and its user data is the connection), or the timeout expires. */
+int ucpu_supervisor_process(ucpu_connection_t *ucpu_connection);
+/* Returns with the maximum time in milliseconds until ucpu_supervisor_process
+ * must be called, or -1 if the connection works. */
+int ucpu_supervisor_timeout_ms(ucpu_connection_t *ucpu_connection);
+/* Detaches the supervisor. The socket of a running attempt is closed. */
+void ucpu_supervisor_stop(ucpu_connection_t *ucpu_connection);
+/* Called by the library. */
+void ucpu_supervisor_update(ucpu_connection_t *ucpu_connection, const uint8_t *packet, int packet_len);
+void ucpu_supervisor_connection_lost(ucpu_connection_t *ucpu_connection);
 
 int ucpu_is_notification(ucpu_connection_t *ucpu_connection, int message_length);
 /* The following ucpu_is_* functions can only be invoked if ucpu_is_notification returned non-zero */
 int ucpu_is_attached_io_update(ucpu_connection_t *ucpu_connection, int message_length);
 int ucpu_is_port_value_single(ucpu_connection_t *ucpu_connection, int message_length);
 
+/* Same as above, except that they check a packet stored in a buffer (e.g. ucpu_rx_packet_t). */
+int ucpu_is_notification_packet(ucpu_connection_t *ucpu_connection, const uint8_t *packet, int message_length);
+int ucpu_is_attached_io_update_packet(const uint8_t *packet, int message_length);
+int ucpu_is_port_value_single_packet(const uint8_t *packet, int message_length);
+
+/* Combined mode: a device reports the values of multiple modes in a single
+ * HUB_PORT_VALUE_COMBINED message. The format describes the mode/dataset pairs
+ * of the combination, which are needed to decode the message. */
+
+typedef struct {
+	uint8_t mode;
+	uint8_t dataset;
+	/* Size of the value in bytes: 1, 2 or 4. */
+	uint8_t value_size;
+} ucpu_combined_value_format_t;
+
+typedef struct {
+	uint8_t count;
+	ucpu_combined_value_format_t values[HUB_COMBINED_MAX_MODE_DATASETS];
+} ucpu_combined_format_t;
+
+typedef struct {
+	/* Bit n is set when values[n] is present in the message. */
+	uint16_t present;
+	/* Sign extended values. */
+	int32_t values[HUB_COMBINED_MAX_MODE_DATASETS];
+} ucpu_combined_values_t;
+
+int ucpu_is_port_value_combined(ucpu_connection_t *ucpu_connection, int message_length);
+int ucpu_is_port_value_combined_packet(const uint8_t *packet, int message_length);
+/* Returns with 0 on success, and 1 if the message does not match the format. */
+int ucpu_decode_port_value_combined(const ucpu_combined_format_t *format,
+	const uint8_t *packet, int message_length, ucpu_combined_values_t *values);
+
+/* Notification dispatcher. The message type of a notification selects a handler
+ * from a table. HUB_PORT_VALUE_SINGLE and HUB_PORT_VALUE_COMBINED messages are
+ * dispatched by their port id first, and by their message type when no port
+ * handler is set. The message passed to the handler points into the receive
+ * buffer, and it is only valid until the handler returns. */
+
+typedef void (*ucpu_message_handler_t)(ucpu_connection_t *ucpu_connection,
+	const hub_common_message_header_t *message, int message_length, void *user_data);
+
+typedef struct {
+	ucpu_message_handler_t handler;
+	void *user_data;
+} ucpu_dispatch_entry_t;
+
+typedef struct {
+	ucpu_dispatch_entry_t message_types[256];
+	ucpu_dispatch_entry_t port_values[256];
+} ucpu_dispatcher_t;
+
+void ucpu_dispatcher_init(ucpu_dispatcher_t *dispatcher);
+/* Passing NULL as handler removes the handler. */
+void ucpu_dispatcher_set_handler(ucpu_dispatcher_t *dispatcher, uint8_t message_type,
+	ucpu_message_handler_t handler, void *user_data);
+void ucpu_dispatcher_set_port_value_handler(ucpu_dispatcher_t *dispatcher, uint8_t port_id,
+	ucpu_message_handler_t handler, void *user_data);
+/* Returns with 1 if a handler is called, 0 otherwise. */
+int ucpu_dispatch(ucpu_dispatcher_t *dispatcher, ucpu_connection_t *ucpu_connection,
+	const uint8_t *packet, int message_length);
+/* Dispatches and consumes all packets of the ring. Returns with the number of handled packets. */
+int ucpu_dispatch_ring(ucpu_dispatcher_t *dispatcher, ucpu_connection_t *ucpu_connection, ucpu_rx_ring_t *ring);
+
+/* Feedback tracking. When a tracker is set, each port output command which requests
+ * feedback (PORT_OUTPUT_COMPLETION_FEEDBACK) gets a token, and the status of the
+ * command is updated from the PORT_OUTPUT_COMMAND_FEEDBACK messages. Tokens are
+ * per port sequence numbers. A coalesced command inherits the token of the command
+ * it replaced. The tracker is updated by ucpu_att_receive and ucpu_att_receive_batch. */
+
+#define UCPU_COMMAND_PENDING 0
+#define UCPU_COMMAND_IN_PROGRESS 1
+#define UCPU_COMMAND_COMPLETED 2
+#define UCPU_COMMAND_DISCARDED 3
+
+void ucpu_feedback_tracker_init(ucpu_feedback_tracker_t *feedback_tracker);
+/* Returns with the token of the last command sent to the port. */
+uint32_t ucpu_feedback_last_token(ucpu_connection_t *ucpu_connection, uint8_t port_id);
+/* Returns with one of the UCPU_COMMAND_* values. */
+int ucpu_feedback_status(ucpu_connection_t *ucpu_connection, uint8_t port_id, uint32_t token);
+/* Waits until the command is completed or discarded. Other notifications are passed to the
+ * dispatcher (if not NULL). Returns with the status of the command, which is PENDING or
+ * IN_PROGRESS on timeout, or -1 on error. A negative timeout_ms waits forever. */
+int ucpu_feedback_wait(ucpu_connection_t *ucpu_connection, uint8_t port_id, uint32_t token,
+	int timeout_ms, ucpu_dispatcher_t *dispatcher);
+/* Called by the library for sent commands and received notifications. */
+void ucpu_feedback_register(ucpu_connection_t *ucpu_connection, const uint8_t *packet, int packet_len);
+void ucpu_feedback_process(ucpu_connection_t *ucpu_connection, const uint8_t *packet, int message_length);
+
+/* Pipelining. The Hub can buffer a port output command behind the running one,
+ * so the next command starts without waiting for a radio round trip. When a
+ * pipeline is set (which requires a feedback tracker), the port output commands
+ * of the pipelined ports are sent with the startup_and_complete value of the
+ * pipeline, and at most depth unfinished commands are sent to each port. The
+ * rest is held back by the library, and sent when feedback messages report
+ * finished commands. A depth of 2 matches the single entry command buffer of
+ * the Hub. Commands of pipelined ports are never coalesced. */
+
+void ucpu_pipeline_init(ucpu_pipeline_t *pipeline, uint8_t depth, uint8_t startup_and_complete);
+void ucpu_pipeline_add_port(ucpu_pipeline_t *pipeline, uint8_t port_id);
+void ucpu_pipeline_remove_port(ucpu_pipeline_t *pipeline, uint8_t port_id);
+#define UCPU_PIPELINE_HAS_PORT(pipeline, port_id) \
+	(((pipeline)->ports[(port_id) >> 5] >> ((port_id) & 0x1f)) & 0x1)
+/* Returns with 0 on success, UCPU_TX_QUEUE_FULL if there is no space in the pipeline, or 1 on
+ * error (also when the connection has no feedback tracker). */
+int ucpu_pipeline_push(ucpu_connection_t *ucpu_connection, hub_port_output_command_t *port_output_command,
+	uint16_t message_len);
+/* Called by the library after feedback messages are processed. */
+int ucpu_pipeline_refill(ucpu_connection_t *ucpu_connection);
+
+/* Port registry. When a registry is set, it is updated by ucpu_att_receive and
+ * ucpu_att_receive_batch from the HUB_ATTACHED_IO messages. The Hub sends these
+ * messages for all attached devices after the connection is established. */
+
+/* Returns with NULL for unknown io types. */
+const ucpu_io_type_t *ucpu_get_io_type(uint16_t io_type_id);
+void ucpu_port_registry_init(ucpu_port_registry_t *port_registry);
+/* Returns with NULL if no device is attached to the port. */
+const ucpu_port_info_t *ucpu_port_lookup(ucpu_connection_t *ucpu_connection, uint8_t port_id);
+/* Called by the library for received notifications. */
+void ucpu_port_registry_update(ucpu_connection_t *ucpu_connection, const uint8_t *packet, int message_length);
+
+/* Device information. The description of the device attached to a port is requested
+ * with port information and port mode information requests. All requests are sent
+ * back-to-back, and the replies are collected by ucpu_device_query_process. Since
+ * the description depends only on the io type and revisions of the device, it is
+ * also stored in an optional cache file, so the queries can be skipped next time.
+ * The port registry must be set, and only one query can be active on a connection. */
+
+/* The cache is disabled by default, and can be disabled again by passing NULL as path. */
+void ucpu_device_info_cache_set_path(const char *path);
+/* Returns with 0 if the device is found in the cache. */
+int ucpu_device_info_cache_lookup(ucpu_device_info_t *device_info);
+void ucpu_device_info_cache_store(const ucpu_device_info_t *device_info);
+
+/* Returns with one of the UCPU_DISCOVERY_* values. */
+int ucpu_device_query_start(ucpu_connection_t *ucpu_connection, ucpu_device_query_t *device_query,
+	uint8_t port_id, ucpu_device_info_t *device_info);
+int ucpu_device_query_process(ucpu_connection_t *ucpu_connection, ucpu_device_query_t *device_query,
+	const uint8_t *packet, int message_length);
+/* Blocking version of the functions above. Returns with 0 on success. A negative
+ * timeout_ms waits forever. Other notifications received while waiting are passed
+ * to the dispatcher when it is not NULL. */
+int ucpu_get_device_info(ucpu_connection_t *ucpu_connection, uint8_t port_id,
+	ucpu_device_info_t *device_info, int timeout_ms, ucpu_dispatcher_t *dispatcher);
+
+/* Value decoders. A decoder is initialized once when the notifications of a mode
+ * are enabled, and converts all datasets of a port value message in one pass. */
+
+#define UCPU_VALUE_UNIT_RAW 0
+#define UCPU_VALUE_UNIT_PCT 1
+#define UCPU_VALUE_UNIT_SI 2
+
+/* Initializes a decoder without scaling. Returns with 0 on success. */
+int ucpu_value_decoder_init(ucpu_value_decoder_t *value_decoder, uint8_t dataset_type, uint8_t dataset_count);
+/* Initializes a decoder from the value format of a mode (see ucpu_get_device_info), and
+ * maps the raw range to the percentage or SI range depending on unit. */
+int ucpu_value_decoder_init_mode(ucpu_value_decoder_t *value_decoder, const ucpu_mode_info_t *mode_info, int unit);
+/* Decodes a HUB_PORT_VALUE_SINGLE message. Returns with the number of datasets, or -1 on error. */
+int ucpu_decode_port_value(const ucpu_value_decoder_t *value_decoder,
+	const uint8_t *packet, int message_length, int32_t *values);
+/* Same as ucpu_decode_port_value, except the values are scaled. */
+int ucpu_decode_port_value_scaled(const ucpu_value_decoder_t *value_decoder,
+	const uint8_t *packet, int message_length, float *values);
+
+/* Subscriptions. When a subscription manager is set, multiple consumers can subscribe
+ * to the same port. Port input format setup messages are only sent when the effective
+ * configuration of a port changes: the smallest delta interval of the consumers is
+ * used, and the notifications are disabled when the last consumer unsubscribes. */
+
+#define UCPU_SUBSCRIPTION_CONFLICT 2
+
+void ucpu_subscription_manager_init(ucpu_subscription_manager_t *subscription_manager);
+/* Returns with 0 on success, UCPU_SUBSCRIPTION_CONFLICT if another mode of
+ * the port is subscribed, or 1 on error. */
+int ucpu_subscribe(ucpu_connection_t *ucpu_connection, uint8_t port_id, uint8_t mode, uint32_t delta_interval);
+/* Must be called with the same arguments as ucpu_subscribe. */
+int ucpu_unsubscribe(ucpu_connection_t *ucpu_connection, uint8_t port_id, uint8_t mode, uint32_t delta_interval);
+
+/* Recorder. When a recorder is set, all sent and received packets of the connection
+ * are appended to a binary file. The records are collected in a buffer, which is
+ * written to the file when it is full, or when ucpu_recorder_flush is called. */
+
+#define UCPU_RECORD_RECEIVED 0
+#define UCPU_RECORD_SENT 1
+
+#define UCPU_RECORD_MAX_LENGTH 256
+
+/* Followed by the packet data. The size of each record is a multiple of 8. */
+typedef struct {
+	/* CLOCK_MONOTONIC time (see ucpu_get_time_ns). */
+	uint64_t timestamp_ns;
+	uint16_t connection_id;
+	uint16_t length;
+	uint8_t direction;
+	uint8_t reserved[3];
+} ucpu_record_t;
+
+typedef struct {
+	const uint8_t *data;
+	size_t size;
+	size_t offset;
+} ucpu_record_reader_t;
+
+/* Appends the records to the file if it exists. Returns with 0 on success. */
+int ucpu_recorder_open(ucpu_recorder_t *recorder, const char *path);
+int ucpu_recorder_flush(ucpu_recorder_t *recorder);
+int ucpu_recorder_close(ucpu_recorder_t *recorder);
+/* Called by the library for sent and received packets. */
+void ucpu_recorder_write(ucpu_recorder_t *recorder, uint16_t connection_id, uint8_t direction,
+	uint64_t timestamp_ns, const uint8_t *data, int length);
+
+/* The file is memory mapped, and read sequentially. Returns with 0 on success. */
+int ucpu_record_reader_open(ucpu_record_reader_t *record_reader, const char *path);
+/* Returns with NULL at the end of the file. The packet data follows the record. */
+const ucpu_record_t *ucpu_record_reader_next(ucpu_record_reader_t *record_reader);
+void ucpu_record_reader_close(ucpu_record_reader_t *record_reader);
+
+/* Latest value cache (see value_cache.h). Called by the library for received notifications. */
+void ucpu_value_cache_update(ucpu_connection_t *ucpu_connection, const uint8_t *packet, int message_length,
+	uint64_t timestamp_ns);
+
 int ucpu_port_information_request(ucpu_connection_t *ucpu_connection, uint8_t port_id, uint8_t information_type);
+int ucpu_port_mode_information_request(ucpu_connection_t *ucpu_connection, uint8_t port_id,
+	uint8_t mode, uint8_t mode_information_type);
 int ucpu_port_input_format_setup(ucpu_connection_t *ucpu_connection, uint8_t port_id, uint8_t mode,
 	uint32_t delta_interval, uint8_t notification_enabled);
+/* Sub commands without arguments (e.g. HUB_COMBINED_LOCK). */
+int ucpu_port_input_format_setup_combined(ucpu_connection_t *ucpu_connection, uint8_t port_id, uint8_t sub_command);
+int ucpu_port_set_mode_combination(ucpu_connection_t *ucpu_connection, uint8_t port_id,
+	uint8_t combination_index, const ucpu_combined_format_t *format);
+/* Sends the whole setup sequence: locks the port, enables the notifications of
+ * each mode, sets the combination, and unlocks the port with multi update enabled. */
+int ucpu_port_subscribe_combined(ucpu_connection_t *ucpu_connection, uint8_t port_id,
+	uint8_t combination_index, const ucpu_combined_format_t *format, uint32_t delta_interval);
 int ucpu_virtual_port_connect(ucpu_connection_t *ucpu_connection, uint8_t port_id_a, uint8_t port_id_b);
 int ucpu_virtual_port_disconnect(ucpu_connection_t *ucpu_connection, uint8_t port_id);
 
@@ -83,4 +989,27 @@ int ucpu_motor_start_speed(ucpu_connection_t *ucpu_connection, uint8_t port_id,
 int ucpu_motor_goto_absolute_position(ucpu_connection_t *ucpu_connection, uint8_t port_id,
 	int32_t absolute_pos, int8_t speed, int8_t max_power, int8_t end_state, uint8_t use_profile);
 
+/* The following commands are executed by the Hub, and report completion after the
+ * time has elapsed or the motor has reached its target. The _dual variants control
+ * both motors of a virtual port. */
+int ucpu_motor_set_acc_time(ucpu_connection_t *ucpu_connection, uint8_t port_id,
+	uint16_t time_ms, int8_t profile_number);
+int ucpu_motor_set_dec_time(ucpu_connection_t *ucpu_connection, uint8_t port_id,
+	uint16_t time_ms, int8_t profile_number);
+int ucpu_motor_start_speed_dual(ucpu_connection_t *ucpu_connection, uint8_t port_id,
+	int8_t speed_1, int8_t speed_2, int8_t max_power, uint8_t use_profile);
+int ucpu_motor_start_speed_for_time(ucpu_connection_t *ucpu_connection, uint8_t port_id,
+	uint16_t time_ms, int8_t speed, int8_t max_power, int8_t end_state, uint8_t use_profile);
+int ucpu_motor_start_speed_for_time_dual(ucpu_connection_t *ucpu_connection, uint8_t port_id,
+	uint16_t time_ms, int8_t speed_1, int8_t speed_2, int8_t max_power, int8_t end_state, uint8_t use_profile);
+int ucpu_motor_start_speed_for_degrees(ucpu_connection_t *ucpu_connection, uint8_t port_id,
+	int32_t degrees, int8_t speed, int8_t max_power, int8_t end_state, uint8_t use_profile);
+int ucpu_motor_start_speed_for_degrees_dual(ucpu_connection_t *ucpu_connection, uint8_t port_id,
+	int32_t degrees, int8_t speed_1, int8_t speed_2, int8_t max_power, int8_t end_state, uint8_t use_profile);
+int ucpu_motor_goto_absolute_position_dual(ucpu_connection_t *ucpu_connection, uint8_t port_id,
+	int32_t absolute_pos_1, int32_t absolute_pos_2, int8_t speed, int8_t max_power, int8_t end_state, uint8_t use_profile);
+int ucpu_motor_preset_encoder(ucpu_connection_t *ucpu_connection, uint8_t port_id, int32_t position);
+int ucpu_motor_preset_encoder_dual(ucpu_connection_t *ucpu_connection, uint8_t port_id,
+	int32_t position_1, int32_t position_2);
+
 #endif /* GLOBALS_H_ */
@@ -0,0 +1,158 @@
+/*
+ *    uc-powered-up (micro/universal c implementation of powered up, you see powered up, ...)
+ *
+ *    Copyright Zoltan Herczeg (hzmester@freemail.hu). All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright notice, this list of
+ *      conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *      of conditions and the following disclaimer in the documentation and/or other materials
+ *      provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER(S) AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER(S) OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Persistent cache of the characteristic handles of Hubs. */
+
+#include "globals.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+
+/* Each line of the cache file contains an address followed by the handle
+ * of the LEGO Hub Characteristic and the handle of its Client Characteristic
+ * Configuration Descriptor (CCCD) in hexadecimal form. For example:
+ *     90:84:2B:01:02:03 000e 000f
+ * The handles only depend on the firmware of the Hub, so they rarely change. */
+
+static char ucpu_handle_cache_path[PATH_MAX];
+
+void ucpu_handle_cache_set_path(const char *path)
+{
+	if (path == NULL || strlen(path) >= sizeof(ucpu_handle_cache_path) - 4) {
+		ucpu_handle_cache_path[0] = '\0';
+		return;
+	}
+
+	strcpy(ucpu_handle_cache_path, path);
+}
+
+static int ucpu_handle_cache_parse(const char *line, uint8_t *address, uint8_t *handle, uint8_t *client_config_handle)
+{
+	unsigned int bytes[6], handle_value, client_config_handle_value;
+	int i;
+
+	if (sscanf(line, "%2x:%2x:%2x:%2x:%2x:%2x %4x %4x", bytes + 5, bytes + 4, bytes + 3,
+			bytes + 2, bytes + 1, bytes, &handle_value, &client_config_handle_value) != 8) {
+		return 1;
+	}
+
+	for (i = 0; i < 6; i++) {
+		address[i] = (uint8_t)bytes[i];
+	}
+
+	handle[0] = (uint8_t)handle_value;
+	handle[1] = (uint8_t)(handle_value >> 8);
+	client_config_handle[0] = (uint8_t)client_config_handle_value;
+	client_config_handle[1] = (uint8_t)(client_config_handle_value >> 8);
+	return 0;
+}
+
+int ucpu_handle_cache_lookup(const ucpu_hub_address_t *hub, uint8_t *handle, uint8_t *client_config_handle)
+{
+	FILE *file;
+	char line[64];
+	uint8_t address[6], line_handle[2], line_client_config_handle[2];
+	int ret = 1;
+
+	if (ucpu_handle_cache_path[0] == '\0') {
+		return 1;
+	}
+
+	file = fopen(ucpu_handle_cache_path, "r");
+	if (file == NULL) {
+		return 1;
+	}
+
+	while (fgets(line, sizeof(line), file) != NULL) {
+		/* The handles of the caller are only changed when the address matches. */
+		if (ucpu_handle_cache_parse(line, address, line_handle, line_client_config_handle) == 0
+				&& memcmp(address, hub->address, 6) == 0) {
+			memcpy(handle, line_handle, 2);
+			memcpy(client_config_handle, line_client_config_handle, 2);
+			ret = 0;
+			break;
+		}
+	}
+
+	fclose(file);
+	return ret;
+}
+
+/* Rewrites the cache file without the entry of the hub. When handle
+ * is not NULL, a new entry is appended to the end of the file. */
+static void ucpu_handle_cache_update(const ucpu_hub_address_t *hub, const uint8_t *handle, const uint8_t *client_config_handle)
+{
+	FILE *file, *new_file;
+	char line[64];
+	char new_path[PATH_MAX + 4];
+	uint8_t address[6], old_handle[2], old_client_config_handle[2];
+	const uint8_t *src = hub->address;
+
+	if (ucpu_handle_cache_path[0] == '\0') {
+		return;
+	}
+
+	/* The file is replaced atomically, so concurrent readers never see partial data. */
+	snprintf(new_path, sizeof(new_path), "%s.new", ucpu_handle_cache_path);
+
+	new_file = fopen(new_path, "w");
+	if (new_file == NULL) {
+		return;
+	}
+
+	file = fopen(ucpu_handle_cache_path, "r");
+	if (file != NULL) {
+		while (fgets(line, sizeof(line), file) != NULL) {
+			if (ucpu_handle_cache_parse(line, address, old_handle, old_client_config_handle) == 0
+					&& memcmp(address, hub->address, 6) != 0) {
+				fputs(line, new_file);
+			}
+		}
+		fclose(file);
+	}
+
+	if (handle != NULL) {
+		fprintf(new_file, "%02X:%02X:%02X:%02X:%02X:%02X %04x %04x\n",
+			src[5], src[4], src[3], src[2], src[1], src[0],
+			(unsigned int)handle[0] | ((unsigned int)handle[1] << 8),
+			(unsigned int)client_config_handle[0] | ((unsigned int)client_config_handle[1] << 8));
+	}
+
+	if (fclose(new_file) != 0 || rename(new_path, ucpu_handle_cache_path) != 0) {
+		remove(new_path);
+	}
+}
+
+void ucpu_handle_cache_store(const ucpu_hub_address_t *hub, const uint8_t *handle, const uint8_t *client_config_handle)
+{
+	ucpu_handle_cache_update(hub, handle, client_config_handle);
+}
+
+void ucpu_handle_cache_invalidate(const ucpu_hub_address_t *hub)
+{
+	ucpu_handle_cache_update(hub, NULL, NULL);
+}
@@ -0,0 +1,557 @@
+/*
+ *    uc-powered-up (micro/universal c implementation of powered up, you see powered up, ...)
+ *
+ *    Copyright Zoltan Herczeg (hzmester@freemail.hu). All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright notice, this list of
+ *      conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *      of conditions and the following disclaimer in the documentation and/or other materials
+ *      provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER(S) AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER(S) OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* I/O thread with lock-free queues for multi-threaded applications. */
+
+#include "io_thread.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#define UCPU_BIT_IS_SET(bits, index) ((bits)[(index) >> 5] & (1u << ((index) & 0x1f)))
+#define UCPU_BIT_SET(bits, index) ((bits)[(index) >> 5] |= (1u << ((index) & 0x1f)))
+
+/* Bounded multi-producer queue. The sequence of a slot is equal to its position when
+ * the slot is free, and position + 1 when it contains a command. Producers reserve
+ * a position by incrementing the tail, and publish the command by updating the
+ * sequence, so a slow producer never blocks the other producers. */
+
+static void ucpu_command_queue_init(ucpu_command_queue_t *command_queue)
+{
+	uint32_t i;
+
+	for (i = 0; i < UCPU_COMMAND_QUEUE_SIZE; i++) {
+		atomic_init(&command_queue->commands[i].sequence, i);
+	}
+
+	atomic_init(&command_queue->tail, 0);
+	command_queue->head = 0;
+}
+
+static int ucpu_command_queue_push(ucpu_command_queue_t *command_queue, uint8_t connection_index,
+	const void *packet, uint16_t packet_len)
+{
+	ucpu_queued_command_t *command;
+	uint32_t position, sequence;
+
+	position = atomic_load_explicit(&command_queue->tail, memory_order_relaxed);
+
+	while (1) {
+		command = command_queue->commands + (position & (UCPU_COMMAND_QUEUE_SIZE - 1));
+		sequence = atomic_load_explicit(&command->sequence, memory_order_acquire);
+
+		if (sequence == position) {
+			if (atomic_compare_exchange_weak_explicit(&command_queue->tail, &position, position + 1,
+					memory_order_relaxed, memory_order_relaxed)) {
+				break;
+			}
+			/* The position is reloaded by the failed exchange. */
+			continue;
+		}
+
+		if ((int32_t)(sequence - position) < 0) {
+			/* The slot still contains the command pushed one round earlier. */
+			return UCPU_TX_QUEUE_FULL;
+		}
+
+		position = atomic_load_explicit(&command_queue->tail, memory_order_relaxed);
+	}
+
+	command->connection_index = connection_index;
+	command->length = (uint8_t)packet_len;
+	memcpy(command->data, packet, packet_len);
+
+	atomic_store_explicit(&command->sequence, position + 1, memory_order_release);
+	return 0;
+}
+
+/* Returns with NULL when the queue is empty. The command must be released by
+ * ucpu_command_queue_release before the next call. Only the I/O thread pops. */
+static ucpu_queued_command_t *ucpu_command_queue_peek(ucpu_command_queue_t *command_queue)
+{
+	ucpu_queued_command_t *command = command_queue->commands + (command_queue->head & (UCPU_COMMAND_QUEUE_SIZE - 1));
+
+	if (atomic_load_explicit(&command->sequence, memory_order_acquire) != command_queue->head + 1) {
+		return NULL;
+	}
+	return command;
+}
+
+static void ucpu_command_queue_release(ucpu_command_queue_t *command_queue, ucpu_queued_command_t *command)
+{
+	atomic_store_explicit(&command->sequence, command_queue->head + UCPU_COMMAND_QUEUE_SIZE, memory_order_release);
+	command_queue->head++;
+}
+
+int ucpu_notification_ring_init(ucpu_notification_ring_t *ring)
+{
+	atomic_init(&ring->tail, 0);
+	atomic_init(&ring->dropped, 0);
+	atomic_init(&ring->head, 0);
+	memset(ring->message_types, 0, sizeof(ring->message_types));
+	memset(ring->ports, 0, sizeof(ring->ports));
+
+	ring->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	return ring->event_fd < 0;
+}
+
+void ucpu_notification_ring_free(ucpu_notification_ring_t *ring)
+{
+	if (ring->event_fd >= 0) {
+		close(ring->event_fd);
+		ring->event_fd = -1;
+	}
+}
+
+void ucpu_notification_ring_subscribe(ucpu_notification_ring_t *ring, uint8_t message_type)
+{
+	UCPU_BIT_SET(ring->message_types, message_type);
+}
+
+void ucpu_notification_ring_subscribe_port(ucpu_notification_ring_t *ring, uint8_t port_id)
+{
+	UCPU_BIT_SET(ring->ports, port_id);
+}
+
+/* Called by the I/O thread only. Returns with 1 when the notification is stored. */
+static int ucpu_notification_ring_push(ucpu_notification_ring_t *ring, uint8_t connection_index,
+	const ucpu_rx_packet_t *packet)
+{
+	uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	ucpu_notification_t *notification;
+
+	/* The I/O thread never waits for the consumers. */
+	if (tail - atomic_load_explicit(&ring->head, memory_order_acquire) >= UCPU_NOTIFICATION_RING_SIZE) {
+		atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+		return 0;
+	}
+
+	notification = ring->notifications + (tail & (UCPU_NOTIFICATION_RING_SIZE - 1));
+	notification->timestamp_ns = packet->timestamp_ns;
+	notification->connection_index = connection_index;
+	notification->message_type = ((const hub_common_message_header_t*)packet->data)->message_type;
+	notification->length = (uint8_t)packet->length;
+	memcpy(notification->data, packet->data, (size_t)packet->length);
+
+	atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+	return 1;
+}
+
+int ucpu_notification_ring_pop(ucpu_notification_ring_t *ring, ucpu_notification_t *notification)
+{
+	uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+	if (head == atomic_load_explicit(&ring->tail, memory_order_acquire)) {
+		return 0;
+	}
+
+	memcpy(notification, ring->notifications + (head & (UCPU_NOTIFICATION_RING_SIZE - 1)), sizeof(ucpu_notification_t));
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+	return 1;
+}
+
+int ucpu_notification_ring_wait(ucpu_notification_ring_t *ring, int timeout_ms)
+{
+	struct pollfd poll_fd;
+	uint64_t value;
+	int ret;
+
+	/* The counter of the eventfd is not reset when the ring is consumed
+	 * without waiting, so the ring itself is checked first. */
+	while (atomic_load_explicit(&ring->head, memory_order_relaxed)
+			== atomic_load_explicit(&ring->tail, memory_order_acquire)) {
+		poll_fd.fd = ring->event_fd;
+		poll_fd.events = POLLIN;
+		poll_fd.revents = 0;
+
+		do {
+			ret = poll(&poll_fd, 1, timeout_ms);
+		} while (ret < 0 && errno == EINTR);
+
+		if (ret < 0) {
+			return -1;
+		}
+
+		if (ret == 0) {
+			return 0;
+		}
+
+		if (read(ring->event_fd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+			return -1;
+		}
+	}
+	return 1;
+}
+
+static int ucpu_notification_ring_selects(const ucpu_notification_ring_t *ring, const uint8_t *packet, int length)
+{
+	uint8_t message_type = ((const hub_common_message_header_t*)packet)->message_type;
+
+	if ((message_type == HUB_PORT_VALUE_SINGLE || message_type == HUB_PORT_VALUE_COMBINED)
+			&& length > sizeof(hub_port_value_single_t)) {
+		return UCPU_BIT_IS_SET(ring->ports, ((const hub_port_value_single_t*)packet)->port_id) != 0;
+	}
+	return UCPU_BIT_IS_SET(ring->message_types, message_type) != 0;
+}
+
+int ucpu_io_thread_init(ucpu_io_thread_t *io_thread, ucpu_connection_t *connections, int connection_count)
+{
+	int i;
+
+	if (connection_count > UCPU_IO_THREAD_MAX_CONNECTIONS) {
+		return 1;
+	}
+
+	io_thread->connections = connections;
+	io_thread->connection_count = connection_count;
+	io_thread->consumer_count = 0;
+	atomic_init(&io_thread->running, 0);
+	atomic_init(&io_thread->wakeup_pending, 0);
+	atomic_init(&io_thread->sent_count, 0);
+	atomic_init(&io_thread->received_count, 0);
+	ucpu_rx_ring_init(&io_thread->rx_ring);
+	ucpu_command_queue_init(&io_thread->command_queue);
+
+	io_thread->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (io_thread->wakeup_fd < 0) {
+		return 1;
+	}
+
+	if (ucpu_event_loop_init(&io_thread->event_loop) != 0) {
+		close(io_thread->wakeup_fd);
+		io_thread->wakeup_fd = -1;
+		return 1;
+	}
+
+	if (ucpu_event_loop_add_fd(&io_thread->event_loop, io_thread->wakeup_fd, UCPU_EVENT_READABLE, NULL) != 0) {
+		ucpu_io_thread_free(io_thread);
+		return 1;
+	}
+
+	for (i = 0; i < connection_count; i++) {
+		if (ucpu_event_loop_add(&io_thread->event_loop, connections + i) != 0) {
+			ucpu_io_thread_free(io_thread);
+			return 1;
+		}
+
+		if (connections[i].tx_queue == NULL) {
+			ucpu_tx_queue_init(io_thread->tx_queues + i, UCPU_TX_QUEUE_SIZE, UCPU_TX_QUEUE_SIZE / 2);
+			ucpu_set_tx_queue(connections + i, io_thread->tx_queues + i);
+		}
+	}
+	return 0;
+}
+
+int ucpu_io_thread_add_consumer(ucpu_io_thread_t *io_thread, ucpu_notification_ring_t *ring)
+{
+	if (io_thread->consumer_count >= UCPU_IO_THREAD_MAX_CONSUMERS) {
+		return 1;
+	}
+
+	io_thread->consumers[io_thread->consumer_count++] = ring;
+	return 0;
+}
+
+static void ucpu_io_thread_send_commands(ucpu_io_thread_t *io_thread)
+{
+	ucpu_queued_command_t *command;
+	ucpu_connection_t *ucpu_connection;
+	uint64_t count = 0;
+	int i, ret;
+
+	while ((command = ucpu_command_queue_peek(&io_thread->command_queue)) != NULL) {
+		ucpu_connection = io_thread->connections + command->connection_index;
+
+		/* Commands of closed connections are dropped. */
+		if (ucpu_connection->sock >= 0) {
+			ret = ucpu_send_command(ucpu_connection, (hub_common_message_header_t*)command->data, command->length);
+
+			/* The command is retried after the writable event (or the feedback
+			 * which frees the pipeline) wakes the thread. The commands behind it
+			 * wait as well, so their order is preserved. */
+			if (ret == UCPU_TX_QUEUE_FULL) {
+				break;
+			}
+
+			if (ret == 0) {
+				count++;
+			}
+		}
+
+		ucpu_command_queue_release(&io_thread->command_queue, command);
+	}
+
+	/* The new commands are sent without waiting for the writable event. */
+	for (i = 0; i < io_thread->connection_count; i++) {
+		ucpu_connection = io_thread->connections + i;
+
+		if (ucpu_connection->sock >= 0 && ucpu_connection->tx_queue != NULL
+				&& UCPU_TX_QUEUE_DEPTH(ucpu_connection->tx_queue) > 0) {
+			ucpu_tx_flush(ucpu_connection);
+		}
+	}
+
+	atomic_fetch_add_explicit(&io_thread->sent_count, count, memory_order_relaxed);
+}
+
+static void ucpu_io_thread_receive(ucpu_io_thread_t *io_thread, ucpu_connection_t *ucpu_connection,
+	uint32_t *signaled)
+{
+	ucpu_rx_ring_t *rx_ring = &io_thread->rx_ring;
+	ucpu_rx_packet_t *packet;
+	uint8_t connection_index = (uint8_t)(ucpu_connection - io_thread->connections);
+	int i, j, count;
+
+	count = ucpu_att_receive_batch(ucpu_connection, rx_ring);
+	if (count < 0) {
+		ucpu_disconnect(ucpu_connection);
+	}
+
+	count = UCPU_RX_RING_COUNT(rx_ring);
+
+	for (i = 0; i < count; i++) {
+		packet = UCPU_RX_RING_PEEK(rx_ring, i);
+
+		if (packet->length > UCPU_IO_MESSAGE_LENGTH
+				|| !ucpu_is_notification_packet(ucpu_connection, packet->data, packet->length)) {
+			continue;
+		}
+
+		for (j = 0; j < io_thread->consumer_count; j++) {
+			if (ucpu_notification_ring_selects(io_thread->consumers[j], packet->data, packet->length)
+					&& ucpu_notification_ring_push(io_thread->consumers[j], connection_index, packet)) {
+				*signaled |= 1u << j;
+			}
+		}
+	}
+
+	UCPU_RX_RING_CONSUME(rx_ring, count);
+	atomic_fetch_add_explicit(&io_thread->received_count, (uint64_t)count, memory_order_relaxed);
+}
+
+static void *ucpu_io_thread_run(void *arg)
+{
+	ucpu_io_thread_t *io_thread = (ucpu_io_thread_t*)arg;
+	ucpu_event_t events[UCPU_IO_THREAD_MAX_CONNECTIONS + 1];
+	uint64_t value = 1;
+	uint32_t signaled;
+	int i, count;
+
+	while (atomic_load_explicit(&io_thread->running, memory_order_acquire)) {
+		count = ucpu_event_loop_wait(&io_thread->event_loop, events, UCPU_IO_THREAD_MAX_CONNECTIONS + 1, -1);
+		if (count < 0) {
+			break;
+		}
+
+		signaled = 0;
+
+		for (i = 0; i < count; i++) {
+			if (events[i].connection == NULL) {
+				/* The wakeup is cleared before the queue is drained, so a
+				 * command pushed during the draining signals it again. */
+				if (read(io_thread->wakeup_fd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+					continue;
+				}
+				atomic_store(&io_thread->wakeup_pending, 0);
+				continue;
+			}
+
+			if (events[i].events & (UCPU_EVENT_READABLE | UCPU_EVENT_ERROR)) {
+				ucpu_io_thread_receive(io_thread, events[i].connection, &signaled);
+			}
+		}
+
+		ucpu_io_thread_send_commands(io_thread);
+
+		/* Consumers are signaled once per batch. */
+		value = 1;
+		for (i = 0; signaled != 0; i++, signaled >>= 1) {
+			if ((signaled & 0x1) && write(io_thread->consumers[i]->event_fd, &value, sizeof(value)) < 0) {
+				break;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static void ucpu_io_thread_wakeup(ucpu_io_thread_t *io_thread)
+{
+	uint64_t value = 1;
+
+	/* Only the first producer after a wakeup calls the kernel. */
+	if (atomic_exchange(&io_thread->wakeup_pending, 1) == 0) {
+		if (write(io_thread->wakeup_fd, &value, sizeof(value)) < 0) {
+			atomic_store(&io_thread->wakeup_pending, 0);
+		}
+	}
+}
+
+int ucpu_io_thread_start(ucpu_io_thread_t *io_thread)
+{
+	atomic_store(&io_thread->running, 1);
+
+	if (pthread_create(&io_thread->thread, NULL, ucpu_io_thread_run, io_thread) != 0) {
+		atomic_store(&io_thread->running, 0);
+		return 1;
+	}
+	return 0;
+}
+
+void ucpu_io_thread_stop(ucpu_io_thread_t *io_thread)
+{
+	uint64_t value = 1;
+
+	if (!atomic_load(&io_thread->running)) {
+		return;
+	}
+
+	atomic_store(&io_thread->running, 0);
+
+	if (write(io_thread->wakeup_fd, &value, sizeof(value)) == sizeof(value)) {
+		pthread_join(io_thread->thread, NULL);
+	}
+}
+
+void ucpu_io_thread_free(ucpu_io_thread_t *io_thread)
+{
+	int i;
+
+	for (i = 0; i < io_thread->connection_count; i++) {
+		if (io_thread->connections[i].tx_queue == io_thread->tx_queues + i) {
+			ucpu_set_tx_queue(io_thread->connections + i, NULL);
+		}
+
+		if (io_thread->connections[i].event_loop == &io_thread->event_loop) {
+			ucpu_event_loop_remove(&io_thread->event_loop, io_thread->connections + i);
+		}
+	}
+
+	ucpu_event_loop_free(&io_thread->event_loop);
+
+	if (io_thread->wakeup_fd >= 0) {
+		close(io_thread->wakeup_fd);
+		io_thread->wakeup_fd = -1;
+	}
+}
+
+int ucpu_io_thread_send(ucpu_io_thread_t *io_thread, int connection_index, const void *packet, uint16_t packet_len)
+{
+	if (connection_index < 0 || connection_index >= io_thread->connection_count
+			|| packet_len > UCPU_IO_MESSAGE_LENGTH) {
+		return 1;
+	}
+
+	if (ucpu_command_queue_push(&io_thread->command_queue, (uint8_t)connection_index, packet, packet_len) != 0) {
+		return UCPU_TX_QUEUE_FULL;
+	}
+
+	ucpu_io_thread_wakeup(io_thread);
+	return 0;
+}
+
+/* Proxy transport. The connection_id of a proxy is the index of its connection. */
+
+static int ucpu_proxy_open(ucpu_connection_t *ucpu_connection, const void *parameters)
+{
+	ucpu_connection->transport_data = (void*)parameters;
+	ucpu_connection->sock = -1;
+	return 0;
+}
+
+static int ucpu_proxy_send(ucpu_connection_t *ucpu_connection, const void *packet, uint16_t packet_len)
+{
+	ucpu_io_thread_t *io_thread = (ucpu_io_thread_t*)ucpu_connection->transport_data;
+	int ret;
+
+	while (1) {
+		ret = ucpu_io_thread_send(io_thread, ucpu_connection->connection_id, packet, packet_len);
+
+		if (ret != UCPU_TX_QUEUE_FULL) {
+			return ret;
+		}
+
+		/* The queue is drained by the I/O thread. */
+		if (!atomic_load_explicit(&io_thread->running, memory_order_relaxed)) {
+			return 1;
+		}
+		sched_yield();
+	}
+}
+
+static int ucpu_proxy_send_batch(ucpu_connection_t *ucpu_connection, const struct iovec *packets, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (ucpu_proxy_send(ucpu_connection, packets[i].iov_base, (uint16_t)packets[i].iov_len) != 0) {
+			return (i > 0) ? i : -1;
+		}
+	}
+	return count;
+}
+
+static int ucpu_proxy_receive(ucpu_connection_t *ucpu_connection, uint8_t *buffer, int buffer_size)
+{
+	return 0;
+}
+
+static int ucpu_proxy_receive_batch(ucpu_connection_t *ucpu_connection, ucpu_rx_packet_t **packets, int count)
+{
+	return 0;
+}
+
+static void ucpu_proxy_close(ucpu_connection_t *ucpu_connection)
+{
+	ucpu_connection->transport_data = NULL;
+}
+
+static const ucpu_transport_t ucpu_proxy_transport = {
+	ucpu_proxy_open,
+	ucpu_proxy_send,
+	ucpu_proxy_send_batch,
+	ucpu_proxy_receive,
+	ucpu_proxy_receive_batch,
+	ucpu_proxy_close,
+};
+
+int ucpu_io_thread_open_proxy(ucpu_io_thread_t *io_thread, ucpu_connection_t *proxy, int connection_index)
+{
+	if (connection_index < 0 || connection_index >= io_thread->connection_count) {
+		return 1;
+	}
+
+	ucpu_transport_open(proxy, &ucpu_proxy_transport, io_thread);
+	proxy->connection_id = (uint16_t)connection_index;
+	proxy->address = io_thread->connections[connection_index].address;
+	proxy->handle[0] = io_thread->connections[connection_index].handle[0];
+	proxy->handle[1] = io_thread->connections[connection_index].handle[1];
+	return 0;
+}
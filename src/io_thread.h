@@ -0,0 +1,152 @@
+/*
+ *    uc-powered-up (micro/universal c implementation of powered up, you see powered up, ...)
+ *
+ *    Copyright Zoltan Herczeg (hzmester@freemail.hu). All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright notice, this list of
+ *      conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *      of conditions and the following disclaimer in the documentation and/or other materials
+ *      provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER(S) AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER(S) OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef IO_THREAD_H_
+#define IO_THREAD_H_
+
+#include "globals.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+/* I/O thread. The library functions are not thread safe, so a multi-threaded
+ * application runs a single I/O thread, which owns the connections. Other
+ * threads send commands through proxy connections: the command functions
+ * (e.g. ucpu_motor_start_speed) work with proxies, but the encoded messages
+ * are appended to a lock-free multi-producer queue instead of being sent. The
+ * I/O thread is woken by an eventfd, sends the queued commands, receives the
+ * notifications, and copies them into single-producer single-consumer rings.
+ * Each consumer thread has its own ring, and selects the messages it needs. */
+
+/* Must be a power of 2. */
+#define UCPU_COMMAND_QUEUE_SIZE 256
+/* Must be a power of 2. */
+#define UCPU_NOTIFICATION_RING_SIZE 1024
+#define UCPU_IO_THREAD_MAX_CONNECTIONS 8
+#define UCPU_IO_THREAD_MAX_CONSUMERS 8
+/* Maximum length of a command or notification including the ATT header. */
+#define UCPU_IO_MESSAGE_LENGTH 64
+
+typedef struct {
+	/* Slot state: see ucpu_command_queue_push. */
+	_Atomic uint32_t sequence;
+	uint8_t connection_index;
+	uint8_t length;
+	uint8_t data[UCPU_IO_MESSAGE_LENGTH];
+} ucpu_queued_command_t;
+
+typedef struct {
+	/* Producers and the consumer use separate cache lines. */
+	_Alignas(64) _Atomic uint32_t tail;
+	_Alignas(64) uint32_t head;
+	ucpu_queued_command_t commands[UCPU_COMMAND_QUEUE_SIZE];
+} ucpu_command_queue_t;
+
+typedef struct {
+	/* Time of the system call which received the notification. */
+	uint64_t timestamp_ns;
+	uint8_t connection_index;
+	uint8_t message_type;
+	uint8_t length;
+	/* Complete packet, which can be passed to the ucpu_*_packet functions. */
+	uint8_t data[UCPU_IO_MESSAGE_LENGTH];
+} ucpu_notification_t;
+
+typedef struct {
+	/* Written by the I/O thread. */
+	_Alignas(64) _Atomic uint32_t tail;
+	/* Number of notifications dropped because the ring was full. */
+	_Atomic uint32_t dropped;
+	/* Written by the consumer. */
+	_Alignas(64) _Atomic uint32_t head;
+	/* Signaled after the I/O thread stored notifications into the ring. */
+	int event_fd;
+	/* Bit sets of message types and ports. */
+	uint32_t message_types[8];
+	uint32_t ports[8];
+	ucpu_notification_t notifications[UCPU_NOTIFICATION_RING_SIZE];
+} ucpu_notification_ring_t;
+
+typedef struct {
+	ucpu_event_loop_t event_loop;
+	ucpu_connection_t *connections;
+	int connection_count;
+	int consumer_count;
+	int wakeup_fd;
+	pthread_t thread;
+	_Atomic uint32_t running;
+	/* Set when the wakeup_fd is signaled, so producers can skip the system call. */
+	_Atomic uint32_t wakeup_pending;
+	/* Statistics. */
+	_Atomic uint64_t sent_count;
+	_Atomic uint64_t received_count;
+	ucpu_notification_ring_t *consumers[UCPU_IO_THREAD_MAX_CONSUMERS];
+	ucpu_rx_ring_t rx_ring;
+	/* Attached to the connections without a transmit queue. */
+	ucpu_tx_queue_t tx_queues[UCPU_IO_THREAD_MAX_CONNECTIONS];
+	ucpu_command_queue_t command_queue;
+} ucpu_io_thread_t;
+
+/* Returns with 0 on success. */
+int ucpu_notification_ring_init(ucpu_notification_ring_t *ring);
+void ucpu_notification_ring_free(ucpu_notification_ring_t *ring);
+/* Selects the messages stored into the ring. Port value messages (HUB_PORT_VALUE_SINGLE
+ * and HUB_PORT_VALUE_COMBINED) are selected by their port, other messages are
+ * selected by their message type. Must be called before the thread is started. */
+void ucpu_notification_ring_subscribe(ucpu_notification_ring_t *ring, uint8_t message_type);
+void ucpu_notification_ring_subscribe_port(ucpu_notification_ring_t *ring, uint8_t port_id);
+/* Called by the consumer thread. Returns with 1 when a notification is copied, 0 otherwise. */
+int ucpu_notification_ring_pop(ucpu_notification_ring_t *ring, ucpu_notification_t *notification);
+/* Waits until the ring is not empty. Returns with 1 when notifications are available,
+ * 0 on timeout, or -1 on error. A negative timeout_ms waits forever. */
+int ucpu_notification_ring_wait(ucpu_notification_ring_t *ring, int timeout_ms);
+
+/* The connections must be connected, and they are owned by the I/O thread after
+ * it is started. The index of a connection in the array identifies the connection.
+ * A transmit queue is attached to each connection which does not have one, so the
+ * I/O thread never blocks while sending. When the transmit queue of a connection
+ * is full, the commands stay in the command queue until it has space again.
+ * Returns with 0 on success. */
+int ucpu_io_thread_init(ucpu_io_thread_t *io_thread, ucpu_connection_t *connections, int connection_count);
+/* Must be called before the thread is started. Returns with 0 on success. */
+int ucpu_io_thread_add_consumer(ucpu_io_thread_t *io_thread, ucpu_notification_ring_t *ring);
+int ucpu_io_thread_start(ucpu_io_thread_t *io_thread);
+/* Stops the thread. The connections are not closed. */
+void ucpu_io_thread_stop(ucpu_io_thread_t *io_thread);
+void ucpu_io_thread_free(ucpu_io_thread_t *io_thread);
+
+/* Initializes a proxy for a connection. A proxy must only be used by one thread,
+ * but any number of proxies can be created for the same connection. Feedback
+ * tracking, pipelines and transmit queues are only supported by the connection
+ * itself, and proxies cannot receive. The command functions of a proxy wait
+ * while the command queue is full. Returns with 0 on success. */
+int ucpu_io_thread_open_proxy(ucpu_io_thread_t *io_thread, ucpu_connection_t *proxy, int connection_index);
+/* Queues a complete packet (the ATT header is filled by the I/O thread). Can be
+ * called from any thread. Returns with 0 on success, and UCPU_TX_QUEUE_FULL when
+ * the queue is full. */
+int ucpu_io_thread_send(ucpu_io_thread_t *io_thread, int connection_index, const void *packet, uint16_t packet_len);
+
+#endif /* IO_THREAD_H_ */
@@ -0,0 +1,215 @@
+/*
+ *    uc-powered-up (micro/universal c implementation of powered up, you see powered up, ...)
+ *
+ *    Copyright Zoltan Herczeg (hzmester@freemail.hu). All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright notice, this list of
+ *      conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *      of conditions and the following disclaimer in the documentation and/or other materials
+ *      provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER(S) AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER(S) OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Connection manager which connects to multiple Hubs in parallel. */
+
+#include "globals.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+static void ucpu_hub_failed(ucpu_hub_status_t *hub, ucpu_connection_t *ucpu_connection)
+{
+	ucpu_disconnect(ucpu_connection);
+	hub->state = UCPU_HUB_FAILED;
+}
+
+static void ucpu_hub_connected(ucpu_hub_status_t *hub, ucpu_connection_t *ucpu_connection, uint64_t elapsed_ns)
+{
+	int error = 0;
+	socklen_t error_len = sizeof(error);
+
+	/* The result of a non-blocking connect is available as a socket error. */
+	if (getsockopt(ucpu_connection->sock, SOL_SOCKET, SO_ERROR, &error, &error_len) != 0 || error != 0) {
+		ucpu_hub_failed(hub, ucpu_connection);
+		return;
+	}
+
+	hub->connected_ns = elapsed_ns;
+
+	if (ucpu_discovery_start(ucpu_connection, &hub->discovery) != UCPU_DISCOVERY_IN_PROGRESS) {
+		ucpu_hub_failed(hub, ucpu_connection);
+		return;
+	}
+	hub->state = UCPU_HUB_DISCOVERING;
+}
+
+static void ucpu_hub_discovery_response(ucpu_hub_status_t *hub, ucpu_connection_t *ucpu_connection, uint64_t elapsed_ns)
+{
+	int received_len = ucpu_att_receive(ucpu_connection);
+
+	if (received_len == 0) {
+		return;
+	}
+
+	switch (ucpu_discovery_process(ucpu_connection, &hub->discovery, received_len)) {
+	case UCPU_DISCOVERY_IN_PROGRESS:
+		return;
+	case UCPU_DISCOVERY_COMPLETED:
+		/* Notifications are enabled by the discovery. */
+		hub->ready_ns = elapsed_ns;
+		hub->state = UCPU_HUB_READY;
+		return;
+	}
+
+	ucpu_hub_failed(hub, ucpu_connection);
+}
+
+int ucpu_hub_manager_connect(ucpu_hub_manager_t *manager, ucpu_connection_t *connections,
+	int max_hubs, int scan_timeout_ms, int connect_timeout_ms)
+{
+	ucpu_hub_info_t hubs[UCPU_MAX_HUBS];
+	struct pollfd poll_fds[UCPU_MAX_HUBS];
+	uint64_t start_ns, now_ns, deadline_ns;
+	int i, hub_count, pending, ready_count, ret;
+
+	if (max_hubs > UCPU_MAX_HUBS) {
+		max_hubs = UCPU_MAX_HUBS;
+	}
+
+	start_ns = ucpu_get_time_ns();
+	manager->hub_count = 0;
+
+	/* All Hubs are collected by a single scan. */
+	hub_count = ucpu_scan_hubs(hubs, max_hubs, scan_timeout_ms);
+	if (hub_count < 0) {
+		return -1;
+	}
+
+	now_ns = ucpu_get_time_ns();
+	manager->scan_ns = now_ns - start_ns;
+	manager->hub_count = hub_count;
+
+	printf("Connecting to %d LEGO Hub(s)\n", hub_count);
+
+	/* Start all connections without waiting for their completion. */
+	for (i = 0; i < hub_count; i++) {
+		ucpu_hub_status_t *hub = manager->hubs + i;
+
+		hub->address = hubs[i].address;
+		hub->state = UCPU_HUB_CONNECTING;
+		hub->connection_index = -1;
+		hub->connected_ns = 0;
+		hub->ready_ns = 0;
+
+		ucpu_connection_init(connections + i);
+		connections[i].transport = &ucpu_l2cap_transport;
+		connections[i].address = hub->address;
+		connections[i].connection_id = (uint16_t)i;
+		connections[i].sock = ucpu_l2cap_connect(&hub->address, 1);
+		if (connections[i].sock < 0) {
+			hub->state = UCPU_HUB_FAILED;
+		}
+	}
+
+	/* Each Hub is driven by its own state machine, and every response is
+	 * processed as soon as it arrives regardless of the other Hubs.
+	 * A negative timeout means no limit. */
+	deadline_ns = (connect_timeout_ms < 0) ? UINT64_MAX : now_ns + (uint64_t)connect_timeout_ms * 1000000;
+
+	while (1) {
+		pending = 0;
+
+		for (i = 0; i < hub_count; i++) {
+			poll_fds[i].fd = -1;
+			poll_fds[i].revents = 0;
+
+			switch (manager->hubs[i].state) {
+			case UCPU_HUB_CONNECTING:
+				poll_fds[i].fd = connections[i].sock;
+				poll_fds[i].events = POLLOUT;
+				pending++;
+				break;
+			case UCPU_HUB_DISCOVERING:
+				poll_fds[i].fd = connections[i].sock;
+				poll_fds[i].events = POLLIN;
+				pending++;
+				break;
+			}
+		}
+
+		now_ns = ucpu_get_time_ns();
+		if (pending == 0 || now_ns >= deadline_ns) {
+			break;
+		}
+
+		ret = poll(poll_fds, hub_count, (connect_timeout_ms < 0) ? -1 : (int)((deadline_ns - now_ns + 999999) / 1000000));
+		if (ret < 0 && errno != EINTR) {
+			break;
+		}
+
+		if (ret <= 0) {
+			continue;
+		}
+
+		now_ns = ucpu_get_time_ns();
+
+		for (i = 0; i < hub_count; i++) {
+			ucpu_hub_status_t *hub = manager->hubs + i;
+
+			if (poll_fds[i].revents == 0) {
+				continue;
+			}
+
+			if (hub->state == UCPU_HUB_CONNECTING) {
+				ucpu_hub_connected(hub, connections + i, now_ns - start_ns);
+				continue;
+			}
+
+			if (poll_fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+				ucpu_hub_failed(hub, connections + i);
+				continue;
+			}
+
+			ucpu_hub_discovery_response(hub, connections + i, now_ns - start_ns);
+		}
+	}
+
+	/* Unfinished hubs are dropped, and ready connections are moved to the front. */
+	ready_count = 0;
+	for (i = 0; i < hub_count; i++) {
+		ucpu_hub_status_t *hub = manager->hubs + i;
+
+		if (hub->state != UCPU_HUB_READY) {
+			ucpu_hub_failed(hub, connections + i);
+			continue;
+		}
+
+		hub->connection_index = ready_count;
+		if (ready_count != i) {
+			connections[ready_count] = connections[i];
+			connections[ready_count].connection_id = (uint16_t)ready_count;
+			/* The socket is owned by the moved connection. */
+			connections[i].sock = -1;
+		}
+		ready_count++;
+	}
+
+	printf("Connection completed to %d LEGO Hub(s)\n", ready_count);
+	return ready_count;
+}
@@ -0,0 +1,146 @@
+/*
+ *    uc-powered-up (micro/universal c implementation of powered up, you see powered up, ...)
+ *
+ *    Copyright Zoltan Herczeg (hzmester@freemail.hu). All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright notice, this list of
+ *      conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *      of conditions and the following disclaimer in the documentation and/or other materials
+ *      provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER(S) AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER(S) OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Pipelining port output commands using the command buffer of the Hub. */
+
+#include "globals.h"
+
+#include <string.h>
+
+void ucpu_pipeline_init(ucpu_pipeline_t *pipeline, uint8_t depth, uint8_t startup_and_complete)
+{
+	memset(pipeline, 0, sizeof(ucpu_pipeline_t));
+
+	pipeline->depth = depth > 0 ? depth : 1;
+	/* Feedback messages are needed for refilling. */
+	pipeline->startup_and_complete = startup_and_complete | PORT_OUTPUT_COMPLETION_FEEDBACK;
+}
+
+void ucpu_pipeline_add_port(ucpu_pipeline_t *pipeline, uint8_t port_id)
+{
+	pipeline->ports[port_id >> 5] |= 1u << (port_id & 0x1f);
+}
+
+void ucpu_pipeline_remove_port(ucpu_pipeline_t *pipeline, uint8_t port_id)
+{
+	pipeline->ports[port_id >> 5] &= ~(1u << (port_id & 0x1f));
+}
+
+static uint32_t ucpu_pipeline_unfinished(ucpu_connection_t *ucpu_connection, uint8_t port_id)
+{
+	ucpu_port_feedback_t *port_feedback = ucpu_connection->feedback_tracker->ports + port_id;
+
+	return port_feedback->next_token - port_feedback->first_token;
+}
+
+int ucpu_pipeline_push(ucpu_connection_t *ucpu_connection, hub_port_output_command_t *port_output_command,
+	uint16_t message_len)
+{
+	ucpu_pipeline_t *pipeline = ucpu_connection->pipeline;
+	ucpu_tx_packet_t *packet;
+	uint8_t port_id = port_output_command->port_id;
+	uint32_t index;
+
+	/* The unfinished commands are counted by the feedback tracker. */
+	if (ucpu_connection->feedback_tracker == NULL) {
+		return 1;
+	}
+
+	port_output_command->startup_and_complete = pipeline->startup_and_complete;
+
+	/* Commands are sent immediately when no older commands are held back for the
+	 * same port, and the Hub has space for one more command on that port. */
+	if (ucpu_pipeline_unfinished(ucpu_connection, port_id) < pipeline->depth) {
+		for (index = pipeline->head; index != pipeline->tail; index++) {
+			packet = pipeline->packets + (index & (UCPU_PIPELINE_SIZE - 1));
+			if (((hub_port_output_command_t*)packet->data)->port_id == port_id) {
+				break;
+			}
+		}
+
+		if (index == pipeline->tail) {
+			return ucpu_transmit(ucpu_connection, &port_output_command->common_message_header, message_len);
+		}
+	}
+
+	if (message_len > sizeof(packet->data)) {
+		return 1;
+	}
+
+	if (pipeline->tail - pipeline->head >= UCPU_PIPELINE_SIZE) {
+		return UCPU_TX_QUEUE_FULL;
+	}
+
+	packet = pipeline->packets + (pipeline->tail & (UCPU_PIPELINE_SIZE - 1));
+	packet->length = (uint8_t)message_len;
+	memcpy(packet->data, port_output_command, message_len);
+	pipeline->tail++;
+	return 0;
+}
+
+int ucpu_pipeline_refill(ucpu_connection_t *ucpu_connection)
+{
+	ucpu_pipeline_t *pipeline = ucpu_connection->pipeline;
+	ucpu_tx_packet_t *packet, *dst;
+	uint32_t blocked_ports[8];
+	uint32_t index, new_tail;
+	uint8_t port_id;
+	int ret = 0;
+
+	if (ucpu_connection->feedback_tracker == NULL) {
+		return 1;
+	}
+
+	memset(blocked_ports, 0, sizeof(blocked_ports));
+	new_tail = pipeline->head;
+
+	/* The held commands are sent in order. Once a command of a port cannot be
+	 * sent, the later commands of that port are held back as well. The rest
+	 * of the commands are moved forward to fill the gaps. */
+	for (index = pipeline->head; index != pipeline->tail; index++) {
+		packet = pipeline->packets + (index & (UCPU_PIPELINE_SIZE - 1));
+		port_id = ((hub_port_output_command_t*)packet->data)->port_id;
+
+		if (ret == 0 && !(blocked_ports[port_id >> 5] & (1u << (port_id & 0x1f)))
+				&& ucpu_pipeline_unfinished(ucpu_connection, port_id) < pipeline->depth) {
+			ret = ucpu_transmit(ucpu_connection, (hub_common_message_header_t*)packet->data, packet->length);
+			if (ret == 0) {
+				continue;
+			}
+		}
+
+		blocked_ports[port_id >> 5] |= 1u << (port_id & 0x1f);
+
+		dst = pipeline->packets + (new_tail & (UCPU_PIPELINE_SIZE - 1));
+		if (dst != packet) {
+			*dst = *packet;
+		}
+		new_tail++;
+	}
+
+	pipeline->tail = new_tail;
+	return ret == 1;
+}
@@ -0,0 +1,214 @@
+/*
+ *    uc-powered-up (micro/universal c implementation of powered up, you see powered up, ...)
+ *
+ *    Copyright Zoltan Herczeg (hzmester@freemail.hu). All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright notice, this list of
+ *      conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *      of conditions and the following disclaimer in the documentation and/or other materials
+ *      provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER(S) AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER(S) OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Recording the sent and received packets into a binary file. */
+
+#include "globals.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* The file starts with a 16 byte header: the magic value followed by zeroes.
+ * Each record is a ucpu_record_t followed by the packet data, padded to 8
+ * bytes, so all records are aligned in a memory mapped file. */
+static const char ucpu_record_magic[8] = { 'U', 'C', 'P', 'U', 'R', 'E', 'C', '1' };
+
+#define UCPU_RECORD_FILE_HEADER_SIZE 16
+#define UCPU_RECORD_SIZE(length) ((sizeof(ucpu_record_t) + (length) + 7) & ~(size_t)7)
+
+static int ucpu_write_all(int fd, const uint8_t *data, size_t size)
+{
+	ssize_t ret;
+
+	while (size > 0) {
+		ret = write(fd, data, size);
+
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return 1;
+		}
+
+		data += ret;
+		size -= (size_t)ret;
+	}
+	return 0;
+}
+
+int ucpu_recorder_open(ucpu_recorder_t *recorder, const char *path)
+{
+	uint8_t file_header[UCPU_RECORD_FILE_HEADER_SIZE];
+	struct stat file_stat;
+
+	recorder->used = 0;
+	recorder->fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+	if (recorder->fd < 0) {
+		return 1;
+	}
+
+	if (fstat(recorder->fd, &file_stat) != 0) {
+		close(recorder->fd);
+		recorder->fd = -1;
+		return 1;
+	}
+
+	/* New records are appended to existing files. */
+	if (file_stat.st_size == 0) {
+		memset(file_header, 0, sizeof(file_header));
+		memcpy(file_header, ucpu_record_magic, sizeof(ucpu_record_magic));
+
+		if (ucpu_write_all(recorder->fd, file_header, sizeof(file_header)) != 0) {
+			close(recorder->fd);
+			recorder->fd = -1;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int ucpu_recorder_flush(ucpu_recorder_t *recorder)
+{
+	int ret;
+
+	if (recorder->used == 0) {
+		return 0;
+	}
+
+	ret = ucpu_write_all(recorder->fd, (const uint8_t*)recorder->buffer, recorder->used);
+	recorder->used = 0;
+	return ret;
+}
+
+int ucpu_recorder_close(ucpu_recorder_t *recorder)
+{
+	int ret = ucpu_recorder_flush(recorder);
+
+	if (close(recorder->fd) != 0) {
+		ret = 1;
+	}
+
+	recorder->fd = -1;
+	return ret;
+}
+
+void ucpu_recorder_write(ucpu_recorder_t *recorder, uint16_t connection_id, uint8_t direction,
+	uint64_t timestamp_ns, const uint8_t *data, int length)
+{
+	ucpu_record_t *record;
+	size_t record_size;
+
+	if (length < 0 || length > UCPU_RECORD_MAX_LENGTH) {
+		return;
+	}
+
+	record_size = UCPU_RECORD_SIZE((size_t)length);
+
+	/* Records are only written to the file when the buffer is full. */
+	if (recorder->used + record_size > UCPU_RECORDER_BUFFER_SIZE) {
+		ucpu_recorder_flush(recorder);
+	}
+
+	record = (ucpu_record_t*)((uint8_t*)recorder->buffer + recorder->used);
+	record->timestamp_ns = timestamp_ns;
+	record->connection_id = connection_id;
+	record->length = (uint16_t)length;
+	record->direction = direction;
+	memset(record->reserved, 0, sizeof(record->reserved));
+
+	memcpy(record + 1, data, (size_t)length);
+	/* Padding bytes are zeroed, so the output is deterministic. */
+	memset((uint8_t*)(record + 1) + length, 0, record_size - sizeof(ucpu_record_t) - (size_t)length);
+
+	recorder->used += (uint32_t)record_size;
+}
+
+int ucpu_record_reader_open(ucpu_record_reader_t *record_reader, const char *path)
+{
+	struct stat file_stat;
+	void *data;
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0) {
+		return 1;
+	}
+
+	if (fstat(fd, &file_stat) != 0 || file_stat.st_size < UCPU_RECORD_FILE_HEADER_SIZE) {
+		close(fd);
+		return 1;
+	}
+
+	data = mmap(NULL, (size_t)file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED) {
+		return 1;
+	}
+
+	if (memcmp(data, ucpu_record_magic, sizeof(ucpu_record_magic)) != 0) {
+		munmap(data, (size_t)file_stat.st_size);
+		return 1;
+	}
+
+	madvise(data, (size_t)file_stat.st_size, MADV_SEQUENTIAL);
+
+	record_reader->data = (const uint8_t*)data;
+	record_reader->size = (size_t)file_stat.st_size;
+	record_reader->offset = UCPU_RECORD_FILE_HEADER_SIZE;
+	return 0;
+}
+
+const ucpu_record_t *ucpu_record_reader_next(ucpu_record_reader_t *record_reader)
+{
+	const ucpu_record_t *record;
+	size_t record_size;
+
+	if (record_reader->offset + sizeof(ucpu_record_t) > record_reader->size) {
+		return NULL;
+	}
+
+	record = (const ucpu_record_t*)(record_reader->data + record_reader->offset);
+	record_size = UCPU_RECORD_SIZE((size_t)record->length);
+
+	/* The last record might be truncated if the recording was interrupted. */
+	if (record_reader->offset + record_size > record_reader->size) {
+		return NULL;
+	}
+
+	record_reader->offset += record_size;
+	return record;
+}
+
+void ucpu_record_reader_close(ucpu_record_reader_t *record_reader)
+{
+	munmap((void*)record_reader->data, record_reader->size);
+	record_reader->data = NULL;
+}
@@ -0,0 +1,151 @@
+/*
+ *    uc-powered-up (micro/universal c implementation of powered up, you see powered up, ...)
+ *
+ *    Copyright Zoltan Herczeg (hzmester@freemail.hu). All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright notice, this list of
+ *      conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *      of conditions and the following disclaimer in the documentation and/or other materials
+ *      provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER(S) AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER(S) OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Registry of the devices attached to the ports of a Hub. */
+
+#include "globals.h"
+
+#include <string.h>
+
+#define UCPU_MOTOR (UCPU_IO_CAPABILITY_OUTPUT | UCPU_IO_CAPABILITY_MOTOR)
+#define UCPU_TACHO_MOTOR (UCPU_MOTOR | UCPU_IO_CAPABILITY_INPUT | UCPU_IO_CAPABILITY_TACHO)
+#define UCPU_ANGULAR_MOTOR (UCPU_TACHO_MOTOR | UCPU_IO_CAPABILITY_ABSOLUTE_POSITION)
+#define UCPU_LIGHT (UCPU_IO_CAPABILITY_OUTPUT | UCPU_IO_CAPABILITY_LIGHT)
+#define UCPU_SENSOR UCPU_IO_CAPABILITY_INPUT
+
+/* Must be sorted by io_type_id. */
+static const ucpu_io_type_t ucpu_io_types[] = {
+	{ 0x01, UCPU_MOTOR, "Basic motor" },
+	{ 0x02, UCPU_MOTOR, "System Train Motor" },
+	{ 0x05, UCPU_SENSOR, "Button" },
+	{ 0x08, UCPU_LIGHT, "LED light" },
+	{ 0x14, UCPU_SENSOR, "Voltage sensor" },
+	{ 0x15, UCPU_SENSOR, "Current sensor" },
+	{ 0x16, UCPU_IO_CAPABILITY_OUTPUT, "Piezo tone (sound)" },
+	{ 0x17, UCPU_LIGHT, "Hub LED light" },
+	{ 0x22, UCPU_SENSOR, "External tilt sensor" },
+	{ 0x23, UCPU_SENSOR, "Motion sensor" },
+	{ 0x25, UCPU_SENSOR | UCPU_LIGHT, "Color distance sensor" },
+	{ 0x26, UCPU_TACHO_MOTOR, "External motor with tacho" },
+	{ 0x27, UCPU_TACHO_MOTOR, "Internal motor with tacho" },
+	{ 0x28, UCPU_SENSOR, "Internal tilt sensor" },
+	{ 0x29, UCPU_MOTOR, "Duplo train motor" },
+	{ 0x2a, UCPU_IO_CAPABILITY_OUTPUT, "Duplo train speaker" },
+	{ 0x2b, UCPU_SENSOR, "Duplo train color sensor" },
+	{ 0x2c, UCPU_SENSOR, "Duplo train speedometer" },
+	{ 0x2e, UCPU_ANGULAR_MOTOR, "Technic large motor" },
+	{ 0x2f, UCPU_ANGULAR_MOTOR, "Technic extra large motor" },
+	{ 0x30, UCPU_ANGULAR_MOTOR, "Technic medium angular motor" },
+	{ 0x31, UCPU_ANGULAR_MOTOR, "Technic large angular motor" },
+	{ 0x36, UCPU_SENSOR, "Hub gesture sensor" },
+	{ 0x37, UCPU_SENSOR, "Remote control button" },
+	{ 0x38, UCPU_SENSOR, "Remote control RSSI" },
+	{ 0x39, UCPU_SENSOR, "Hub accelerometer" },
+	{ 0x3a, UCPU_SENSOR, "Hub gyro sensor" },
+	{ 0x3b, UCPU_SENSOR, "Hub tilt sensor" },
+	{ 0x3c, UCPU_SENSOR, "Hub temperature sensor" },
+	{ 0x3d, UCPU_SENSOR | UCPU_LIGHT, "Color sensor" },
+	{ 0x3e, UCPU_SENSOR | UCPU_LIGHT, "Distance sensor" },
+	{ 0x3f, UCPU_SENSOR, "Force sensor" },
+	{ 0x4b, UCPU_ANGULAR_MOTOR, "Technic medium angular motor (grey)" },
+	{ 0x4c, UCPU_ANGULAR_MOTOR, "Technic large angular motor (grey)" },
+};
+
+const ucpu_io_type_t *ucpu_get_io_type(uint16_t io_type_id)
+{
+	int low = 0;
+	int high = (int)(sizeof(ucpu_io_types) / sizeof(ucpu_io_type_t)) - 1;
+	int mid;
+
+	while (low <= high) {
+		mid = (low + high) >> 1;
+
+		if (ucpu_io_types[mid].io_type_id == io_type_id) {
+			return ucpu_io_types + mid;
+		}
+
+		if (ucpu_io_types[mid].io_type_id < io_type_id) {
+			low = mid + 1;
+		} else {
+			high = mid - 1;
+		}
+	}
+	return NULL;
+}
+
+void ucpu_port_registry_init(ucpu_port_registry_t *port_registry)
+{
+	memset(port_registry, 0, sizeof(ucpu_port_registry_t));
+}
+
+const ucpu_port_info_t *ucpu_port_lookup(ucpu_connection_t *ucpu_connection, uint8_t port_id)
+{
+	const ucpu_port_info_t *port_info = ucpu_connection->port_registry->ports + port_id;
+
+	if (port_info->state == HUB_ATTACHED_IO_DETACHED) {
+		return NULL;
+	}
+	return port_info;
+}
+
+#define UCPU_GET_32BIT_VALUE(source) \
+	((uint32_t)(source)[0] | ((uint32_t)(source)[1] << 8) | ((uint32_t)(source)[2] << 16) | ((uint32_t)(source)[3] << 24))
+
+void ucpu_port_registry_update(ucpu_connection_t *ucpu_connection, const uint8_t *packet, int message_length)
+{
+	const hub_attached_io_attached_t *attached_io_attached;
+	const hub_attached_io_attached_virtual_t *attached_io_attached_virtual;
+	ucpu_port_info_t *port_info;
+	int update_type = ucpu_is_attached_io_update_packet(packet, message_length);
+
+	if (update_type < 0) {
+		return;
+	}
+
+	port_info = ucpu_connection->port_registry->ports + ((const hub_attached_io_t*)packet)->port_id;
+	memset(port_info, 0, sizeof(ucpu_port_info_t));
+
+	if (update_type == HUB_ATTACHED_IO_DETACHED) {
+		return;
+	}
+
+	port_info->state = (uint8_t)update_type;
+
+	if (update_type == HUB_ATTACHED_IO_ATTACHED) {
+		attached_io_attached = (const hub_attached_io_attached_t*)packet;
+		port_info->io_type_id = (uint16_t)(attached_io_attached->io_type_id[0] | (attached_io_attached->io_type_id[1] << 8));
+		port_info->hardware_revision = UCPU_GET_32BIT_VALUE(attached_io_attached->hardware_revision);
+		port_info->software_revision = UCPU_GET_32BIT_VALUE(attached_io_attached->software_revision);
+	} else {
+		attached_io_attached_virtual = (const hub_attached_io_attached_virtual_t*)packet;
+		port_info->io_type_id = (uint16_t)(attached_io_attached_virtual->io_type_id[0]
+			| (attached_io_attached_virtual->io_type_id[1] << 8));
+		port_info->port_id_a = attached_io_attached_virtual->port_id_a;
+		port_info->port_id_b = attached_io_attached_virtual->port_id_b;
+	}
+
+	port_info->io_type = ucpu_get_io_type(port_info->io_type_id);
+}
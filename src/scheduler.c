@@ -0,0 +1,291 @@
+/*
+ *    uc-powered-up (micro/universal c implementation of powered up, you see powered up, ...)
+ *
+ *    Copyright Zoltan Herczeg (hzmester@freemail.hu). All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright notice, this list of
+ *      conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *      of conditions and the following disclaimer in the documentation and/or other materials
+ *      provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER(S) AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER(S) OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Stage scheduler driven by absolute deadlines. */
+
+#include "globals.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+int ucpu_scheduler_init(ucpu_scheduler_t *scheduler, uint32_t miss_threshold_us)
+{
+	memset(scheduler, 0, sizeof(ucpu_scheduler_t));
+	scheduler->miss_threshold_ns = (uint64_t)miss_threshold_us * 1000;
+
+	/* The timerfd uses the same clock as ucpu_get_time_ns. */
+	scheduler->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	return scheduler->timer_fd < 0;
+}
+
+void ucpu_scheduler_free(ucpu_scheduler_t *scheduler)
+{
+	if (scheduler->timer_fd >= 0) {
+		close(scheduler->timer_fd);
+		scheduler->timer_fd = -1;
+	}
+}
+
+void ucpu_scheduler_set_miss_handler(ucpu_scheduler_t *scheduler,
+	ucpu_deadline_miss_handler_t miss_handler, void *user_data)
+{
+	scheduler->miss_handler = miss_handler;
+	scheduler->miss_user_data = user_data;
+}
+
+static int ucpu_scheduler_arm(ucpu_scheduler_t *scheduler)
+{
+	struct itimerspec timer_spec;
+	uint64_t deadline_ns = scheduler->stage_deadline_ns;
+	int i;
+
+	for (i = 0; i < UCPU_SCHEDULER_MAX_ACTIONS; i++) {
+		if (scheduler->actions[i].handler != NULL
+				&& (deadline_ns == 0 || scheduler->actions[i].deadline_ns < deadline_ns)) {
+			deadline_ns = scheduler->actions[i].deadline_ns;
+		}
+	}
+
+	/* Avoid system calls when the earliest deadline is not changed. */
+	if (deadline_ns == scheduler->armed_ns) {
+		return 0;
+	}
+
+	/* A zero expiration disarms the timer. Expired deadlines are reported immediately. */
+	memset(&timer_spec, 0, sizeof(timer_spec));
+	timer_spec.it_value.tv_sec = (time_t)(deadline_ns / 1000000000);
+	timer_spec.it_value.tv_nsec = (long)(deadline_ns % 1000000000);
+
+	if (timerfd_settime(scheduler->timer_fd, TFD_TIMER_ABSTIME, &timer_spec, NULL) != 0) {
+		return 1;
+	}
+
+	scheduler->armed_ns = deadline_ns;
+	return 0;
+}
+
+static void ucpu_scheduler_check_deadline(ucpu_scheduler_t *scheduler, uint8_t type, uint32_t index,
+	uint64_t deadline_ns, uint64_t now_ns, uint32_t skipped)
+{
+	ucpu_deadline_miss_t miss;
+	uint64_t late_ns = now_ns - deadline_ns;
+
+	if (late_ns <= scheduler->miss_threshold_ns && skipped == 0) {
+		return;
+	}
+
+	scheduler->miss_count++;
+	if (late_ns > scheduler->max_late_ns) {
+		scheduler->max_late_ns = late_ns;
+	}
+
+	if (scheduler->miss_handler != NULL) {
+		miss.type = type;
+		miss.index = index;
+		miss.deadline_ns = deadline_ns;
+		miss.late_ns = late_ns;
+		miss.skipped = skipped;
+		scheduler->miss_handler(scheduler, &miss, scheduler->miss_user_data);
+	}
+}
+
+static void ucpu_scheduler_enter(ucpu_scheduler_t *scheduler, uint32_t stage, uint64_t start_ns)
+{
+	const ucpu_stage_t *current;
+
+	scheduler->stage = stage;
+	scheduler->stage_start_ns = start_ns;
+	scheduler->stage_deadline_ns = 0;
+
+	if (stage >= scheduler->stage_count) {
+		return;
+	}
+
+	current = scheduler->stages + stage;
+
+	/* The deadline is set first, since the handler may enter another stage. */
+	if (current->duration_ms > 0) {
+		scheduler->stage_deadline_ns = start_ns + (uint64_t)current->duration_ms * 1000000;
+	}
+
+	if (current->enter != NULL) {
+		current->enter(scheduler, stage, start_ns, current->user_data);
+	}
+}
+
+int ucpu_scheduler_start(ucpu_scheduler_t *scheduler, const ucpu_stage_t *stages,
+	uint32_t stage_count, uint64_t start_ns)
+{
+	scheduler->stages = stages;
+	scheduler->stage_count = stage_count;
+
+	ucpu_scheduler_enter(scheduler, 0, (start_ns != 0) ? start_ns : ucpu_get_time_ns());
+	return ucpu_scheduler_arm(scheduler);
+}
+
+int ucpu_scheduler_set_stage(ucpu_scheduler_t *scheduler, uint32_t stage)
+{
+	if (stage > scheduler->stage_count) {
+		stage = scheduler->stage_count;
+	}
+
+	ucpu_scheduler_enter(scheduler, stage, ucpu_get_time_ns());
+	return ucpu_scheduler_arm(scheduler);
+}
+
+int ucpu_scheduler_add_action(ucpu_scheduler_t *scheduler, uint64_t deadline_ns,
+	uint32_t period_us, ucpu_action_handler_t handler, void *user_data)
+{
+	ucpu_scheduled_action_t *action;
+	int i;
+
+	for (i = 0; i < UCPU_SCHEDULER_MAX_ACTIONS; i++) {
+		action = scheduler->actions + i;
+
+		if (action->handler == NULL) {
+			action->handler = handler;
+			action->user_data = user_data;
+			action->deadline_ns = deadline_ns;
+			action->period_ns = (uint64_t)period_us * 1000;
+
+			if (ucpu_scheduler_arm(scheduler) != 0) {
+				action->handler = NULL;
+				return -1;
+			}
+			return i;
+		}
+	}
+	return -1;
+}
+
+void ucpu_scheduler_remove_action(ucpu_scheduler_t *scheduler, int action_id)
+{
+	if (action_id < 0 || action_id >= UCPU_SCHEDULER_MAX_ACTIONS) {
+		return;
+	}
+
+	scheduler->actions[action_id].handler = NULL;
+	ucpu_scheduler_arm(scheduler);
+}
+
+static void ucpu_scheduler_run_action(ucpu_scheduler_t *scheduler, int action_id, uint64_t now_ns)
+{
+	ucpu_scheduled_action_t *action = scheduler->actions + action_id;
+	ucpu_action_handler_t handler = action->handler;
+	uint64_t deadline_ns = action->deadline_ns;
+	uint32_t skipped = 0;
+
+	/* The action is updated before the handler is called, so the
+	 * handler can remove it, or add new actions to its entry. */
+	if (action->period_ns > 0) {
+		skipped = (uint32_t)((now_ns - deadline_ns) / action->period_ns);
+		action->deadline_ns = deadline_ns + (uint64_t)(skipped + 1) * action->period_ns;
+	} else {
+		action->handler = NULL;
+	}
+
+	ucpu_scheduler_check_deadline(scheduler, UCPU_DEADLINE_ACTION, (uint32_t)action_id,
+		deadline_ns, now_ns, skipped);
+	handler(scheduler, action_id, deadline_ns, action->user_data);
+}
+
+int ucpu_scheduler_process(ucpu_scheduler_t *scheduler)
+{
+	uint64_t expirations, now_ns, deadline_ns;
+	ucpu_scheduled_action_t *action;
+	int i, next;
+
+	/* The deadlines are compared to the current time, so the number of expirations is not used. */
+	if (read(scheduler->timer_fd, &expirations, sizeof(expirations)) < 0
+			&& errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+		return 1;
+	}
+
+	scheduler->armed_ns = 0;
+	now_ns = ucpu_get_time_ns();
+
+	while (1) {
+		/* The expired deadlines are processed in order. Stage transitions are
+		 * processed first when an action has the same deadline. */
+		next = -2;
+		deadline_ns = 0;
+
+		if (scheduler->stage_deadline_ns != 0 && scheduler->stage_deadline_ns <= now_ns) {
+			next = -1;
+			deadline_ns = scheduler->stage_deadline_ns;
+		}
+
+		for (i = 0; i < UCPU_SCHEDULER_MAX_ACTIONS; i++) {
+			action = scheduler->actions + i;
+
+			if (action->handler != NULL && action->deadline_ns <= now_ns
+					&& (next == -2 || action->deadline_ns < deadline_ns)) {
+				next = i;
+				deadline_ns = action->deadline_ns;
+			}
+		}
+
+		if (next == -2) {
+			break;
+		}
+
+		if (next >= 0) {
+			ucpu_scheduler_run_action(scheduler, next, now_ns);
+			continue;
+		}
+
+		/* The next stage starts at the deadline, not when it is processed. A late stage
+		 * is still entered, since its commands may be needed by the following stages. */
+		ucpu_scheduler_check_deadline(scheduler, UCPU_DEADLINE_STAGE, scheduler->stage, deadline_ns, now_ns, 0);
+		ucpu_scheduler_enter(scheduler, scheduler->stage + 1, deadline_ns);
+	}
+
+	return ucpu_scheduler_arm(scheduler);
+}
+
+int ucpu_scheduler_notify(ucpu_scheduler_t *scheduler, ucpu_connection_t *ucpu_connection,
+	const uint8_t *packet, int packet_len)
+{
+	const ucpu_stage_t *current;
+
+	if (UCPU_SCHEDULER_FINISHED(scheduler) || packet_len < (int)sizeof(hub_common_message_header_t)
+			|| packet[0] != ATT_HANDLE_VALUE_NTF) {
+		return 0;
+	}
+
+	current = scheduler->stages + scheduler->stage;
+
+	if (current->trigger == NULL || !current->trigger(ucpu_connection,
+			(const hub_common_message_header_t*)packet, packet_len, current->user_data)) {
+		return 0;
+	}
+
+	ucpu_scheduler_enter(scheduler, scheduler->stage + 1, ucpu_get_time_ns());
+	ucpu_scheduler_arm(scheduler);
+	return 1;
+}
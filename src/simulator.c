@@ -0,0 +1,488 @@
+/*
+ *    uc-powered-up (micro/universal c implementation of powered up, you see powered up, ...)
+ *
+ *    Copyright Zoltan Herczeg (hzmester@freemail.hu). All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright notice, this list of
+ *      conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *      of conditions and the following disclaimer in the documentation and/or other materials
+ *      provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER(S) AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER(S) OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Simulated Hub for testing without hardware. */
+
+#define _GNU_SOURCE
+
+#include "simulator.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+/* First port id assigned to virtual ports. */
+#define UCPU_SIMULATOR_VIRTUAL_PORT_ID 16
+
+void ucpu_simulator_init(ucpu_simulator_t *simulator)
+{
+	memset(simulator, 0, sizeof(ucpu_simulator_t));
+
+	simulator->sock = -1;
+	simulator->stop_fd = -1;
+	/* Handle used by the LEGO Hubs. */
+	simulator->handle[0] = 0x0e;
+	simulator->handle[1] = 0x00;
+	simulator->command_duration_us = 1000;
+}
+
+int ucpu_simulator_add_device(ucpu_simulator_t *simulator, uint8_t port_id, uint16_t io_type_id,
+	uint8_t value_size, uint32_t period_us)
+{
+	ucpu_simulated_device_t *device;
+
+	if (simulator->device_count >= UCPU_SIMULATOR_MAX_DEVICES || value_size > 32) {
+		return 1;
+	}
+
+	device = simulator->devices + simulator->device_count;
+	simulator->device_count++;
+
+	memset(device, 0, sizeof(ucpu_simulated_device_t));
+	device->port_id = port_id;
+	device->attached = HUB_ATTACHED_IO_ATTACHED;
+	device->io_type_id = io_type_id;
+	device->value_size = value_size;
+	device->delta_interval = 1;
+	device->period_us = period_us;
+	return 0;
+}
+
+static ucpu_simulated_device_t *ucpu_simulator_find(ucpu_simulator_t *simulator, uint8_t port_id)
+{
+	uint32_t i;
+
+	for (i = 0; i < simulator->device_count; i++) {
+		if (simulator->devices[i].port_id == port_id && simulator->devices[i].attached != HUB_ATTACHED_IO_DETACHED) {
+			return simulator->devices + i;
+		}
+	}
+	return NULL;
+}
+
+/* Notifications are dropped when the socket buffer is full, like a congested radio link. */
+static void ucpu_simulator_send(ucpu_simulator_t *simulator, uint8_t *packet, int packet_len)
+{
+	hub_common_message_header_t *common_message_header = (hub_common_message_header_t*)packet;
+
+	common_message_header->opcode = ATT_HANDLE_VALUE_NTF;
+	common_message_header->handle[0] = simulator->handle[0];
+	common_message_header->handle[1] = simulator->handle[1];
+	common_message_header->length = (uint8_t)(packet_len - 3);
+	common_message_header->hub_id = 0;
+
+	if (send(simulator->sock, packet, (size_t)packet_len, MSG_DONTWAIT) == packet_len) {
+		simulator->sent_count++;
+	} else {
+		simulator->dropped_count++;
+	}
+}
+
+static void ucpu_simulator_send_attached_io(ucpu_simulator_t *simulator, ucpu_simulated_device_t *device)
+{
+	hub_attached_io_attached_t attached_io_attached;
+	hub_attached_io_attached_virtual_t *attached_io_attached_virtual = (hub_attached_io_attached_virtual_t*)&attached_io_attached;
+	int packet_len = sizeof(hub_attached_io_t);
+
+	memset(&attached_io_attached, 0, sizeof(attached_io_attached));
+	attached_io_attached.attached_io.common_message_header.message_type = HUB_ATTACHED_IO;
+	attached_io_attached.attached_io.port_id = device->port_id;
+	attached_io_attached.attached_io.event = device->attached;
+
+	if (device->attached == HUB_ATTACHED_IO_ATTACHED) {
+		attached_io_attached.io_type_id[0] = (uint8_t)device->io_type_id;
+		attached_io_attached.io_type_id[1] = (uint8_t)(device->io_type_id >> 8);
+		/* Version 1.0.0.0 */
+		attached_io_attached.hardware_revision[3] = 0x10;
+		attached_io_attached.software_revision[3] = 0x10;
+		packet_len = sizeof(hub_attached_io_attached_t);
+	} else if (device->attached == HUB_ATTACHED_IO_ATTACHED_VIRTUAL) {
+		attached_io_attached_virtual->io_type_id[0] = (uint8_t)device->io_type_id;
+		attached_io_attached_virtual->io_type_id[1] = (uint8_t)(device->io_type_id >> 8);
+		attached_io_attached_virtual->port_id_a = device->port_id_a;
+		attached_io_attached_virtual->port_id_b = device->port_id_b;
+		packet_len = sizeof(hub_attached_io_attached_virtual_t);
+	}
+
+	ucpu_simulator_send(simulator, (uint8_t*)&attached_io_attached, packet_len);
+}
+
+static void ucpu_simulator_send_value(ucpu_simulator_t *simulator, ucpu_simulated_device_t *device)
+{
+	uint8_t packet[sizeof(hub_port_value_single_t) + 32];
+	hub_port_value_single_t *port_value_single = (hub_port_value_single_t*)packet;
+	uint8_t *data = packet + sizeof(hub_port_value_single_t);
+	int i;
+
+	port_value_single->common_message_header.message_type = HUB_PORT_VALUE_SINGLE;
+	port_value_single->port_id = device->port_id;
+
+	/* Each 32 bit part of the data contains the value. */
+	for (i = 0; i < device->value_size; i++) {
+		data[i] = (uint8_t)((uint32_t)device->value >> ((i & 0x3) * 8));
+	}
+
+	device->last_sent_value = device->value;
+	ucpu_simulator_send(simulator, packet, (int)sizeof(hub_port_value_single_t) + device->value_size);
+}
+
+static void ucpu_simulator_send_feedback(ucpu_simulator_t *simulator, ucpu_simulated_device_t *device, uint8_t feedback)
+{
+	hub_port_output_command_feedback_t port_output_command_feedback;
+
+	if (!device->feedback) {
+		return;
+	}
+
+	port_output_command_feedback.common_message_header.message_type = PORT_OUTPUT_COMMAND_FEEDBACK;
+	port_output_command_feedback.port_id = device->port_id;
+	port_output_command_feedback.feedback = feedback;
+	ucpu_simulator_send(simulator, (uint8_t*)&port_output_command_feedback, sizeof(hub_port_output_command_feedback_t));
+}
+
+static void ucpu_simulator_input_format_setup(ucpu_simulator_t *simulator, const uint8_t *packet, int packet_len)
+{
+	const hub_port_input_format_setup_t *port_input_format_setup = (const hub_port_input_format_setup_t*)packet;
+	hub_port_input_format_single_t port_input_format_single;
+	ucpu_simulated_device_t *device;
+
+	if (packet_len != sizeof(hub_port_input_format_setup_t)) {
+		return;
+	}
+
+	device = ucpu_simulator_find(simulator, port_input_format_setup->port_id);
+	if (device == NULL) {
+		return;
+	}
+
+	device->mode = port_input_format_setup->mode;
+	device->delta_interval = (uint32_t)port_input_format_setup->delta_interval[0]
+		| ((uint32_t)port_input_format_setup->delta_interval[1] << 8)
+		| ((uint32_t)port_input_format_setup->delta_interval[2] << 16)
+		| ((uint32_t)port_input_format_setup->delta_interval[3] << 24);
+	device->notification_enabled = port_input_format_setup->notification_enabled;
+	device->next_value_ns = ucpu_get_time_ns() + (uint64_t)device->period_us * 1000;
+
+	port_input_format_single.common_message_header.message_type = HUB_PORT_INPUT_FORMAT_SINGLE;
+	port_input_format_single.port_id = device->port_id;
+	port_input_format_single.mode = device->mode;
+	memcpy(port_input_format_single.delta_interval, port_input_format_setup->delta_interval, 4);
+	port_input_format_single.notification_enabled = device->notification_enabled;
+	ucpu_simulator_send(simulator, (uint8_t*)&port_input_format_single, sizeof(hub_port_input_format_single_t));
+
+	/* The Hub reports the current value when notifications are enabled. */
+	if (device->notification_enabled && device->value_size > 0) {
+		ucpu_simulator_send_value(simulator, device);
+	}
+}
+
+static void ucpu_simulator_output_command(ucpu_simulator_t *simulator, const uint8_t *packet, int packet_len)
+{
+	const hub_port_output_command_t *port_output_command = (const hub_port_output_command_t*)packet;
+	const hub_motor_start_speed_for_time_t *motor_start_speed_for_time = (const hub_motor_start_speed_for_time_t*)packet;
+	ucpu_simulated_device_t *device;
+	uint32_t duration_us = simulator->command_duration_us;
+
+	if (packet_len < sizeof(hub_port_output_command_t)) {
+		return;
+	}
+
+	device = ucpu_simulator_find(simulator, port_output_command->port_id);
+	if (device == NULL) {
+		return;
+	}
+
+	if ((port_output_command->sub_command == HUB_MOTOR_START_SPEED_FOR_TIME
+			|| port_output_command->sub_command == HUB_MOTOR_START_SPEED_FOR_TIME_DUAL)
+			&& packet_len >= sizeof(hub_motor_start_speed_for_time_t)) {
+		duration_us = ((uint32_t)motor_start_speed_for_time->time[0]
+			| ((uint32_t)motor_start_speed_for_time->time[1] << 8)) * 1000;
+	}
+
+	device->feedback = port_output_command->startup_and_complete & PORT_OUTPUT_COMPLETION_FEEDBACK;
+
+	if (device->running && !(port_output_command->startup_and_complete & PORT_OUTPUT_STARTUP_IMMEDIATE)) {
+		if (device->buffered) {
+			ucpu_simulator_send_feedback(simulator, device, PORT_FEEDBACK_BUSY_FULL);
+			return;
+		}
+
+		/* Started when the running command is completed. */
+		device->buffered = 1;
+		device->buffered_duration_us = duration_us;
+		return;
+	}
+
+	if (device->running) {
+		/* Both the running and the buffered commands are discarded. */
+		ucpu_simulator_send_feedback(simulator, device, PORT_FEEDBACK_DISCARDED | PORT_FEEDBACK_BUFFER_EMPTY_IN_PROGRESS);
+	} else {
+		ucpu_simulator_send_feedback(simulator, device, PORT_FEEDBACK_BUFFER_EMPTY_IN_PROGRESS);
+	}
+
+	device->running = 1;
+	device->buffered = 0;
+	device->command_end_ns = ucpu_get_time_ns() + (uint64_t)duration_us * 1000;
+}
+
+static void ucpu_simulator_virtual_port_setup(ucpu_simulator_t *simulator, const uint8_t *packet, int packet_len)
+{
+	const hub_virtual_port_connect_t *virtual_port_connect = (const hub_virtual_port_connect_t*)packet;
+	ucpu_simulated_device_t *device, *device_a, *device_b;
+	uint8_t port_id = UCPU_SIMULATOR_VIRTUAL_PORT_ID;
+
+	if (virtual_port_connect->sub_command == 0) {
+		device = ucpu_simulator_find(simulator, virtual_port_connect->port_id_a);
+
+		if (packet_len == sizeof(hub_virtual_port_disconnect_t) && device != NULL
+				&& device->attached == HUB_ATTACHED_IO_ATTACHED_VIRTUAL) {
+			device->attached = HUB_ATTACHED_IO_DETACHED;
+			ucpu_simulator_send_attached_io(simulator, device);
+		}
+		return;
+	}
+
+	device_a = ucpu_simulator_find(simulator, virtual_port_connect->port_id_a);
+	device_b = ucpu_simulator_find(simulator, virtual_port_connect->port_id_b);
+
+	if (packet_len != sizeof(hub_virtual_port_connect_t) || device_a == NULL || device_b == NULL
+			|| device_a->io_type_id != device_b->io_type_id
+			|| simulator->device_count >= UCPU_SIMULATOR_MAX_DEVICES) {
+		return;
+	}
+
+	while (ucpu_simulator_find(simulator, port_id) != NULL) {
+		port_id++;
+	}
+
+	device = simulator->devices + simulator->device_count;
+	simulator->device_count++;
+
+	memset(device, 0, sizeof(ucpu_simulated_device_t));
+	device->port_id = port_id;
+	device->attached = HUB_ATTACHED_IO_ATTACHED_VIRTUAL;
+	device->port_id_a = device_a->port_id;
+	device->port_id_b = device_b->port_id;
+	device->io_type_id = device_a->io_type_id;
+	device->delta_interval = 1;
+	ucpu_simulator_send_attached_io(simulator, device);
+}
+
+static void ucpu_simulator_receive(ucpu_simulator_t *simulator)
+{
+	uint8_t packet[64];
+	const hub_common_message_header_t *common_message_header = (const hub_common_message_header_t*)packet;
+	ssize_t ret;
+
+	while (1) {
+		ret = recv(simulator->sock, packet, sizeof(packet), MSG_DONTWAIT);
+
+		if (ret < (int)sizeof(hub_common_message_header_t)) {
+			return;
+		}
+
+		simulator->received_count++;
+
+		if (common_message_header->opcode != ATT_WRITE_CMD) {
+			continue;
+		}
+
+		switch (common_message_header->message_type) {
+		case HUB_PORT_INPUT_FORMAT_SETUP:
+			ucpu_simulator_input_format_setup(simulator, packet, (int)ret);
+			break;
+		case PORT_OUTPUT_COMMAND:
+			ucpu_simulator_output_command(simulator, packet, (int)ret);
+			break;
+		case HUB_VIRTUAL_PORT_SETUP:
+			ucpu_simulator_virtual_port_setup(simulator, packet, (int)ret);
+			break;
+		}
+	}
+}
+
+/* Completes the commands and sends the values whose time has come. Returns
+ * with the time of the next event, or UINT64_MAX if there is no such event. */
+static uint64_t ucpu_simulator_update(ucpu_simulator_t *simulator, uint64_t now_ns)
+{
+	ucpu_simulated_device_t *device = simulator->devices;
+	ucpu_simulated_device_t *end = device + simulator->device_count;
+	uint64_t next_ns = UINT64_MAX;
+	uint64_t period_ns;
+
+	for (; device < end; device++) {
+		if (device->attached == HUB_ATTACHED_IO_DETACHED) {
+			continue;
+		}
+
+		if (device->running && device->command_end_ns <= now_ns) {
+			if (device->buffered) {
+				ucpu_simulator_send_feedback(simulator, device,
+					PORT_FEEDBACK_BUFFER_EMPTY_COMPLETED | PORT_FEEDBACK_BUFFER_EMPTY_IN_PROGRESS);
+				device->buffered = 0;
+				device->command_end_ns = now_ns + (uint64_t)device->buffered_duration_us * 1000;
+			} else {
+				ucpu_simulator_send_feedback(simulator, device,
+					PORT_FEEDBACK_BUFFER_EMPTY_COMPLETED | PORT_FEEDBACK_IDLE);
+				device->running = 0;
+			}
+		}
+
+		if (device->running && device->command_end_ns < next_ns) {
+			next_ns = device->command_end_ns;
+		}
+
+		if (!device->notification_enabled || device->period_us == 0 || device->value_size == 0) {
+			continue;
+		}
+
+		period_ns = (uint64_t)device->period_us * 1000;
+
+		/* Values are not accumulated when the simulator falls behind. */
+		if (device->next_value_ns + period_ns * 16 < now_ns) {
+			device->next_value_ns = now_ns;
+		}
+
+		while (device->next_value_ns <= now_ns) {
+			device->value++;
+			device->next_value_ns += period_ns;
+
+			if ((uint32_t)(device->value - device->last_sent_value) >= device->delta_interval) {
+				ucpu_simulator_send_value(simulator, device);
+			}
+		}
+
+		if (device->next_value_ns < next_ns) {
+			next_ns = device->next_value_ns;
+		}
+	}
+
+	return next_ns;
+}
+
+static void *ucpu_simulator_run(void *data)
+{
+	ucpu_simulator_t *simulator = (ucpu_simulator_t*)data;
+	struct pollfd poll_fds[2];
+	struct timespec timeout;
+	uint64_t now_ns, next_ns;
+	uint32_t i;
+
+	for (i = 0; i < simulator->device_count; i++) {
+		ucpu_simulator_send_attached_io(simulator, simulator->devices + i);
+	}
+
+	poll_fds[0].fd = simulator->sock;
+	poll_fds[0].events = POLLIN;
+	poll_fds[1].fd = simulator->stop_fd;
+	poll_fds[1].events = POLLIN;
+
+	while (1) {
+		now_ns = ucpu_get_time_ns();
+		next_ns = ucpu_simulator_update(simulator, now_ns);
+
+		if (next_ns != UINT64_MAX) {
+			now_ns = ucpu_get_time_ns();
+			next_ns = (next_ns > now_ns) ? next_ns - now_ns : 0;
+			timeout.tv_sec = (time_t)(next_ns / 1000000000);
+			timeout.tv_nsec = (long)(next_ns % 1000000000);
+		}
+
+		/* Microsecond resolution is needed for high notification rates. */
+		if (ppoll(poll_fds, 2, next_ns != UINT64_MAX ? &timeout : NULL, NULL) < 0 && errno != EINTR) {
+			break;
+		}
+
+		if (poll_fds[1].revents & POLLIN) {
+			break;
+		}
+
+		if (poll_fds[0].revents & (POLLERR | POLLHUP)) {
+			break;
+		}
+
+		if (poll_fds[0].revents & POLLIN) {
+			ucpu_simulator_receive(simulator);
+		}
+	}
+
+	return NULL;
+}
+
+int ucpu_simulator_start(ucpu_simulator_t *simulator, ucpu_connection_t *ucpu_connection)
+{
+	int sockets[2];
+
+	/* Both sockets are non-blocking like the L2CAP sockets of the connections. */
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, sockets) != 0) {
+		return 1;
+	}
+
+	simulator->stop_fd = eventfd(0, EFD_CLOEXEC);
+	if (simulator->stop_fd < 0) {
+		close(sockets[0]);
+		close(sockets[1]);
+		return 1;
+	}
+
+	simulator->sock = sockets[1];
+
+	ucpu_transport_open(ucpu_connection, &ucpu_socket_transport, sockets);
+	ucpu_connection->handle[0] = simulator->handle[0];
+	ucpu_connection->handle[1] = simulator->handle[1];
+
+	if (pthread_create(&simulator->thread, NULL, ucpu_simulator_run, simulator) != 0) {
+		close(sockets[0]);
+		close(sockets[1]);
+		close(simulator->stop_fd);
+		simulator->sock = -1;
+		simulator->stop_fd = -1;
+		ucpu_connection->sock = -1;
+		return 1;
+	}
+	return 0;
+}
+
+void ucpu_simulator_stop(ucpu_simulator_t *simulator)
+{
+	uint64_t value = 1;
+
+	if (simulator->sock < 0) {
+		return;
+	}
+
+	if (write(simulator->stop_fd, &value, sizeof(value)) == sizeof(value)) {
+		pthread_join(simulator->thread, NULL);
+	}
+
+	close(simulator->sock);
+	close(simulator->stop_fd);
+	simulator->sock = -1;
+	simulator->stop_fd = -1;
+}
@@ -0,0 +1,93 @@
+/*
+ *    uc-powered-up (micro/universal c implementation of powered up, you see powered up, ...)
+ *
+ *    Copyright Zoltan Herczeg (hzmester@freemail.hu). All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright notice, this list of
+ *      conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *      of conditions and the following disclaimer in the documentation and/or other materials
+ *      provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER(S) AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER(S) OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SIMULATOR_H_
+#define SIMULATOR_H_
+
+#include "globals.h"
+
+#include <pthread.h>
+
+/* Simulated Hub. The simulator runs in a separate thread, and communicates with a
+ * connection through an AF_UNIX SOCK_SEQPACKET socket pair using the same ATT
+ * packets as a real Hub. It is intended for testing and benchmarking without
+ * hardware. The simulator reports its devices with attached io messages, sends
+ * port value messages at a configurable rate when notifications are enabled,
+ * acknowledges port input format setup messages, executes port output commands
+ * with feedback, and creates virtual ports. */
+
+#define UCPU_SIMULATOR_MAX_DEVICES 32
+
+typedef struct {
+	uint8_t port_id;
+	uint8_t attached;
+	/* Member ports of a virtual port. */
+	uint8_t port_id_a;
+	uint8_t port_id_b;
+	uint16_t io_type_id;
+	/* Size of the port value data in bytes. */
+	uint8_t value_size;
+	uint8_t mode;
+	uint8_t notification_enabled;
+	/* Commands started by the simulator: the running one and the buffered one. */
+	uint8_t running;
+	uint8_t buffered;
+	uint8_t feedback;
+	uint32_t delta_interval;
+	/* Time between two value changes. Zero disables the value stream. */
+	uint32_t period_us;
+	uint32_t buffered_duration_us;
+	int32_t value;
+	int32_t last_sent_value;
+	uint64_t next_value_ns;
+	uint64_t command_end_ns;
+} ucpu_simulated_device_t;
+
+typedef struct {
+	int sock;
+	int stop_fd;
+	pthread_t thread;
+	uint8_t handle[2];
+	/* Duration of port output commands without time argument. */
+	uint32_t command_duration_us;
+	uint32_t device_count;
+	/* Statistics, valid after the simulator is stopped. */
+	uint64_t sent_count;
+	uint64_t dropped_count;
+	uint64_t received_count;
+	ucpu_simulated_device_t devices[UCPU_SIMULATOR_MAX_DEVICES];
+} ucpu_simulator_t;
+
+void ucpu_simulator_init(ucpu_simulator_t *simulator);
+/* Must be called before the simulator is started. Returns with 0 on success. */
+int ucpu_simulator_add_device(ucpu_simulator_t *simulator, uint8_t port_id, uint16_t io_type_id,
+	uint8_t value_size, uint32_t period_us);
+/* Initializes the connection, and starts the simulator thread. Returns with 0 on success. */
+int ucpu_simulator_start(ucpu_simulator_t *simulator, ucpu_connection_t *ucpu_connection);
+/* Stops the thread. The connection socket must be closed by the caller. */
+void ucpu_simulator_stop(ucpu_simulator_t *simulator);
+
+#endif /* SIMULATOR_H_ */
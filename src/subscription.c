@@ -0,0 +1,161 @@
+/*
+ *    uc-powered-up (micro/universal c implementation of powered up, you see powered up, ...)
+ *
+ *    Copyright Zoltan Herczeg (hzmester@freemail.hu). All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright notice, this list of
+ *      conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *      of conditions and the following disclaimer in the documentation and/or other materials
+ *      provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER(S) AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER(S) OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Reference counted subscriptions of port value notifications. */
+
+#include "globals.h"
+
+#include <string.h>
+
+void ucpu_subscription_manager_init(ucpu_subscription_manager_t *subscription_manager)
+{
+	int i;
+
+	memset(subscription_manager, 0, sizeof(ucpu_subscription_manager_t));
+
+	for (i = 0; i < 256; i++) {
+		subscription_manager->ports[i].mode = UCPU_SUBSCRIPTION_NO_MODE;
+	}
+}
+
+static ucpu_subscription_t *ucpu_subscription_find(ucpu_subscription_manager_t *subscription_manager,
+	uint8_t port_id, uint8_t mode, uint32_t delta_interval)
+{
+	ucpu_subscription_t *subscription = subscription_manager->subscriptions;
+	ucpu_subscription_t *end = subscription + subscription_manager->count;
+
+	for (; subscription < end; subscription++) {
+		if (subscription->port_id == port_id && subscription->mode == mode
+				&& subscription->delta_interval == delta_interval) {
+			return subscription;
+		}
+	}
+	return NULL;
+}
+
+/* Sends a setup message if the configuration of the port is changed. */
+static int ucpu_subscription_update_port(ucpu_connection_t *ucpu_connection, uint8_t port_id)
+{
+	ucpu_subscription_manager_t *subscription_manager = ucpu_connection->subscription_manager;
+	ucpu_subscription_port_t *port = subscription_manager->ports + port_id;
+	ucpu_subscription_t *subscription = subscription_manager->subscriptions;
+	ucpu_subscription_t *end = subscription + subscription_manager->count;
+	uint8_t mode = UCPU_SUBSCRIPTION_NO_MODE;
+	uint32_t delta_interval = 0;
+
+	/* The Hub uses the smallest delta interval requested by the consumers. */
+	for (; subscription < end; subscription++) {
+		if (subscription->port_id == port_id
+				&& (mode == UCPU_SUBSCRIPTION_NO_MODE || subscription->delta_interval < delta_interval)) {
+			mode = subscription->mode;
+			delta_interval = subscription->delta_interval;
+		}
+	}
+
+	if (mode == port->mode && delta_interval == port->delta_interval) {
+		return 0;
+	}
+
+	if (mode == UCPU_SUBSCRIPTION_NO_MODE) {
+		if (ucpu_port_input_format_setup(ucpu_connection, port_id, port->mode, port->delta_interval, 0) != 0) {
+			return 1;
+		}
+	} else if (ucpu_port_input_format_setup(ucpu_connection, port_id, mode, delta_interval, 1) != 0) {
+		return 1;
+	}
+
+	port->mode = mode;
+	port->delta_interval = delta_interval;
+	return 0;
+}
+
+int ucpu_subscribe(ucpu_connection_t *ucpu_connection, uint8_t port_id, uint8_t mode, uint32_t delta_interval)
+{
+	ucpu_subscription_manager_t *subscription_manager = ucpu_connection->subscription_manager;
+	ucpu_subscription_t *subscription;
+	uint8_t current_mode = subscription_manager->ports[port_id].mode;
+
+	/* A port can report the values of one mode at a time. Use
+	 * ucpu_port_subscribe_combined to receive multiple modes. */
+	if (current_mode != UCPU_SUBSCRIPTION_NO_MODE && current_mode != mode) {
+		return UCPU_SUBSCRIPTION_CONFLICT;
+	}
+
+	subscription = ucpu_subscription_find(subscription_manager, port_id, mode, delta_interval);
+
+	if (subscription == NULL) {
+		if (subscription_manager->count >= UCPU_MAX_SUBSCRIPTIONS) {
+			return 1;
+		}
+
+		subscription = subscription_manager->subscriptions + subscription_manager->count;
+		subscription->port_id = port_id;
+		subscription->mode = mode;
+		subscription->ref_count = 0;
+		subscription->delta_interval = delta_interval;
+		subscription_manager->count++;
+	}
+
+	subscription->ref_count++;
+
+	if (subscription->ref_count > 1) {
+		return 0;
+	}
+
+	if (ucpu_subscription_update_port(ucpu_connection, port_id) != 0) {
+		/* Revert the new entry. */
+		*subscription = subscription_manager->subscriptions[--subscription_manager->count];
+		return 1;
+	}
+	return 0;
+}
+
+int ucpu_unsubscribe(ucpu_connection_t *ucpu_connection, uint8_t port_id, uint8_t mode, uint32_t delta_interval)
+{
+	ucpu_subscription_manager_t *subscription_manager = ucpu_connection->subscription_manager;
+	ucpu_subscription_t *subscription = ucpu_subscription_find(subscription_manager, port_id, mode, delta_interval);
+	ucpu_subscription_t removed;
+
+	if (subscription == NULL) {
+		return 1;
+	}
+
+	if (subscription->ref_count > 1) {
+		subscription->ref_count--;
+		return 0;
+	}
+
+	/* The order of the entries does not matter. */
+	removed = *subscription;
+	*subscription = subscription_manager->subscriptions[--subscription_manager->count];
+
+	if (ucpu_subscription_update_port(ucpu_connection, port_id) != 0) {
+		/* The Hub still sends the values, so the entry is restored. */
+		subscription_manager->subscriptions[subscription_manager->count++] = removed;
+		return 1;
+	}
+	return 0;
+}
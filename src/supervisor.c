@@ -0,0 +1,460 @@
+/*
+ *    uc-powered-up (micro/universal c implementation of powered up, you see powered up, ...)
+ *
+ *    Copyright Zoltan Herczeg (hzmester@freemail.hu). All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright notice, this list of
+ *      conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *      of conditions and the following disclaimer in the documentation and/or other materials
+ *      provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER(S) AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER(S) OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Reconnect supervisor, which restores the state of a lost connection. */
+
+#include "globals.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+
+void ucpu_supervisor_init(ucpu_supervisor_t *supervisor, uint32_t min_backoff_ms,
+	uint32_t max_backoff_ms, uint32_t attempt_timeout_ms)
+{
+	memset(supervisor, 0, sizeof(ucpu_supervisor_t));
+
+	supervisor->state = UCPU_SUPERVISOR_CONNECTED;
+	supervisor->min_backoff_ms = min_backoff_ms;
+	supervisor->max_backoff_ms = (max_backoff_ms < min_backoff_ms) ? min_backoff_ms : max_backoff_ms;
+	supervisor->attempt_timeout_ms = attempt_timeout_ms;
+	supervisor->backoff_ms = min_backoff_ms;
+	supervisor->registered_fd = -1;
+}
+
+static void ucpu_supervisor_register(ucpu_connection_t *ucpu_connection, int fd, uint32_t events)
+{
+	ucpu_supervisor_t *supervisor = ucpu_connection->supervisor;
+
+	if (supervisor->registered_fd >= 0) {
+		/* Fails when the socket is already closed, but the entry is released. */
+		ucpu_event_loop_remove_fd(supervisor->event_loop, supervisor->registered_fd);
+		supervisor->registered_fd = -1;
+	}
+
+	if (fd >= 0 && supervisor->event_loop != NULL
+			&& ucpu_event_loop_add_fd(supervisor->event_loop, fd, events, ucpu_connection) == 0) {
+		supervisor->registered_fd = fd;
+	}
+}
+
+static void ucpu_supervisor_backoff(ucpu_connection_t *ucpu_connection, uint64_t now_ns)
+{
+	ucpu_supervisor_t *supervisor = ucpu_connection->supervisor;
+
+	ucpu_supervisor_register(ucpu_connection, -1, 0);
+
+	if (ucpu_connection->sock >= 0) {
+		ucpu_connection->transport->close(ucpu_connection);
+	}
+
+	supervisor->state = UCPU_SUPERVISOR_BACKOFF;
+	supervisor->deadline_ns = now_ns + (uint64_t)supervisor->backoff_ms * 1000000;
+
+	supervisor->backoff_ms *= 2;
+	if (supervisor->backoff_ms > supervisor->max_backoff_ms) {
+		supervisor->backoff_ms = supervisor->max_backoff_ms;
+	}
+}
+
+static void ucpu_supervisor_restored(ucpu_connection_t *ucpu_connection, uint64_t now_ns)
+{
+	ucpu_supervisor_t *supervisor = ucpu_connection->supervisor;
+	uint32_t i, count = 0;
+
+	/* Virtual ports which are not attached until the deadline are forgotten. */
+	for (i = 0; i < supervisor->virtual_port_count; i++) {
+		if (!supervisor->virtual_ports[i].pending) {
+			supervisor->virtual_ports[count++] = supervisor->virtual_ports[i];
+		}
+	}
+
+	supervisor->virtual_port_count = count;
+	supervisor->state = UCPU_SUPERVISOR_CONNECTED;
+	supervisor->backoff_ms = supervisor->min_backoff_ms;
+	supervisor->report.restored_ns = now_ns - supervisor->report.lost_ns;
+	supervisor->reconnect_count++;
+}
+
+static void ucpu_supervisor_restore(ucpu_connection_t *ucpu_connection, uint64_t now_ns)
+{
+	ucpu_supervisor_t *supervisor = ucpu_connection->supervisor;
+	ucpu_supervised_virtual_port_t *virtual_port;
+	ucpu_supervised_port_t *port;
+	uint32_t i;
+
+	supervisor->state = UCPU_SUPERVISOR_RESTORING;
+	supervisor->deadline_ns = now_ns + (uint64_t)supervisor->attempt_timeout_ms * 1000000;
+
+	/* Only the final state is restored: one command for each virtual port and each
+	 * port with enabled notifications. The devices stay attached while the connection
+	 * is lost, so the commands are sent without waiting for the attached io messages.
+	 * With a transmit queue, they are passed to the transport as a single batch. */
+	for (i = 0; i < supervisor->virtual_port_count && supervisor->state == UCPU_SUPERVISOR_RESTORING; i++) {
+		virtual_port = supervisor->virtual_ports + i;
+
+		/* The notifications of a virtual port are enabled when it is attached again. */
+		if (!virtual_port->pending) {
+			virtual_port->pending = 1;
+			virtual_port->port = supervisor->ports[virtual_port->port_id];
+			supervisor->ports[virtual_port->port_id].enabled = 0;
+		}
+
+		ucpu_virtual_port_connect(ucpu_connection, virtual_port->port_id_a, virtual_port->port_id_b);
+	}
+
+	for (i = 0; i < 256 && supervisor->state == UCPU_SUPERVISOR_RESTORING; i++) {
+		port = supervisor->ports + i;
+
+		if (port->enabled && ucpu_port_input_format_setup(ucpu_connection, (uint8_t)i,
+				port->mode, port->delta_interval, 1) == 0) {
+			supervisor->report.restored_subscriptions++;
+		}
+	}
+
+	if (supervisor->state != UCPU_SUPERVISOR_RESTORING) {
+		return;
+	}
+
+	if (ucpu_connection->tx_queue != NULL) {
+		ucpu_tx_flush(ucpu_connection);
+	}
+
+	if (supervisor->state == UCPU_SUPERVISOR_RESTORING && supervisor->virtual_port_count == 0) {
+		ucpu_supervisor_restored(ucpu_connection, now_ns);
+	}
+}
+
+static void ucpu_supervisor_ready(ucpu_connection_t *ucpu_connection, uint64_t now_ns)
+{
+	ucpu_supervisor_t *supervisor = ucpu_connection->supervisor;
+
+	ucpu_supervisor_register(ucpu_connection, -1, 0);
+	supervisor->report.ready_ns = now_ns - supervisor->report.lost_ns;
+
+	/* From now the notifications are received by the application again. */
+	if (supervisor->event_loop != NULL
+			&& ucpu_event_loop_add(supervisor->event_loop, ucpu_connection) != 0) {
+		ucpu_supervisor_backoff(ucpu_connection, now_ns);
+		return;
+	}
+
+	ucpu_supervisor_restore(ucpu_connection, now_ns);
+}
+
+static void ucpu_supervisor_start_attempt(ucpu_connection_t *ucpu_connection, uint64_t now_ns)
+{
+	ucpu_supervisor_t *supervisor = ucpu_connection->supervisor;
+
+	supervisor->report.attempts++;
+	supervisor->deadline_ns = now_ns + (uint64_t)supervisor->attempt_timeout_ms * 1000000;
+
+	ucpu_connection->sock = ucpu_l2cap_connect(&ucpu_connection->address, 1);
+	if (ucpu_connection->sock < 0) {
+		ucpu_supervisor_backoff(ucpu_connection, now_ns);
+		return;
+	}
+
+	supervisor->state = UCPU_SUPERVISOR_CONNECTING;
+	ucpu_supervisor_register(ucpu_connection, ucpu_connection->sock, UCPU_EVENT_WRITABLE);
+}
+
+static void ucpu_supervisor_connected(ucpu_connection_t *ucpu_connection, uint64_t now_ns)
+{
+	ucpu_supervisor_t *supervisor = ucpu_connection->supervisor;
+	int error = 0;
+	socklen_t error_len = sizeof(error);
+
+	/* The result of a non-blocking connect is available as a socket error. */
+	if (getsockopt(ucpu_connection->sock, SOL_SOCKET, SO_ERROR, &error, &error_len) != 0 || error != 0) {
+		ucpu_supervisor_backoff(ucpu_connection, now_ns);
+		return;
+	}
+
+	supervisor->report.connected_ns = now_ns - supervisor->report.lost_ns;
+	supervisor->state = UCPU_SUPERVISOR_DISCOVERING;
+	ucpu_supervisor_register(ucpu_connection, ucpu_connection->sock, UCPU_EVENT_READABLE);
+
+	/* A send error is reported by ucpu_supervisor_connection_lost. */
+	if (ucpu_discovery_start(ucpu_connection, &supervisor->discovery) != UCPU_DISCOVERY_IN_PROGRESS
+			&& supervisor->state == UCPU_SUPERVISOR_DISCOVERING) {
+		ucpu_supervisor_backoff(ucpu_connection, now_ns);
+	}
+}
+
+static void ucpu_supervisor_discovery_response(ucpu_connection_t *ucpu_connection, uint64_t now_ns)
+{
+	ucpu_supervisor_t *supervisor = ucpu_connection->supervisor;
+	int received_len;
+
+	/* The handle cache usually completes the discovery with a single response. */
+	while (supervisor->state == UCPU_SUPERVISOR_DISCOVERING) {
+		received_len = ucpu_att_receive(ucpu_connection);
+
+		if (received_len <= 0) {
+			return;
+		}
+
+		switch (ucpu_discovery_process(ucpu_connection, &supervisor->discovery, received_len)) {
+		case UCPU_DISCOVERY_IN_PROGRESS:
+			break;
+		case UCPU_DISCOVERY_COMPLETED:
+			ucpu_supervisor_ready(ucpu_connection, now_ns);
+			return;
+		default:
+			if (supervisor->state == UCPU_SUPERVISOR_DISCOVERING) {
+				ucpu_supervisor_backoff(ucpu_connection, now_ns);
+			}
+			return;
+		}
+	}
+}
+
+static int ucpu_supervisor_poll(int fd, short events)
+{
+	struct pollfd poll_fd;
+
+	poll_fd.fd = fd;
+	poll_fd.events = events;
+	poll_fd.revents = 0;
+
+	if (poll(&poll_fd, 1, 0) <= 0) {
+		return 0;
+	}
+	return poll_fd.revents;
+}
+
+int ucpu_supervisor_process(ucpu_connection_t *ucpu_connection)
+{
+	ucpu_supervisor_t *supervisor = ucpu_connection->supervisor;
+	uint64_t now_ns = ucpu_get_time_ns();
+
+	switch (supervisor->state) {
+	case UCPU_SUPERVISOR_BACKOFF:
+		if (now_ns >= supervisor->deadline_ns) {
+			ucpu_supervisor_start_attempt(ucpu_connection, now_ns);
+		}
+		break;
+	case UCPU_SUPERVISOR_CONNECTING:
+		if (ucpu_supervisor_poll(ucpu_connection->sock, POLLOUT) != 0) {
+			ucpu_supervisor_connected(ucpu_connection, now_ns);
+		}
+		break;
+	case UCPU_SUPERVISOR_DISCOVERING:
+		if (ucpu_supervisor_poll(ucpu_connection->sock, POLLIN) != 0) {
+			ucpu_supervisor_discovery_response(ucpu_connection, now_ns);
+		}
+		break;
+	case UCPU_SUPERVISOR_RESTORING:
+		if (now_ns >= supervisor->deadline_ns) {
+			ucpu_supervisor_restored(ucpu_connection, now_ns);
+		}
+		return supervisor->state;
+	default:
+		return supervisor->state;
+	}
+
+	/* The same deadline covers connecting and discovery. */
+	if ((supervisor->state == UCPU_SUPERVISOR_CONNECTING || supervisor->state == UCPU_SUPERVISOR_DISCOVERING)
+			&& now_ns >= supervisor->deadline_ns) {
+		ucpu_supervisor_backoff(ucpu_connection, now_ns);
+	}
+	return supervisor->state;
+}
+
+int ucpu_supervisor_timeout_ms(ucpu_connection_t *ucpu_connection)
+{
+	ucpu_supervisor_t *supervisor = ucpu_connection->supervisor;
+	uint64_t now_ns;
+
+	if (supervisor->state == UCPU_SUPERVISOR_CONNECTED) {
+		return -1;
+	}
+
+	now_ns = ucpu_get_time_ns();
+	if (now_ns >= supervisor->deadline_ns) {
+		return 0;
+	}
+	return (int)((supervisor->deadline_ns - now_ns + 999999) / 1000000);
+}
+
+void ucpu_supervisor_stop(ucpu_connection_t *ucpu_connection)
+{
+	ucpu_supervisor_t *supervisor = ucpu_connection->supervisor;
+
+	if (supervisor == NULL) {
+		return;
+	}
+
+	ucpu_supervisor_register(ucpu_connection, -1, 0);
+
+	/* The connection is not usable until the discovery is completed. */
+	if (supervisor->state == UCPU_SUPERVISOR_CONNECTING || supervisor->state == UCPU_SUPERVISOR_DISCOVERING) {
+		ucpu_connection->transport->close(ucpu_connection);
+	}
+
+	ucpu_connection->supervisor = NULL;
+}
+
+static void ucpu_supervisor_virtual_port_attached(ucpu_connection_t *ucpu_connection,
+	const hub_attached_io_attached_virtual_t *attached_virtual)
+{
+	ucpu_supervisor_t *supervisor = ucpu_connection->supervisor;
+	ucpu_supervised_virtual_port_t *virtual_port;
+	uint8_t port_id = attached_virtual->attached_io.port_id;
+	uint32_t i, pending = 0;
+
+	for (i = 0; i < supervisor->virtual_port_count; i++) {
+		virtual_port = supervisor->virtual_ports + i;
+
+		if (virtual_port->pending && virtual_port->port_id_a == attached_virtual->port_id_a
+				&& virtual_port->port_id_b == attached_virtual->port_id_b) {
+			virtual_port->pending = 0;
+			virtual_port->port_id = port_id;
+			supervisor->report.restored_virtual_ports++;
+
+			if (virtual_port->port.enabled && ucpu_port_input_format_setup(ucpu_connection, port_id,
+					virtual_port->port.mode, virtual_port->port.delta_interval, 1) == 0) {
+				supervisor->report.restored_subscriptions++;
+			}
+
+			for (i = 0; i < supervisor->virtual_port_count; i++) {
+				pending |= supervisor->virtual_ports[i].pending;
+			}
+
+			if (!pending && supervisor->state == UCPU_SUPERVISOR_RESTORING) {
+				ucpu_supervisor_restored(ucpu_connection, ucpu_get_time_ns());
+			}
+			return;
+		}
+	}
+
+	/* A new virtual port created by the application. */
+	if (supervisor->virtual_port_count < UCPU_SUPERVISOR_MAX_VIRTUAL_PORTS) {
+		virtual_port = supervisor->virtual_ports + supervisor->virtual_port_count++;
+		virtual_port->port_id = port_id;
+		virtual_port->port_id_a = attached_virtual->port_id_a;
+		virtual_port->port_id_b = attached_virtual->port_id_b;
+		virtual_port->pending = 0;
+	}
+}
+
+static void ucpu_supervisor_port_detached(ucpu_supervisor_t *supervisor, uint8_t port_id)
+{
+	uint32_t i;
+
+	supervisor->ports[port_id].enabled = 0;
+
+	/* Pending virtual ports may have the same (old) port id. */
+	for (i = 0; i < supervisor->virtual_port_count; i++) {
+		if (supervisor->virtual_ports[i].port_id == port_id && !supervisor->virtual_ports[i].pending) {
+			supervisor->virtual_ports[i] = supervisor->virtual_ports[--supervisor->virtual_port_count];
+			return;
+		}
+	}
+}
+
+void ucpu_supervisor_update(ucpu_connection_t *ucpu_connection, const uint8_t *packet, int packet_len)
+{
+	ucpu_supervisor_t *supervisor = ucpu_connection->supervisor;
+	const hub_port_input_format_single_t *input_format;
+	const hub_attached_io_t *attached_io;
+	ucpu_supervised_port_t *port;
+
+	switch (((const hub_common_message_header_t*)packet)->message_type) {
+	case HUB_PORT_INPUT_FORMAT_SINGLE:
+		if (packet_len < (int)sizeof(hub_port_input_format_single_t)) {
+			return;
+		}
+
+		/* The acknowledged setup is recorded, which is the current state of the Hub. */
+		input_format = (const hub_port_input_format_single_t*)packet;
+		port = supervisor->ports + input_format->port_id;
+		port->enabled = input_format->notification_enabled != 0;
+		port->mode = input_format->mode;
+		port->delta_interval = (uint32_t)input_format->delta_interval[0]
+			| ((uint32_t)input_format->delta_interval[1] << 8)
+			| ((uint32_t)input_format->delta_interval[2] << 16)
+			| ((uint32_t)input_format->delta_interval[3] << 24);
+		return;
+	case HUB_ATTACHED_IO:
+		if (packet_len < (int)sizeof(hub_attached_io_t)) {
+			return;
+		}
+
+		attached_io = (const hub_attached_io_t*)packet;
+
+		if (attached_io->event == HUB_ATTACHED_IO_DETACHED) {
+			ucpu_supervisor_port_detached(supervisor, attached_io->port_id);
+			return;
+		}
+
+		if (attached_io->event == HUB_ATTACHED_IO_ATTACHED_VIRTUAL
+				&& packet_len >= (int)sizeof(hub_attached_io_attached_virtual_t)) {
+			ucpu_supervisor_virtual_port_attached(ucpu_connection,
+				(const hub_attached_io_attached_virtual_t*)packet);
+		}
+		return;
+	}
+}
+
+void ucpu_supervisor_connection_lost(ucpu_connection_t *ucpu_connection)
+{
+	ucpu_supervisor_t *supervisor = ucpu_connection->supervisor;
+	ucpu_tx_queue_t *tx_queue = ucpu_connection->tx_queue;
+	uint64_t now_ns = ucpu_get_time_ns();
+
+	if (supervisor->state != UCPU_SUPERVISOR_CONNECTED && supervisor->state != UCPU_SUPERVISOR_RESTORING) {
+		/* The current attempt is failed. */
+		ucpu_supervisor_backoff(ucpu_connection, now_ns);
+		return;
+	}
+
+	if (supervisor->state == UCPU_SUPERVISOR_CONNECTED) {
+		memset(&supervisor->report, 0, sizeof(ucpu_reconnect_report_t));
+		supervisor->report.lost_ns = now_ns;
+	}
+
+	/* The closed socket is removed from the event loop automatically,
+	 * and the connection is added again when the discovery is completed. */
+	if (ucpu_connection->event_loop != NULL) {
+		supervisor->event_loop = ucpu_connection->event_loop;
+		ucpu_connection->event_loop = NULL;
+	}
+
+	/* Queued commands are outdated when the connection is restored. */
+	if (tx_queue != NULL) {
+		tx_queue->head = tx_queue->tail;
+		tx_queue->congested = 0;
+		tx_queue->write_wait = 0;
+	}
+
+	/* The first attempt is started immediately. */
+	supervisor->backoff_ms = supervisor->min_backoff_ms;
+	supervisor->state = UCPU_SUPERVISOR_BACKOFF;
+	supervisor->deadline_ns = now_ns;
+}
@@ -0,0 +1,182 @@
+/*
+ *    uc-powered-up (micro/universal c implementation of powered up, you see powered up, ...)
+ *
+ *    Copyright Zoltan Herczeg (hzmester@freemail.hu). All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright notice, this list of
+ *      conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *      of conditions and the following disclaimer in the documentation and/or other materials
+ *      provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER(S) AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER(S) OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Socket based transport. */
+
+/* Needed by recvmmsg and sendmmsg. */
+#define _GNU_SOURCE
+
+#include "globals.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+static int ucpu_socket_open(ucpu_connection_t *ucpu_connection, const void *parameters)
+{
+	ucpu_connection->sock = *(const int*)parameters;
+	return ucpu_connection->sock < 0;
+}
+
+int ucpu_socket_send(ucpu_connection_t *ucpu_connection, const void *packet, uint16_t packet_len)
+{
+	ssize_t ret = send(ucpu_connection->sock, packet, packet_len, MSG_NOSIGNAL);
+
+	if (ret == (ssize_t)packet_len) {
+		return 0;
+	}
+
+	if (ret < 0 && (errno == EWOULDBLOCK || errno == EAGAIN || errno == EINTR)) {
+		return UCPU_TRANSPORT_AGAIN;
+	}
+	return 1;
+}
+
+int ucpu_socket_send_batch(ucpu_connection_t *ucpu_connection, const struct iovec *packets, int count)
+{
+	struct mmsghdr msgs[UCPU_TX_QUEUE_SIZE];
+	int i, ret;
+
+	if (count > UCPU_TX_QUEUE_SIZE) {
+		count = UCPU_TX_QUEUE_SIZE;
+	}
+
+	for (i = 0; i < count; i++) {
+		memset(&msgs[i].msg_hdr, 0, sizeof(struct msghdr));
+		msgs[i].msg_hdr.msg_iov = (struct iovec*)(packets + i);
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	/* Sends packets until the socket buffer is full. */
+	ret = sendmmsg(ucpu_connection->sock, msgs, (unsigned int)count, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+	if (ret < 0) {
+		if (errno == EWOULDBLOCK || errno == EAGAIN || errno == EINTR) {
+			return 0;
+		}
+		return -1;
+	}
+	return ret;
+}
+
+int ucpu_socket_receive(ucpu_connection_t *ucpu_connection, uint8_t *buffer, int buffer_size)
+{
+	ssize_t ret = recv(ucpu_connection->sock, buffer, (size_t)buffer_size, 0);
+
+	if (ret > 0) {
+		return (int)ret;
+	}
+
+	/* Zero means the connection is closed by the Hub. */
+	if (ret < 0 && (errno == EWOULDBLOCK || errno == EAGAIN || errno == EINTR)) {
+		return 0;
+	}
+	return -1;
+}
+
+int ucpu_socket_receive_batch(ucpu_connection_t *ucpu_connection, ucpu_rx_packet_t **packets, int count)
+{
+	struct mmsghdr msgs[UCPU_RX_RING_SIZE];
+	struct iovec iovecs[UCPU_RX_RING_SIZE];
+	int i, ret;
+
+	if (count > UCPU_RX_RING_SIZE) {
+		count = UCPU_RX_RING_SIZE;
+	}
+
+	/* Packets are received directly into the storage of the packets. */
+	for (i = 0; i < count; i++) {
+		iovecs[i].iov_base = packets[i]->storage;
+		iovecs[i].iov_len = sizeof(packets[i]->storage);
+
+		memset(&msgs[i].msg_hdr, 0, sizeof(struct msghdr));
+		msgs[i].msg_hdr.msg_iov = iovecs + i;
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	/* Returns when no more packets are available. */
+	ret = recvmmsg(ucpu_connection->sock, msgs, (unsigned int)count, MSG_DONTWAIT, NULL);
+
+	if (ret < 0) {
+		if (errno == EWOULDBLOCK || errno == EAGAIN || errno == EINTR) {
+			return 0;
+		}
+		return -1;
+	}
+
+	for (i = 0; i < ret; i++) {
+		/* Zero means the connection is closed by the Hub. The packets
+		 * before it are returned, and the next call reports the error. */
+		if (msgs[i].msg_len == 0) {
+			return (i > 0) ? i : -1;
+		}
+
+		packets[i]->data = packets[i]->storage;
+		packets[i]->length = (int)msgs[i].msg_len;
+	}
+	return ret;
+}
+
+void ucpu_socket_close(ucpu_connection_t *ucpu_connection)
+{
+	if (ucpu_connection->sock >= 0) {
+		close(ucpu_connection->sock);
+		ucpu_connection->sock = -1;
+	}
+}
+
+const ucpu_transport_t ucpu_socket_transport = {
+	ucpu_socket_open,
+	ucpu_socket_send,
+	ucpu_socket_send_batch,
+	ucpu_socket_receive,
+	ucpu_socket_receive_batch,
+	ucpu_socket_close,
+};
+
+int ucpu_transport_open(ucpu_connection_t *ucpu_connection, const ucpu_transport_t *transport, const void *parameters)
+{
+	ucpu_connection_init(ucpu_connection);
+	ucpu_connection->transport = transport;
+
+	if (transport->open(ucpu_connection, parameters) != 0) {
+		ucpu_connection->sock = -1;
+		return 1;
+	}
+	return 0;
+}
+
+void ucpu_disconnect(ucpu_connection_t *ucpu_connection)
+{
+	if (ucpu_connection->event_loop != NULL) {
+		ucpu_event_loop_remove(ucpu_connection->event_loop, ucpu_connection);
+	}
+
+	if (ucpu_connection->sock >= 0) {
+		ucpu_connection->transport->close(ucpu_connection);
+	}
+}
@@ -0,0 +1,289 @@
+/*
+ *    uc-powered-up (micro/universal c implementation of powered up, you see powered up, ...)
+ *
+ *    Copyright Zoltan Herczeg (hzmester@freemail.hu). All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright notice, this list of
+ *      conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *      of conditions and the following disclaimer in the documentation and/or other materials
+ *      provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER(S) AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER(S) OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Latest value cache with lock-free readers. */
+
+#include "value_cache.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char ucpu_value_cache_magic[8] = { 'U', 'C', 'P', 'U', 'V', 'C', '0', '2' };
+
+static void ucpu_cached_value_write(ucpu_cached_value_t *cached_value, const uint8_t *data, int length,
+	uint64_t timestamp_ns)
+{
+	/* There is only one writer, so the counter is not changed by others. */
+	uint32_t sequence = atomic_load_explicit(&cached_value->sequence, memory_order_relaxed);
+
+	atomic_store_explicit(&cached_value->sequence, sequence + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	cached_value->length = (uint8_t)length;
+	cached_value->timestamp_ns = timestamp_ns;
+	memcpy(cached_value->data, data, (size_t)length);
+
+	atomic_store_explicit(&cached_value->sequence, sequence + 2, memory_order_release);
+}
+
+void ucpu_value_cache_init(ucpu_value_cache_t *value_cache)
+{
+	int i, j;
+
+	memset(value_cache->magic, 0, sizeof(value_cache->magic));
+	value_cache->size = (uint32_t)sizeof(ucpu_value_cache_t);
+	value_cache->reserved = 0;
+
+	for (i = 0; i < UCPU_VALUE_CACHE_PORTS; i++) {
+		atomic_init(&value_cache->modes[i], UCPU_VALUE_CACHE_CURRENT_MODE);
+
+		for (j = 0; j < UCPU_VALUE_CACHE_MODES; j++) {
+			atomic_init(&value_cache->values[i][j].sequence, 0);
+			value_cache->values[i][j].length = 0;
+			value_cache->values[i][j].timestamp_ns = 0;
+		}
+	}
+
+	/* Other processes accept the cache after the magic is set. */
+	atomic_thread_fence(memory_order_release);
+	memcpy(value_cache->magic, ucpu_value_cache_magic, sizeof(ucpu_value_cache_magic));
+}
+
+ucpu_value_cache_t *ucpu_value_cache_create_shared(const char *name)
+{
+	ucpu_value_cache_t *value_cache;
+	int fd;
+
+	fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	if (ftruncate(fd, sizeof(ucpu_value_cache_t)) != 0) {
+		close(fd);
+		shm_unlink(name);
+		return NULL;
+	}
+
+	value_cache = (ucpu_value_cache_t*)mmap(NULL, sizeof(ucpu_value_cache_t),
+		PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (value_cache == MAP_FAILED) {
+		shm_unlink(name);
+		return NULL;
+	}
+
+	ucpu_value_cache_init(value_cache);
+	return value_cache;
+}
+
+const ucpu_value_cache_t *ucpu_value_cache_open_shared(const char *name)
+{
+	const ucpu_value_cache_t *value_cache;
+	struct stat stat_buf;
+	int fd;
+
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	if (fstat(fd, &stat_buf) != 0 || stat_buf.st_size < (off_t)sizeof(ucpu_value_cache_t)) {
+		close(fd);
+		return NULL;
+	}
+
+	value_cache = (const ucpu_value_cache_t*)mmap(NULL, sizeof(ucpu_value_cache_t), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (value_cache == MAP_FAILED) {
+		return NULL;
+	}
+
+	/* The cache might be created by a different version of the library. */
+	if (memcmp(value_cache->magic, ucpu_value_cache_magic, sizeof(ucpu_value_cache_magic)) != 0
+			|| value_cache->size != sizeof(ucpu_value_cache_t)) {
+		ucpu_value_cache_unmap(value_cache);
+		return NULL;
+	}
+
+	atomic_thread_fence(memory_order_acquire);
+	return value_cache;
+}
+
+void ucpu_value_cache_unmap(const ucpu_value_cache_t *value_cache)
+{
+	munmap((void*)value_cache, sizeof(ucpu_value_cache_t));
+}
+
+void ucpu_value_cache_unlink(const char *name)
+{
+	shm_unlink(name);
+}
+
+void ucpu_value_cache_update(ucpu_connection_t *ucpu_connection, const uint8_t *packet, int message_length,
+	uint64_t timestamp_ns)
+{
+	ucpu_value_cache_t *value_cache = ucpu_connection->value_cache;
+	const hub_port_input_format_single_t *port_input_format_single;
+	const hub_attached_io_t *attached_io;
+	uint8_t port_id, mode;
+	int i;
+
+	switch (((const hub_common_message_header_t*)packet)->message_type) {
+	case HUB_PORT_VALUE_SINGLE:
+		if (ucpu_is_port_value_single_packet(packet, message_length) < 0
+				|| message_length > (int)(sizeof(hub_port_value_single_t) + UCPU_VALUE_CACHE_DATA_SIZE)) {
+			return;
+		}
+
+		port_id = ((const hub_port_value_single_t*)packet)->port_id;
+		if (port_id >= UCPU_VALUE_CACHE_PORTS) {
+			return;
+		}
+
+		/* Values of unknown modes are ignored. */
+		mode = atomic_load_explicit(&value_cache->modes[port_id], memory_order_relaxed);
+		if (mode >= UCPU_VALUE_CACHE_MODES) {
+			return;
+		}
+
+		ucpu_cached_value_write(&value_cache->values[port_id][mode], packet + sizeof(hub_port_value_single_t),
+			message_length - (int)sizeof(hub_port_value_single_t), timestamp_ns);
+		return;
+
+	case HUB_PORT_INPUT_FORMAT_SINGLE:
+		if (message_length < sizeof(hub_port_input_format_single_t)) {
+			return;
+		}
+
+		port_input_format_single = (const hub_port_input_format_single_t*)packet;
+		if (port_input_format_single->port_id < UCPU_VALUE_CACHE_PORTS) {
+			atomic_store_explicit(&value_cache->modes[port_input_format_single->port_id],
+				port_input_format_single->mode < UCPU_VALUE_CACHE_MODES
+					? port_input_format_single->mode : UCPU_VALUE_CACHE_CURRENT_MODE,
+				memory_order_release);
+		}
+		return;
+
+	case HUB_ATTACHED_IO:
+		if (ucpu_is_attached_io_update_packet(packet, message_length) != HUB_ATTACHED_IO_DETACHED) {
+			return;
+		}
+
+		attached_io = (const hub_attached_io_t*)packet;
+		if (attached_io->port_id >= UCPU_VALUE_CACHE_PORTS) {
+			return;
+		}
+
+		atomic_store_explicit(&value_cache->modes[attached_io->port_id], UCPU_VALUE_CACHE_CURRENT_MODE,
+			memory_order_release);
+
+		for (i = 0; i < UCPU_VALUE_CACHE_MODES; i++) {
+			if (value_cache->values[attached_io->port_id][i].length > 0) {
+				ucpu_cached_value_write(&value_cache->values[attached_io->port_id][i], packet, 0, timestamp_ns);
+			}
+		}
+		return;
+	}
+}
+
+uint8_t ucpu_value_cache_mode(const ucpu_value_cache_t *value_cache, uint8_t port_id)
+{
+	if (port_id >= UCPU_VALUE_CACHE_PORTS) {
+		return UCPU_VALUE_CACHE_CURRENT_MODE;
+	}
+	return atomic_load_explicit(&value_cache->modes[port_id], memory_order_acquire);
+}
+
+int ucpu_value_cache_read(const ucpu_value_cache_t *value_cache, uint8_t port_id, uint8_t mode,
+	uint8_t *data, uint64_t *timestamp_ns)
+{
+	const ucpu_cached_value_t *cached_value;
+	uint32_t sequence;
+	uint64_t value_timestamp_ns;
+	int length, retries;
+
+	if (mode == UCPU_VALUE_CACHE_CURRENT_MODE) {
+		mode = ucpu_value_cache_mode(value_cache, port_id);
+	}
+
+	if (port_id >= UCPU_VALUE_CACHE_PORTS || mode >= UCPU_VALUE_CACHE_MODES) {
+		return -1;
+	}
+
+	cached_value = &value_cache->values[port_id][mode];
+
+	for (retries = 0; ; retries++) {
+		if (retries == UCPU_VALUE_CACHE_READ_RETRIES) {
+			return -1;
+		}
+
+		sequence = atomic_load_explicit(&cached_value->sequence, memory_order_acquire);
+
+		if (sequence & 0x1) {
+			/* The entry is being written. */
+			continue;
+		}
+
+		/* The whole buffer is copied, since the length might be inconsistent. */
+		length = cached_value->length;
+		value_timestamp_ns = cached_value->timestamp_ns;
+		memcpy(data, cached_value->data, UCPU_VALUE_CACHE_DATA_SIZE);
+
+		atomic_thread_fence(memory_order_acquire);
+		if (atomic_load_explicit(&cached_value->sequence, memory_order_relaxed) == sequence) {
+			break;
+		}
+	}
+
+	if (timestamp_ns != NULL) {
+		*timestamp_ns = value_timestamp_ns;
+	}
+	return length;
+}
+
+int ucpu_value_cache_read_decoded(const ucpu_value_cache_t *value_cache, uint8_t port_id, uint8_t mode,
+	const ucpu_value_decoder_t *value_decoder, int32_t *values, uint64_t *timestamp_ns)
+{
+	uint8_t data[UCPU_VALUE_CACHE_DATA_SIZE];
+	int length = ucpu_value_cache_read(value_cache, port_id, mode, data, timestamp_ns);
+
+	if (length <= 0) {
+		return length;
+	}
+
+	if (length < value_decoder->dataset_count * value_decoder->dataset_size) {
+		return -1;
+	}
+
+	value_decoder->decode(value_decoder, data, values);
+	return value_decoder->dataset_count;
+}
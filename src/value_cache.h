@@ -0,0 +1,102 @@
+/*
+ *    uc-powered-up (micro/universal c implementation of powered up, you see powered up, ...)
+ *
+ *    Copyright Zoltan Herczeg (hzmester@freemail.hu). All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright notice, this list of
+ *      conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *      of conditions and the following disclaimer in the documentation and/or other materials
+ *      provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER(S) AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER(S) OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef VALUE_CACHE_H_
+#define VALUE_CACHE_H_
+
+#include "globals.h"
+
+#include <stdatomic.h>
+
+/* Latest value cache. When a cache is set for a connection, the data of each
+ * HUB_PORT_VALUE_SINGLE message is stored into a table indexed by port and mode,
+ * together with its receive time. The mode of a port is tracked from the
+ * HUB_PORT_INPUT_FORMAT_SINGLE messages sent by the Hub after a port input
+ * format setup, so the cache must be set before the notifications are enabled.
+ * Values of detached ports are removed.
+ *
+ * The cache is written by the thread which receives the notifications, and it
+ * can be read by any number of threads without locks: each entry is protected
+ * by a sequence counter, which is odd while the entry is written, and readers
+ * retry when it changes during the read. Readers never delay the writer. The
+ * cache can also be placed in POSIX shared memory, which allows other processes
+ * to read the values without any communication. */
+
+#define UCPU_VALUE_CACHE_PORTS 128
+#define UCPU_VALUE_CACHE_MODES 16
+#define UCPU_VALUE_CACHE_DATA_SIZE 48
+/* Selects the current mode of a port. Also used when the mode is unknown. */
+#define UCPU_VALUE_CACHE_CURRENT_MODE 0xff
+
+/* Readers give up after this many attempts, e.g. when the writer process dies
+ * while it updates an entry. */
+#define UCPU_VALUE_CACHE_READ_RETRIES 100000
+
+/* The size and the alignment of an entry is 64 bytes, so each entry has its own
+ * cache line. The cache must be allocated with this alignment (shared caches are
+ * page aligned). */
+typedef struct {
+	_Alignas(64) _Atomic uint32_t sequence;
+	/* Zero when no value is received. */
+	uint8_t length;
+	uint8_t reserved[3];
+	uint64_t timestamp_ns;
+	uint8_t data[UCPU_VALUE_CACHE_DATA_SIZE];
+} ucpu_cached_value_t;
+
+struct ucpu_value_cache {
+	/* Identifies the layout for other processes. */
+	char magic[8];
+	uint32_t size;
+	uint32_t reserved;
+	_Atomic uint8_t modes[UCPU_VALUE_CACHE_PORTS];
+	ucpu_cached_value_t values[UCPU_VALUE_CACHE_PORTS][UCPU_VALUE_CACHE_MODES];
+};
+
+void ucpu_value_cache_init(ucpu_value_cache_t *value_cache);
+/* Creates (or replaces) a cache in shared memory. The name must start with a slash.
+ * Returns with NULL on error. */
+ucpu_value_cache_t *ucpu_value_cache_create_shared(const char *name);
+/* Maps a shared cache created by another process for reading. Returns with NULL on error. */
+const ucpu_value_cache_t *ucpu_value_cache_open_shared(const char *name);
+void ucpu_value_cache_unmap(const ucpu_value_cache_t *value_cache);
+/* Removes the name of a shared cache. Mapped caches remain valid. */
+void ucpu_value_cache_unlink(const char *name);
+
+/* Returns with the current mode of a port, or UCPU_VALUE_CACHE_CURRENT_MODE if it is unknown. */
+uint8_t ucpu_value_cache_mode(const ucpu_value_cache_t *value_cache, uint8_t port_id);
+/* Copies the latest value of a port mode into data, which must have UCPU_VALUE_CACHE_DATA_SIZE
+ * bytes. The timestamp_ns can be NULL. Returns with the length of the value, 0 when no value
+ * is available, or -1 when the port or mode is out of range, or no consistent value could be
+ * read in UCPU_VALUE_CACHE_READ_RETRIES attempts. */
+int ucpu_value_cache_read(const ucpu_value_cache_t *value_cache, uint8_t port_id, uint8_t mode,
+	uint8_t *data, uint64_t *timestamp_ns);
+/* Same as ucpu_value_cache_read, except the value is decoded. Returns with the number
+ * of datasets, 0 when no value is available, or -1 on error. */
+int ucpu_value_cache_read_decoded(const ucpu_value_cache_t *value_cache, uint8_t port_id, uint8_t mode,
+	const ucpu_value_decoder_t *value_decoder, int32_t *values, uint64_t *timestamp_ns);
+
+#endif /* VALUE_CACHE_H_ */
@@ -0,0 +1,105 @@
+/*
+ *    uc-powered-up (micro/universal c implementation of powered up, you see powered up, ...)
+ *
+ *    Copyright Zoltan Herczeg (hzmester@freemail.hu). All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright notice, this list of
+ *      conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *      of conditions and the following disclaimer in the documentation and/or other materials
+ *      provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER(S) AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER(S) OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "broker.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* This test connects to the first Hub of a running broker daemon (ucpu-broker),
+ * receives the tilt sensor values for one second, and runs the motor on port 0.
+ * Multiple instances can run at the same time: each instance receives only the
+ * feedbacks of its own commands, and a motor command discarded by the command
+ * of another instance is repeated after that one is finished. The optional
+ * argument is the path of the broker socket. The daemon can be started with a
+ * simulated Hub: "ucpu-broker -s". */
+
+int main(int argc, char **argv)
+{
+	ucpu_connection_t ucpu_connection;
+	ucpu_broker_client_t broker_client;
+	ucpu_feedback_tracker_t feedback_tracker;
+	ucpu_rx_ring_t rx_ring;
+	uint64_t start_ns, value_count = 0;
+	int i, attempt, status;
+
+	if (ucpu_broker_connect(&ucpu_connection, &broker_client,
+			argc > 1 ? argv[1] : UCPU_BROKER_DEFAULT_PATH, 0) != 0) {
+		printf("Cannot connect to the broker\n");
+		return 1;
+	}
+
+	ucpu_feedback_tracker_init(&feedback_tracker);
+	ucpu_connection.feedback_tracker = &feedback_tracker;
+	ucpu_rx_ring_init(&rx_ring);
+
+	ucpu_port_input_format_setup(&ucpu_connection, 99, 0, 1, 1);
+
+	start_ns = ucpu_get_time_ns();
+	while (ucpu_get_time_ns() - start_ns < 1000000000) {
+		if (ucpu_wait_for_notification(&ucpu_connection, 100) < 0
+				|| ucpu_att_receive_batch(&ucpu_connection, &rx_ring) < 0) {
+			return 1;
+		}
+
+		for (i = 0; i < UCPU_RX_RING_COUNT(&rx_ring); i++) {
+			ucpu_rx_packet_t *packet = UCPU_RX_RING_PEEK(&rx_ring, i);
+
+			if (ucpu_is_port_value_single_packet(packet->data, packet->length) == 99) {
+				value_count++;
+			}
+		}
+
+		UCPU_RX_RING_CONSUME(&rx_ring, UCPU_RX_RING_COUNT(&rx_ring));
+	}
+
+	/* The notifications are shared, so they are disabled only when no other client uses them. */
+	printf("Received %llu tilt values in one second (%llu lost)\n", (unsigned long long)value_count,
+		(unsigned long long)broker_client.lost_count);
+	if (value_count == 0) {
+		ucpu_disconnect(&ucpu_connection);
+		return 1;
+	}
+
+	start_ns = ucpu_get_time_ns();
+	for (attempt = 0; attempt < 5; attempt++) {
+		ucpu_motor_start_speed_for_time(&ucpu_connection, 0, 200, 50, 100, HUB_MOTOR_END_STATE_BRAKE, 0);
+		status = ucpu_feedback_wait(&ucpu_connection, 0, ucpu_feedback_last_token(&ucpu_connection, 0), 1000, NULL);
+
+		if (status != UCPU_COMMAND_DISCARDED) {
+			break;
+		}
+
+		printf("Motor command discarded by another client\n");
+		usleep(200000);
+	}
+	printf("Motor command %s in %d ms\n", status == UCPU_COMMAND_COMPLETED ? "completed" : "failed",
+		(int)((ucpu_get_time_ns() - start_ns) / 1000000));
+
+	ucpu_disconnect(&ucpu_connection);
+	return status == UCPU_COMMAND_COMPLETED ? 0 : 1;
+}
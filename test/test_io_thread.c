@@ -0,0 +1,122 @@
+/*
+ *    uc-powered-up (micro/universal c implementation of powered up, you see powered up, ...)
+ *
+ *    Copyright Zoltan Herczeg (hzmester@freemail.hu). All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright notice, this list of
+ *      conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *      of conditions and the following disclaimer in the documentation and/or other materials
+ *      provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER(S) AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER(S) OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "simulator.h"
+#include "io_thread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* This test runs without a Hub: the connection to a simulated Hub is owned by an
+ * I/O thread. A control thread sends motor commands through a proxy connection,
+ * while the main thread consumes the tilt sensor values and the command feedbacks
+ * from a notification ring. */
+
+static ucpu_io_thread_t io_thread;
+static ucpu_notification_ring_t notification_ring;
+
+static void *control_thread(void *arg)
+{
+	ucpu_connection_t proxy;
+	int i;
+
+	if (ucpu_io_thread_open_proxy(&io_thread, &proxy, 0) != 0) {
+		return NULL;
+	}
+
+	ucpu_port_input_format_setup(&proxy, 99, 0, 1, 1);
+
+	for (i = 0; i < 10; i++) {
+		ucpu_motor_start_speed_for_time(&proxy, 0, 50, (int8_t)(i * 10), 100, HUB_MOTOR_END_STATE_BRAKE, 0);
+		usleep(100000);
+	}
+
+	ucpu_port_input_format_setup(&proxy, 99, 0, 1, 0);
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	ucpu_simulator_t simulator;
+	ucpu_connection_t ucpu_connection;
+	ucpu_notification_t notification;
+	pthread_t thread;
+	uint64_t start_ns, value_count = 0, feedback_count = 0;
+
+	ucpu_simulator_init(&simulator);
+	ucpu_simulator_add_device(&simulator, 0, 0x30, 4, 0);
+	ucpu_simulator_add_device(&simulator, 99, 0x3b, 6, 1000);
+
+	if (ucpu_simulator_start(&simulator, &ucpu_connection) != 0) {
+		return 1;
+	}
+
+	if (ucpu_notification_ring_init(&notification_ring) != 0
+			|| ucpu_io_thread_init(&io_thread, &ucpu_connection, 1) != 0) {
+		return 1;
+	}
+
+	ucpu_notification_ring_subscribe_port(&notification_ring, 99);
+	ucpu_notification_ring_subscribe(&notification_ring, PORT_OUTPUT_COMMAND_FEEDBACK);
+	ucpu_io_thread_add_consumer(&io_thread, &notification_ring);
+
+	if (ucpu_io_thread_start(&io_thread) != 0
+			|| pthread_create(&thread, NULL, control_thread, NULL) != 0) {
+		return 1;
+	}
+
+	start_ns = ucpu_get_time_ns();
+	while (ucpu_get_time_ns() - start_ns < 1200000000) {
+		if (ucpu_notification_ring_wait(&notification_ring, 100) < 0) {
+			break;
+		}
+
+		while (ucpu_notification_ring_pop(&notification_ring, &notification)) {
+			if (notification.message_type == PORT_OUTPUT_COMMAND_FEEDBACK) {
+				feedback_count++;
+			} else if (ucpu_is_port_value_single_packet(notification.data, notification.length) == 99) {
+				value_count++;
+			}
+		}
+	}
+
+	pthread_join(thread, NULL);
+	ucpu_io_thread_stop(&io_thread);
+	ucpu_io_thread_free(&io_thread);
+	ucpu_simulator_stop(&simulator);
+	ucpu_disconnect(&ucpu_connection);
+
+	printf("Received %llu tilt values and %llu feedbacks (%u dropped)\n", (unsigned long long)value_count,
+		(unsigned long long)feedback_count, (unsigned)atomic_load(&notification_ring.dropped));
+	printf("I/O thread: %llu commands sent, %llu packets received\n",
+		(unsigned long long)atomic_load(&io_thread.sent_count), (unsigned long long)atomic_load(&io_thread.received_count));
+
+	ucpu_notification_ring_free(&notification_ring);
+
+	/* Each of the ten motor commands gets at least one feedback. */
+	return value_count == 0 || feedback_count < 10 ? 1 : 0;
+}
@@ -28,23 +28,133 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <unistd.h>
+
+#define LED_PORT 50
+
+typedef struct {
+	ucpu_connection_t *connection;
+	int action_id;
+	uint8_t color;
+} led_animation_t;
+
+int led_attached(ucpu_connection_t *ucpu_connection,
+	const hub_common_message_header_t *message, int message_length, void *user_data)
+{
+	return ucpu_is_attached_io_update_packet((const uint8_t*)message, message_length) == HUB_ATTACHED_IO_ATTACHED
+		&& ((const hub_attached_io_t*)message)->port_id == LED_PORT;
+}
+
+void set_next_color(ucpu_scheduler_t *scheduler, int action_id, uint64_t deadline_ns, void *user_data)
+{
+	led_animation_t *animation = (led_animation_t*)user_data;
+
+	printf("Set color to %d\n", animation->color);
+	ucpu_set_led_color(animation->connection, LED_PORT, animation->color);
+	animation->color++;
+}
+
+void start_animation(ucpu_scheduler_t *scheduler, uint32_t stage, uint64_t start_ns, void *user_data)
+{
+	led_animation_t *animation = (led_animation_t*)user_data;
+
+	/* The color is changed every second, counted from the start of the stage. */
+	animation->color = 0;
+	animation->action_id = ucpu_scheduler_add_action(scheduler, start_ns, 1000000, set_next_color, animation);
+}
+
+void stop_animation(ucpu_scheduler_t *scheduler, uint32_t stage, uint64_t start_ns, void *user_data)
+{
+	led_animation_t *animation = (led_animation_t*)user_data;
+
+	ucpu_scheduler_remove_action(scheduler, animation->action_id);
+	printf("Animation completed\n");
+}
+
+void print_deadline_miss(ucpu_scheduler_t *scheduler, const ucpu_deadline_miss_t *miss, void *user_data)
+{
+	printf("Deadline missed by %s %d: %.3f ms late, %d period(s) skipped\n",
+		miss->type == UCPU_DEADLINE_STAGE ? "stage" : "action", (int)miss->index,
+		miss->late_ns / 1e6, (int)miss->skipped);
+}
 
 int main(int argc, char **argv)
 {
 	ucpu_connection_t ucpu_connection;
-	int i;
+	ucpu_event_loop_t event_loop;
+	ucpu_event_t events[4];
+	ucpu_scheduler_t scheduler;
+	led_animation_t animation;
+	ucpu_stage_t stages[3];
+	int i, event_count, received_bytes;
 
-	if (ucpu_connect_to_hub(&ucpu_connection) != 0) {
+	if (ucpu_connect_to_hub_arg(&ucpu_connection, argc, argv) != 0) {
 		return 1;
 	}
 
-	for (i = 0; i <= 10; i++) {
-		printf("Set color to %d\n", i);
-		ucpu_set_led_color(&ucpu_connection, 50, i);
-		sleep(1);
+	animation.connection = &ucpu_connection;
+	animation.action_id = -1;
+
+	/* Stage 0: wait until the LED is reported by the Hub. */
+	stages[0].enter = NULL;
+	stages[0].trigger = led_attached;
+	stages[0].duration_ms = 0;
+	stages[0].user_data = NULL;
+
+	/* Stage 1: show 11 colors, one in every second. */
+	stages[1].enter = start_animation;
+	stages[1].trigger = NULL;
+	stages[1].duration_ms = 11000;
+	stages[1].user_data = &animation;
+
+	stages[2].enter = stop_animation;
+	stages[2].trigger = NULL;
+	stages[2].duration_ms = 0;
+	stages[2].user_data = &animation;
+
+	/* Deadlines later than 2 ms are reported. */
+	if (ucpu_scheduler_init(&scheduler, 2000) != 0) {
+		ucpu_disconnect(&ucpu_connection);
+		return 1;
 	}
+	ucpu_scheduler_set_miss_handler(&scheduler, print_deadline_miss, NULL);
+
+	/* Notifications are processed while the scheduler waits for the next deadline. */
+	if (ucpu_event_loop_init(&event_loop) != 0
+			|| ucpu_event_loop_add(&event_loop, &ucpu_connection) != 0
+			|| ucpu_event_loop_add_fd(&event_loop, scheduler.timer_fd, UCPU_EVENT_READABLE, &scheduler) != 0
+			|| ucpu_scheduler_start(&scheduler, stages, 3, 0) != 0) {
+		ucpu_disconnect(&ucpu_connection);
+		ucpu_scheduler_free(&scheduler);
+		return 1;
+	}
+
+	while (scheduler.stage < 2) {
+		event_count = ucpu_event_loop_wait(&event_loop, events, 4, -1);
+		if (event_count < 0) {
+			break;
+		}
+
+		for (i = 0; i < event_count; i++) {
+			if (events[i].connection == NULL) {
+				ucpu_scheduler_process(&scheduler);
+				continue;
+			}
+
+			received_bytes = ucpu_att_receive(&ucpu_connection);
+			if (received_bytes == -1) {
+				ucpu_event_loop_free(&event_loop);
+				ucpu_scheduler_free(&scheduler);
+				return 1;
+			}
+
+			ucpu_scheduler_notify(&scheduler, &ucpu_connection, ucpu_connection.rsp_buf, received_bytes);
+		}
+	}
+
+	printf("Missed deadlines: %d (max %.3f ms)\n", (int)scheduler.miss_count, scheduler.max_late_ns / 1e6);
 
-	close(ucpu_connection.sock);
+	ucpu_disconnect(&ucpu_connection);
+	ucpu_event_loop_free(&event_loop);
+	ucpu_scheduler_free(&scheduler);
 	return 0;
 }
@@ -33,11 +33,13 @@
 int main(int argc, char **argv)
 {
 	ucpu_connection_t ucpu_connection;
+	ucpu_feedback_tracker_t feedback_tracker;
+	ucpu_pipeline_t pipeline;
 	hub_attached_io_attached_virtual_t *attached_io_attached_virtual;
 	int received_bytes;
 	uint8_t port_id;
 
-	if (ucpu_connect_to_hub(&ucpu_connection) != 0) {
+	if (ucpu_connect_to_hub_arg(&ucpu_connection, argc, argv) != 0) {
 		return 1;
 	}
 
@@ -67,7 +69,7 @@ int main(int argc, char **argv)
 				/* Only this port connection should happen. */
 				if (attached_io_attached_virtual->port_id_a != 0 || attached_io_attached_virtual->port_id_b != 1) {
 					printf("Unexpected virtual port creation\n");
-					close(ucpu_connection.sock);
+					ucpu_disconnect(&ucpu_connection);
 					return 1;
 				}
 
@@ -78,13 +80,22 @@ int main(int argc, char **argv)
 		}
 	}
 
-	/* Move forward for 3 sec, than backwards for 3 sec. */
-	ucpu_motor_start_speed(&ucpu_connection, port_id, -70, 70, 0);
-	sleep(3);
-	ucpu_motor_start_speed(&ucpu_connection, port_id, 70, 70, 0);
-	sleep(3);
-	ucpu_motor_start_speed(&ucpu_connection, port_id, 0, 0, 0);
+	/* Move forward for 3 sec, than backwards for 3 sec. Both moves are timed by the Hub,
+	 * and the second one is buffered by the Hub, so it starts without a delay. */
+	ucpu_feedback_tracker_init(&feedback_tracker);
+	ucpu_connection.feedback_tracker = &feedback_tracker;
+	ucpu_pipeline_init(&pipeline, 2, PORT_OUTPUT_STARTUP_BUFFER);
+	ucpu_pipeline_add_port(&pipeline, port_id);
+	ucpu_connection.pipeline = &pipeline;
 
-	close(ucpu_connection.sock);
+	ucpu_motor_start_speed_for_time(&ucpu_connection, port_id, 3000, -70, 70, HUB_MOTOR_END_STATE_FLOAT, 0);
+	ucpu_motor_start_speed_for_time(&ucpu_connection, port_id, 3000, 70, 70, HUB_MOTOR_END_STATE_BRAKE, 0);
+
+	if (ucpu_feedback_wait(&ucpu_connection, port_id, ucpu_feedback_last_token(&ucpu_connection, port_id),
+			10000, NULL) != UCPU_COMMAND_COMPLETED) {
+		printf("Motor commands are not completed\n");
+	}
+
+	ucpu_disconnect(&ucpu_connection);
 	return 0;
 }
@@ -31,165 +31,109 @@
 #include <unistd.h>
 #include <sys/socket.h>
 
-void print_attached_io_update(ucpu_connection_t *ucpu_connection, int update_type)
+void print_attached_io_update(ucpu_connection_t *ucpu_connection,
+	const hub_common_message_header_t *message, int message_length, void *user_data)
 {
-	hub_attached_io_t *attached_io = (hub_attached_io_t*)ucpu_connection->rsp_buf;
-	uint8_t io_type_id[2];
+	uint8_t port_id = ((const hub_attached_io_t*)message)->port_id;
+	/* The registry is updated before the handlers are called. */
+	const ucpu_port_info_t *port_info = ucpu_port_lookup(ucpu_connection, port_id);
 
-	if (update_type == HUB_ATTACHED_IO_DETACHED) {
-		printf("Port %d detached\n", attached_io->port_id);
+	if (ucpu_is_attached_io_update_packet((const uint8_t*)message, message_length) < 0) {
 		return;
 	}
 
-	if (update_type == HUB_ATTACHED_IO_ATTACHED) {
-		printf("Port %d attached\n", attached_io->port_id);
-		io_type_id[0] = ((hub_attached_io_attached_t*)attached_io)->io_type_id[0];
-		io_type_id[1] = ((hub_attached_io_attached_t*)attached_io)->io_type_id[1];
+	if (port_info == NULL) {
+		printf("Port %d detached\n", port_id);
+		return;
+	}
+
+	if (port_info->state == HUB_ATTACHED_IO_ATTACHED) {
+		printf("Port %d attached\n", port_id);
 	} else {
 		/* Should not happen since this port type can only be created from software. */
-		printf("Virtual port %d attached\n", attached_io->port_id);
-		io_type_id[0] = ((hub_attached_io_attached_t*)attached_io)->io_type_id[0];
-		io_type_id[1] = ((hub_attached_io_attached_t*)attached_io)->io_type_id[1];
+		printf("Virtual port %d (%d + %d) attached\n", port_id, port_info->port_id_a, port_info->port_id_b);
 	}
 
-	if (io_type_id[1] != 0) {
-		printf("    Unknown device: 0x%2x%2x\n", io_type_id[0], io_type_id[1]);
+	if (port_info->io_type == NULL) {
+		printf("    Unknown device: 0x%04x\n", port_info->io_type_id);
 		return;
 	}
 
-	switch (io_type_id[0]) {
-	case 0x01:
-		printf("    Basic motor\n");
-		break;
-	case 0x02:
-		printf("    System Train Motor\n");
-		break;
-	case 0x05:
-		printf("    Button\n");
-		break;
-	case 0x08:
-		printf("    LED light\n");
-		break;
-	case 0x14:
-		printf("    Voltage sensor\n");
-		break;
-	case 0x15:
-		printf("    Current sensor\n");
-		break;
-	case 0x16:
-		printf("    Piezo tone (sound)\n");
-		break;
-	case 0x17:
-		printf("    Hub LED light\n");
-		break;
-	case 0x22:
-		printf("    External tilt sensor\n");
-		break;
-	case 0x23:
-		printf("    Motion sensor\n");
-		break;
-	case 0x25:
-		printf("    Color distance sensor\n");
-		break;
-	case 0x26:
-		printf("    External motor with tacho\n");
-		break;
-	case 0x27:
-		printf("    Internal motor with tacho\n");
-		break;
-	case 0x28:
-		printf("    Internal tilt sensor\n");
-		break;
-	case 0x29:
-		printf("    Duplo train motor\n");
-		break;
-	case 0x2a:
-		printf("    Duplo train speaker\n");
-		break;
-	case 0x2b:
-		printf("    Duplo train color sensor\n");
-		break;
-	case 0x2c:
-		printf("    Duplo train speedometer\n");
-		break;
-	case 0x2e:
-		printf("    Technic large motor\n");
-		break;
-	case 0x2f:
-		printf("    Technic extra large motor\n");
-		break;
-	case 0x30:
-		printf("    Technic medium angular motor\n");
-		break;
-	case 0x31:
-		printf("    Technic large angular motor\n");
-		break;
-	case 0x36:
-		printf("    Hub gest sensor\n");
-		break;
-	case 0x37:
-		printf("    Remote control button\n");
-		break;
-	case 0x38:
-		printf("    Remote control RSSI\n");
-		break;
-	case 0x39:
-		printf("    Hub accelerometer\n");
-		break;
-	case 0x3a:
-		printf("    Hub gyro sensor\n");
-		break;
-	case 0x3b:
-		printf("    Hub tilt sensor\n");
-		break;
-	case 0x3c:
-		printf("    Hub temperature sensor\n");
-		break;
-	case 0x3d:
-		printf("    Color sensor\n");
-		break;
-	case 0x3e:
-		printf("    Distance sensor\n");
-		break;
-	case 0x3f:
-		printf("    Force sensor\n");
-		break;
-	case 0x4b:
-		printf("    Technic medium angular motor (grey)\n");
-		break;
-	case 0x4e:
-		printf("    Technic large angular motor (grey)\n");
-		break;
-	default:
-		printf("    Unknown device: 0x%2x%2x\n", io_type_id[0], io_type_id[1]);
-		break;
-	}
+	printf("    %s\n", port_info->io_type->name);
 }
 
 int main(int argc, char **argv)
 {
 	ucpu_connection_t ucpu_connection;
-	int received_bytes;
+	ucpu_event_loop_t event_loop;
+	ucpu_event_t events[4];
+	ucpu_dispatcher_t dispatcher;
+	ucpu_port_registry_t port_registry;
+	ucpu_supervisor_t supervisor;
+	uint32_t reconnect_count = 0;
+	int i, event_count, received_bytes;
 
-	if (ucpu_connect_to_hub(&ucpu_connection) != 0) {
+	if (ucpu_connect_to_hub_arg(&ucpu_connection, argc, argv) != 0) {
+		return 1;
+	}
+
+	ucpu_port_registry_init(&port_registry);
+	ucpu_connection.port_registry = &port_registry;
+
+	/* The connection is restored when the Hub is switched off and on again. */
+	ucpu_supervisor_init(&supervisor, 250, 4000, 5000);
+	ucpu_connection.supervisor = &supervisor;
+
+	ucpu_dispatcher_init(&dispatcher);
+	ucpu_dispatcher_set_handler(&dispatcher, HUB_ATTACHED_IO, print_attached_io_update, NULL);
+
+	/* The event loop can wait for multiple Hubs, although only one is used here. */
+	if (ucpu_event_loop_init(&event_loop) != 0
+			|| ucpu_event_loop_add(&event_loop, &ucpu_connection) != 0) {
+		ucpu_disconnect(&ucpu_connection);
 		return 1;
 	}
 
 	while (1) {
-		received_bytes = ucpu_att_receive(&ucpu_connection);
-		if (received_bytes == -1) {
-			return 1;
+		event_count = ucpu_event_loop_wait(&event_loop, events, 4, ucpu_supervisor_timeout_ms(&ucpu_connection));
+		if (event_count < 0) {
+			break;
 		}
 
-		if (received_bytes > 0 && ucpu_is_notification(&ucpu_connection, received_bytes)) {
-			int update_type = ucpu_is_attached_io_update(&ucpu_connection, received_bytes);
+		for (i = 0; i < event_count; i++) {
+			ucpu_connection_t *connection = events[i].connection;
+
+			/* Events of the reconnect attempts are processed below. */
+			if (connection == NULL) {
+				continue;
+			}
 
-			if (update_type >= 0) {
-				print_attached_io_update(&ucpu_connection, update_type);
+			received_bytes = ucpu_att_receive(connection);
+			if (received_bytes == -1) {
+				printf("Connection lost, reconnecting\n");
+				break;
 			}
+
+			ucpu_dispatch(&dispatcher, connection, connection->rsp_buf, received_bytes);
+		}
+
+		if (supervisor.state != UCPU_SUPERVISOR_CONNECTED) {
+			ucpu_supervisor_process(&ucpu_connection);
+		}
+
+		/* The restore may be completed by a received notification. */
+		if (supervisor.reconnect_count != reconnect_count) {
+			reconnect_count = supervisor.reconnect_count;
+			printf("Reconnected after %d attempt(s): connected: %.1f ms ready: %.1f ms restored: %.1f ms"
+				" (%d subscription(s), %d virtual port(s))\n", (int)supervisor.report.attempts,
+				supervisor.report.connected_ns / 1e6, supervisor.report.ready_ns / 1e6,
+				supervisor.report.restored_ns / 1e6, (int)supervisor.report.restored_subscriptions,
+				(int)supervisor.report.restored_virtual_ports);
 		}
 	}
 
-	close(ucpu_connection.sock);
+	ucpu_supervisor_stop(&ucpu_connection);
+	ucpu_disconnect(&ucpu_connection);
+	ucpu_event_loop_free(&event_loop);
 	return 0;
 }
@@ -0,0 +1,255 @@
+/*
+ *    uc-powered-up (micro/universal c implementation of powered up, you see powered up, ...)
+ *
+ *    Copyright Zoltan Herczeg (hzmester@freemail.hu). All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright notice, this list of
+ *      conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *      of conditions and the following disclaimer in the documentation and/or other materials
+ *      provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER(S) AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER(S) OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "simulator.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* This test runs without a Hub: a simulated Hub reports a motor on port 0 and
+ * a tilt sensor on port 99. The tilt sensor values are received for one second,
+ * and a timed motor command is executed. Then several speed changes are queued
+ * while the transmit queue is not flushed, and only the last one should be sent,
+ * but a command without completion feedback must not replace one with feedback.
+ * All packets are recorded, and the recording is checked at the end. It can be
+ * replayed by "ucpu-bench -r <recording> dispatch". The optional arguments are
+ * the time between two tilt sensor values in microseconds, and the path of the
+ * recording. */
+
+int main(int argc, char **argv)
+{
+	ucpu_simulator_t simulator;
+	ucpu_connection_t ucpu_connection;
+	ucpu_port_registry_t port_registry;
+	ucpu_feedback_tracker_t feedback_tracker;
+	ucpu_subscription_manager_t subscription_manager;
+	ucpu_rx_ring_t rx_ring;
+	ucpu_tx_queue_t tx_queue;
+	ucpu_recorder_t recorder;
+	ucpu_record_reader_t record_reader;
+	const ucpu_record_t *record;
+	const char *recording_path = "/tmp/test-simulator.rec";
+	uint64_t record_counts[2] = { 0, 0 };
+	const ucpu_port_info_t *port_info;
+	const hub_motor_start_speed_t *queued_command;
+	hub_motor_start_speed_t motor_start_speed;
+	uint32_t period_us = 1000;
+	uint64_t start_ns, value_count = 0;
+	int i, status, feedback_count;
+
+	if (argc > 1) {
+		period_us = (uint32_t)atoi(argv[1]);
+	}
+
+	if (argc > 2) {
+		recording_path = argv[2];
+	}
+
+	ucpu_simulator_init(&simulator);
+	ucpu_simulator_add_device(&simulator, 0, 0x30, 4, 0);
+	ucpu_simulator_add_device(&simulator, 99, 0x3b, 6, period_us);
+
+	if (ucpu_simulator_start(&simulator, &ucpu_connection) != 0) {
+		return 1;
+	}
+
+	/* The recorder appends to existing files. */
+	unlink(recording_path);
+	if (ucpu_recorder_open(&recorder, recording_path) != 0) {
+		printf("Cannot create recording: %s\n", recording_path);
+		return 1;
+	}
+	ucpu_connection.recorder = &recorder;
+
+	ucpu_port_registry_init(&port_registry);
+	ucpu_connection.port_registry = &port_registry;
+	ucpu_feedback_tracker_init(&feedback_tracker);
+	ucpu_connection.feedback_tracker = &feedback_tracker;
+	ucpu_subscription_manager_init(&subscription_manager);
+	ucpu_connection.subscription_manager = &subscription_manager;
+	ucpu_rx_ring_init(&rx_ring);
+
+	/* Wait for the attached io messages. */
+	while (ucpu_port_lookup(&ucpu_connection, 99) == NULL) {
+		if (ucpu_wait_for_notification(&ucpu_connection, 1000) <= 0
+				|| ucpu_att_receive_batch(&ucpu_connection, &rx_ring) < 0) {
+			return 1;
+		}
+		UCPU_RX_RING_CONSUME(&rx_ring, UCPU_RX_RING_COUNT(&rx_ring));
+	}
+
+	for (i = 0; i < 256; i++) {
+		port_info = ucpu_port_lookup(&ucpu_connection, (uint8_t)i);
+		if (port_info != NULL) {
+			printf("Port %d: %s\n", i, port_info->io_type != NULL ? port_info->io_type->name : "unknown");
+		}
+	}
+
+	/* Two consumers of the same mode share the notifications, and the Hub uses
+	 * the smaller delta interval. Another mode of the port cannot be subscribed. */
+	if (ucpu_subscribe(&ucpu_connection, 99, 0, 1) != 0
+			|| ucpu_subscribe(&ucpu_connection, 99, 0, 5) != 0
+			|| ucpu_subscribe(&ucpu_connection, 99, 1, 1) != UCPU_SUBSCRIPTION_CONFLICT) {
+		printf("Subscription failed\n");
+		return 1;
+	}
+
+	start_ns = ucpu_get_time_ns();
+	while (ucpu_get_time_ns() - start_ns < 1000000000) {
+		if (ucpu_wait_for_notification(&ucpu_connection, 100) < 0
+				|| ucpu_att_receive_batch(&ucpu_connection, &rx_ring) < 0) {
+			return 1;
+		}
+
+		for (i = 0; i < UCPU_RX_RING_COUNT(&rx_ring); i++) {
+			ucpu_rx_packet_t *packet = UCPU_RX_RING_PEEK(&rx_ring, i);
+
+			if (ucpu_is_port_value_single_packet(packet->data, packet->length) == 99) {
+				value_count++;
+			}
+		}
+
+		UCPU_RX_RING_CONSUME(&rx_ring, UCPU_RX_RING_COUNT(&rx_ring));
+	}
+
+	/* The notifications are disabled when the last consumer unsubscribes. */
+	if (ucpu_unsubscribe(&ucpu_connection, 99, 0, 5) != 0
+			|| ucpu_unsubscribe(&ucpu_connection, 99, 0, 1) != 0
+			|| subscription_manager.ports[99].mode != UCPU_SUBSCRIPTION_NO_MODE) {
+		printf("Unsubscription failed\n");
+		return 1;
+	}
+	printf("Received %llu tilt values in one second\n", (unsigned long long)value_count);
+	if (value_count == 0) {
+		return 1;
+	}
+
+	start_ns = ucpu_get_time_ns();
+	ucpu_motor_start_speed_for_time(&ucpu_connection, 0, 200, 50, 100, HUB_MOTOR_END_STATE_BRAKE, 0);
+	status = ucpu_feedback_wait(&ucpu_connection, 0, ucpu_feedback_last_token(&ucpu_connection, 0), 1000, NULL);
+	printf("Motor command %s in %d ms\n", status == UCPU_COMMAND_COMPLETED ? "completed" : "failed",
+		(int)((ucpu_get_time_ns() - start_ns) / 1000000));
+	if (status != UCPU_COMMAND_COMPLETED) {
+		return 1;
+	}
+
+	/* Commands without time argument run for a long time, so the
+	 * simulator sends exactly one feedback for each received command. */
+	simulator.command_duration_us = 5000000;
+	ucpu_connection.feedback_tracker = NULL;
+
+	ucpu_tx_queue_init(&tx_queue, UCPU_TX_QUEUE_SIZE, UCPU_TX_QUEUE_SIZE / 2);
+	ucpu_tx_queue_set_coalescing(&tx_queue, UCPU_TX_COALESCE_SETPOINTS);
+	ucpu_set_tx_queue(&ucpu_connection, &tx_queue);
+
+	for (i = 1; i <= 5; i++) {
+		ucpu_motor_start_speed(&ucpu_connection, 0, (int8_t)(i * 10), 100, 0);
+	}
+
+	queued_command = (const hub_motor_start_speed_t*)tx_queue.packets[tx_queue.head & (UCPU_TX_QUEUE_SIZE - 1)].data;
+	printf("Coalescing: %d queued, %d superseded, queued speed: %d\n", (int)UCPU_TX_QUEUE_DEPTH(&tx_queue),
+		(int)tx_queue.superseded, (int)queued_command->speed);
+
+	if (UCPU_TX_QUEUE_DEPTH(&tx_queue) != 1 || tx_queue.superseded != 4 || queued_command->speed != 50
+			|| ucpu_set_tx_queue(&ucpu_connection, NULL) != 0) {
+		printf("Coalescing failed\n");
+		return 1;
+	}
+
+	feedback_count = 0;
+	start_ns = ucpu_get_time_ns();
+	while (ucpu_get_time_ns() - start_ns < 100000000) {
+		if (ucpu_wait_for_notification(&ucpu_connection, 10) < 0
+				|| ucpu_att_receive_batch(&ucpu_connection, &rx_ring) < 0) {
+			return 1;
+		}
+
+		for (i = 0; i < UCPU_RX_RING_COUNT(&rx_ring); i++) {
+			ucpu_rx_packet_t *packet = UCPU_RX_RING_PEEK(&rx_ring, i);
+
+			if (packet->length > (int)sizeof(hub_common_message_header_t)
+					&& ((const hub_common_message_header_t*)packet->data)->message_type == PORT_OUTPUT_COMMAND_FEEDBACK) {
+				feedback_count++;
+			}
+		}
+
+		UCPU_RX_RING_CONSUME(&rx_ring, UCPU_RX_RING_COUNT(&rx_ring));
+	}
+
+	printf("Speed commands received by the simulator: %d\n", feedback_count);
+	if (feedback_count != 1) {
+		return 1;
+	}
+
+	/* The first command is counted by the feedback tracker, so it cannot be replaced. */
+	ucpu_connection.feedback_tracker = &feedback_tracker;
+	ucpu_set_tx_queue(&ucpu_connection, &tx_queue);
+	ucpu_motor_start_speed(&ucpu_connection, 0, 10, 100, 0);
+
+	memset(&motor_start_speed, 0, sizeof(motor_start_speed));
+	motor_start_speed.port_output_command.common_message_header.message_type = PORT_OUTPUT_COMMAND;
+	motor_start_speed.port_output_command.port_id = 0;
+	motor_start_speed.port_output_command.startup_and_complete = PORT_OUTPUT_STARTUP_IMMEDIATE | PORT_OUTPUT_COMPLETION_NONE;
+	motor_start_speed.port_output_command.sub_command = HUB_MOTOR_START_SPEED;
+	motor_start_speed.max_power = 100;
+	ucpu_send_command(&ucpu_connection, &motor_start_speed.port_output_command.common_message_header,
+		sizeof(hub_motor_start_speed_t));
+
+	printf("Coalescing without feedback: %d queued, %d superseded\n", (int)UCPU_TX_QUEUE_DEPTH(&tx_queue),
+		(int)tx_queue.superseded);
+
+	if (UCPU_TX_QUEUE_DEPTH(&tx_queue) != 2 || tx_queue.superseded != 4
+			|| ucpu_set_tx_queue(&ucpu_connection, NULL) != 0) {
+		printf("Coalescing failed\n");
+		return 1;
+	}
+
+	ucpu_simulator_stop(&simulator);
+	ucpu_disconnect(&ucpu_connection);
+
+	printf("Simulator: %llu sent, %llu dropped, %llu received\n", (unsigned long long)simulator.sent_count,
+		(unsigned long long)simulator.dropped_count, (unsigned long long)simulator.received_count);
+
+	if (ucpu_recorder_close(&recorder) != 0 || ucpu_record_reader_open(&record_reader, recording_path) != 0) {
+		printf("Cannot write recording: %s\n", recording_path);
+		return 1;
+	}
+
+	while ((record = ucpu_record_reader_next(&record_reader)) != NULL) {
+		record_counts[record->direction == UCPU_RECORD_SENT]++;
+	}
+	ucpu_record_reader_close(&record_reader);
+
+	/* Every packet received by the simulator must be recorded. */
+	printf("Recording: %llu received, %llu sent packets\n",
+		(unsigned long long)record_counts[0], (unsigned long long)record_counts[1]);
+	if (record_counts[1] != simulator.received_count || record_counts[0] < value_count) {
+		return 1;
+	}
+	return 0;
+}
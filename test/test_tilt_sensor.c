@@ -30,43 +30,69 @@
 #include <stdlib.h>
 #include <unistd.h>
 
-int print_tilt_values(uint8_t *buffer)
-{
-	int x, y, z;
-
-	x = (int16_t)((int)buffer[0] | ((int)buffer[1] << 8));
-	y = (int16_t)((int)buffer[2] | ((int)buffer[3] << 8));
-	z = (int16_t)((int)buffer[4] | ((int)buffer[5] << 8));
-
-	printf("Tilt: x:%d y:%d z:%d\n", x, y, z);
-}
-
 int main(int argc, char **argv)
 {
 	ucpu_connection_t ucpu_connection;
-	int received_bytes;
+	ucpu_rx_ring_t rx_ring;
+	ucpu_port_registry_t port_registry;
+	ucpu_device_info_t device_info;
+	ucpu_value_decoder_t value_decoder;
+	int32_t values[UCPU_MAX_DATASETS];
+	int i;
 	/* Technic Hub 88012 has a built-in tilt sensor on port 99. */
 	uint8_t port_id = 99;
 
-	if (ucpu_connect_to_hub(&ucpu_connection) != 0) {
+	if (ucpu_connect_to_hub_arg(&ucpu_connection, argc, argv) != 0) {
 		return 1;
 	}
 
+	ucpu_port_registry_init(&port_registry);
+	ucpu_connection.port_registry = &port_registry;
+
+	/* The device information can only be requested after the sensor is reported. */
+	while (ucpu_port_lookup(&ucpu_connection, port_id) == NULL) {
+		if (ucpu_wait_for_notification(&ucpu_connection, -1) < 0
+				|| ucpu_att_receive(&ucpu_connection) < 0) {
+			return 1;
+		}
+	}
+
+	/* Mode 0 reports the x, y and z angles. The format is read from the
+	 * device, and three 16 bit values are assumed when it is not available. */
+	if (ucpu_get_device_info(&ucpu_connection, port_id, &device_info, 2000, NULL) == 0
+			&& ucpu_value_decoder_init_mode(&value_decoder, &device_info.modes[0], UCPU_VALUE_UNIT_RAW) == 0) {
+		printf("Mode 0: %s, %d values\n", device_info.modes[0].name, (int)device_info.modes[0].dataset_count);
+	} else {
+		ucpu_value_decoder_init(&value_decoder, HUB_DATASET_TYPE_INT16, 3);
+	}
+
 	ucpu_port_input_format_setup(&ucpu_connection, port_id, 0, 4, 1);
 
+	/* The tilt sensor sends notifications frequently, so they are received in batches. */
+	ucpu_rx_ring_init(&rx_ring);
+
 	while (1) {
-		received_bytes = ucpu_att_receive(&ucpu_connection);
-		if (received_bytes == -1) {
+		if (ucpu_wait_for_notification(&ucpu_connection, -1) < 0) {
 			return 1;
 		}
 
-		if (received_bytes > 0 && ucpu_is_notification(&ucpu_connection, received_bytes)
-				&& ucpu_is_port_value_single(&ucpu_connection, received_bytes) == port_id
-				&& received_bytes == (int)(sizeof(hub_port_value_single_t) + 3 * 2)) {
-			print_tilt_values(ucpu_connection.rsp_buf + sizeof(hub_port_value_single_t));
+		if (ucpu_att_receive_batch(&ucpu_connection, &rx_ring) == -1) {
+			return 1;
 		}
+
+		for (i = 0; i < UCPU_RX_RING_COUNT(&rx_ring); i++) {
+			ucpu_rx_packet_t *packet = UCPU_RX_RING_PEEK(&rx_ring, i);
+
+			if (ucpu_is_notification_packet(&ucpu_connection, packet->data, packet->length)
+					&& ucpu_is_port_value_single_packet(packet->data, packet->length) == port_id
+					&& ucpu_decode_port_value(&value_decoder, packet->data, packet->length, values) == 3) {
+				printf("Tilt: x:%d y:%d z:%d\n", (int)values[0], (int)values[1], (int)values[2]);
+			}
+		}
+
+		UCPU_RX_RING_CONSUME(&rx_ring, UCPU_RX_RING_COUNT(&rx_ring));
 	}
 
-	close(ucpu_connection.sock);
+	ucpu_disconnect(&ucpu_connection);
 	return 0;
 }
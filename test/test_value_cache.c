@@ -0,0 +1,126 @@
+/*
+ *    uc-powered-up (micro/universal c implementation of powered up, you see powered up, ...)
+ *
+ *    Copyright Zoltan Herczeg (hzmester@freemail.hu). All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright notice, this list of
+ *      conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *      of conditions and the following disclaimer in the documentation and/or other materials
+ *      provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER(S) AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER(S) OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "simulator.h"
+#include "value_cache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/* This test runs without a Hub. Without arguments, the tilt sensor values of a
+ * simulated Hub are stored in a shared latest value cache for ten seconds. When
+ * "read" is passed as argument, the test reads the cache of the other process. */
+
+#define VALUE_CACHE_NAME "/ucpu-value-cache"
+
+static void print_tilt(const ucpu_value_cache_t *value_cache, const ucpu_value_decoder_t *value_decoder)
+{
+	int32_t values[UCPU_MAX_DATASETS];
+	uint64_t timestamp_ns;
+
+	if (ucpu_value_cache_read_decoded(value_cache, 99, 0, value_decoder, values, &timestamp_ns) <= 0) {
+		printf("No tilt value\n");
+		return;
+	}
+
+	printf("Tilt: %d %d %d (%llu us ago)\n", (int)values[0], (int)values[1], (int)values[2],
+		(unsigned long long)((ucpu_get_time_ns() - timestamp_ns) / 1000));
+}
+
+static int read_values(ucpu_value_decoder_t *value_decoder)
+{
+	const ucpu_value_cache_t *value_cache = ucpu_value_cache_open_shared(VALUE_CACHE_NAME);
+	int i;
+
+	if (value_cache == NULL) {
+		printf("The cache is not found, start the test without arguments first\n");
+		return 1;
+	}
+
+	for (i = 0; i < 20; i++) {
+		print_tilt(value_cache, value_decoder);
+		usleep(100000);
+	}
+
+	ucpu_value_cache_unmap(value_cache);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	ucpu_simulator_t simulator;
+	ucpu_connection_t ucpu_connection;
+	ucpu_value_cache_t *value_cache;
+	ucpu_value_decoder_t value_decoder;
+	ucpu_rx_ring_t rx_ring;
+	uint64_t start_ns, print_ns;
+
+	ucpu_value_decoder_init(&value_decoder, HUB_DATASET_TYPE_INT16, 3);
+
+	if (argc > 1 && strcmp(argv[1], "read") == 0) {
+		return read_values(&value_decoder);
+	}
+
+	value_cache = ucpu_value_cache_create_shared(VALUE_CACHE_NAME);
+	if (value_cache == NULL) {
+		return 1;
+	}
+
+	ucpu_simulator_init(&simulator);
+	ucpu_simulator_add_device(&simulator, 99, 0x3b, 6, 1000);
+
+	if (ucpu_simulator_start(&simulator, &ucpu_connection) != 0) {
+		return 1;
+	}
+
+	ucpu_connection.value_cache = value_cache;
+	ucpu_rx_ring_init(&rx_ring);
+	ucpu_port_input_format_setup(&ucpu_connection, 99, 0, 1, 1);
+
+	start_ns = ucpu_get_time_ns();
+	print_ns = start_ns;
+
+	while (ucpu_get_time_ns() - start_ns < 10000000000ull) {
+		/* Only the cache is updated, the packets are dropped. */
+		if (ucpu_wait_for_notification(&ucpu_connection, 100) < 0
+				|| ucpu_att_receive_batch(&ucpu_connection, &rx_ring) < 0) {
+			break;
+		}
+		UCPU_RX_RING_CONSUME(&rx_ring, UCPU_RX_RING_COUNT(&rx_ring));
+
+		if (ucpu_get_time_ns() - print_ns >= 1000000000) {
+			print_ns += 1000000000;
+			print_tilt(value_cache, &value_decoder);
+		}
+	}
+
+	ucpu_simulator_stop(&simulator);
+	ucpu_disconnect(&ucpu_connection);
+	ucpu_value_cache_unlink(VALUE_CACHE_NAME);
+	ucpu_value_cache_unmap(value_cache);
+	return 0;
+}
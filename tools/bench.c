@@ -0,0 +1,603 @@
+/*
+ *    uc-powered-up (micro/universal c implementation of powered up, you see powered up, ...)
+ *
+ *    Copyright Zoltan Herczeg (hzmester@freemail.hu). All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright notice, this list of
+ *      conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *      of conditions and the following disclaimer in the documentation and/or other materials
+ *      provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER(S) AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER(S) OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Benchmarks of the library. The results are printed as one line per benchmark
+ * with space separated key=value pairs, which can be compared between releases. */
+
+#include "simulator.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define UCPU_BENCH_MAX_PACKETS 4096
+
+typedef int (*ucpu_bench_command_t)(ucpu_connection_t *ucpu_connection, uint32_t i);
+
+typedef struct {
+	const char *name;
+	ucpu_bench_command_t command;
+} ucpu_bench_command_entry_t;
+
+typedef struct {
+	int count;
+	/* Updated by the benchmarks, so the results are used. */
+	uint64_t valid;
+	uint64_t dispatched;
+	uint64_t values;
+	int32_t checksum;
+	ucpu_value_decoder_t decoders[256];
+	int lengths[UCPU_BENCH_MAX_PACKETS];
+	uint8_t packets[UCPU_BENCH_MAX_PACKETS][UCPU_RECORD_MAX_LENGTH];
+} ucpu_bench_packets_t;
+
+/* Null transport: the encoded packets are counted and dropped. */
+
+static uint64_t ucpu_bench_sent_bytes;
+
+static int ucpu_bench_null_open(ucpu_connection_t *ucpu_connection, const void *parameters)
+{
+	ucpu_connection->sock = -1;
+	return 0;
+}
+
+static int ucpu_bench_null_send(ucpu_connection_t *ucpu_connection, const void *packet, uint16_t packet_len)
+{
+	ucpu_bench_sent_bytes += packet_len;
+	return 0;
+}
+
+static int ucpu_bench_null_send_batch(ucpu_connection_t *ucpu_connection, const struct iovec *packets, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		ucpu_bench_sent_bytes += packets[i].iov_len;
+	}
+	return count;
+}
+
+static int ucpu_bench_null_receive(ucpu_connection_t *ucpu_connection, uint8_t *buffer, int buffer_size)
+{
+	return 0;
+}
+
+static int ucpu_bench_null_receive_batch(ucpu_connection_t *ucpu_connection, ucpu_rx_packet_t **packets, int count)
+{
+	return 0;
+}
+
+static void ucpu_bench_null_close(ucpu_connection_t *ucpu_connection)
+{
+	ucpu_connection->sock = -1;
+}
+
+static const ucpu_transport_t ucpu_bench_null_transport = {
+	ucpu_bench_null_open,
+	ucpu_bench_null_send,
+	ucpu_bench_null_send_batch,
+	ucpu_bench_null_receive,
+	ucpu_bench_null_receive_batch,
+	ucpu_bench_null_close,
+};
+
+/* Command builders. The arguments depend on the iteration counter,
+ * so the compiler cannot hoist the encoding out of the loop. */
+
+#define UCPU_BENCH_COMMAND(name, call) \
+	static int ucpu_bench_##name(ucpu_connection_t *ucpu_connection, uint32_t i) \
+	{ \
+		return call; \
+	}
+
+static const ucpu_combined_format_t ucpu_bench_combined_format = {
+	2, { { 0, 0, 2 }, { 1, 0, 4 } }
+};
+
+UCPU_BENCH_COMMAND(port_information_request,
+	ucpu_port_information_request(ucpu_connection, (uint8_t)i, HUB_PORT_INFORMATION_MODE_INFO))
+UCPU_BENCH_COMMAND(port_mode_information_request,
+	ucpu_port_mode_information_request(ucpu_connection, (uint8_t)i, (uint8_t)(i & 0xf), HUB_MODE_INFORMATION_RAW))
+UCPU_BENCH_COMMAND(port_input_format_setup,
+	ucpu_port_input_format_setup(ucpu_connection, (uint8_t)i, 0, i, 1))
+UCPU_BENCH_COMMAND(port_input_format_setup_combined,
+	ucpu_port_input_format_setup_combined(ucpu_connection, (uint8_t)i, HUB_COMBINED_LOCK))
+UCPU_BENCH_COMMAND(port_set_mode_combination,
+	ucpu_port_set_mode_combination(ucpu_connection, (uint8_t)i, 0, &ucpu_bench_combined_format))
+UCPU_BENCH_COMMAND(port_subscribe_combined,
+	ucpu_port_subscribe_combined(ucpu_connection, (uint8_t)i, 0, &ucpu_bench_combined_format, i))
+UCPU_BENCH_COMMAND(virtual_port_connect,
+	ucpu_virtual_port_connect(ucpu_connection, (uint8_t)i, (uint8_t)(i + 1)))
+UCPU_BENCH_COMMAND(virtual_port_disconnect,
+	ucpu_virtual_port_disconnect(ucpu_connection, (uint8_t)i))
+UCPU_BENCH_COMMAND(set_led_color,
+	ucpu_set_led_color(ucpu_connection, 50, (uint8_t)(i % 11)))
+UCPU_BENCH_COMMAND(set_led_rgb,
+	ucpu_set_led_rgb(ucpu_connection, 50, (uint8_t)i, (uint8_t)(i >> 8), (uint8_t)(i >> 16)))
+UCPU_BENCH_COMMAND(motor_start_speed,
+	ucpu_motor_start_speed(ucpu_connection, (uint8_t)i, (int8_t)i, 100, 0))
+UCPU_BENCH_COMMAND(motor_goto_absolute_position,
+	ucpu_motor_goto_absolute_position(ucpu_connection, (uint8_t)i, (int32_t)i, 50, 100, HUB_MOTOR_END_STATE_HOLD, 0))
+UCPU_BENCH_COMMAND(motor_set_acc_time,
+	ucpu_motor_set_acc_time(ucpu_connection, (uint8_t)i, (uint16_t)i, 0))
+UCPU_BENCH_COMMAND(motor_set_dec_time,
+	ucpu_motor_set_dec_time(ucpu_connection, (uint8_t)i, (uint16_t)i, 0))
+UCPU_BENCH_COMMAND(motor_start_speed_dual,
+	ucpu_motor_start_speed_dual(ucpu_connection, (uint8_t)i, (int8_t)i, (int8_t)-i, 100, 0))
+UCPU_BENCH_COMMAND(motor_start_speed_for_time,
+	ucpu_motor_start_speed_for_time(ucpu_connection, (uint8_t)i, (uint16_t)i, 50, 100, HUB_MOTOR_END_STATE_BRAKE, 0))
+UCPU_BENCH_COMMAND(motor_start_speed_for_time_dual,
+	ucpu_motor_start_speed_for_time_dual(ucpu_connection, (uint8_t)i, (uint16_t)i, 50, -50, 100, HUB_MOTOR_END_STATE_BRAKE, 0))
+UCPU_BENCH_COMMAND(motor_start_speed_for_degrees,
+	ucpu_motor_start_speed_for_degrees(ucpu_connection, (uint8_t)i, (int32_t)i, 50, 100, HUB_MOTOR_END_STATE_BRAKE, 0))
+UCPU_BENCH_COMMAND(motor_start_speed_for_degrees_dual,
+	ucpu_motor_start_speed_for_degrees_dual(ucpu_connection, (uint8_t)i, (int32_t)i, 50, -50, 100, HUB_MOTOR_END_STATE_BRAKE, 0))
+UCPU_BENCH_COMMAND(motor_goto_absolute_position_dual,
+	ucpu_motor_goto_absolute_position_dual(ucpu_connection, (uint8_t)i, (int32_t)i, -(int32_t)i, 50, 100, HUB_MOTOR_END_STATE_HOLD, 0))
+UCPU_BENCH_COMMAND(motor_preset_encoder,
+	ucpu_motor_preset_encoder(ucpu_connection, (uint8_t)i, (int32_t)i))
+UCPU_BENCH_COMMAND(motor_preset_encoder_dual,
+	ucpu_motor_preset_encoder_dual(ucpu_connection, (uint8_t)i, (int32_t)i, -(int32_t)i))
+
+#define UCPU_BENCH_ENTRY(name) { #name, ucpu_bench_##name }
+
+static const ucpu_bench_command_entry_t ucpu_bench_commands[] = {
+	UCPU_BENCH_ENTRY(port_information_request),
+	UCPU_BENCH_ENTRY(port_mode_information_request),
+	UCPU_BENCH_ENTRY(port_input_format_setup),
+	UCPU_BENCH_ENTRY(port_input_format_setup_combined),
+	UCPU_BENCH_ENTRY(port_set_mode_combination),
+	UCPU_BENCH_ENTRY(port_subscribe_combined),
+	UCPU_BENCH_ENTRY(virtual_port_connect),
+	UCPU_BENCH_ENTRY(virtual_port_disconnect),
+	UCPU_BENCH_ENTRY(set_led_color),
+	UCPU_BENCH_ENTRY(set_led_rgb),
+	UCPU_BENCH_ENTRY(motor_start_speed),
+	UCPU_BENCH_ENTRY(motor_goto_absolute_position),
+	UCPU_BENCH_ENTRY(motor_set_acc_time),
+	UCPU_BENCH_ENTRY(motor_set_dec_time),
+	UCPU_BENCH_ENTRY(motor_start_speed_dual),
+	UCPU_BENCH_ENTRY(motor_start_speed_for_time),
+	UCPU_BENCH_ENTRY(motor_start_speed_for_time_dual),
+	UCPU_BENCH_ENTRY(motor_start_speed_for_degrees),
+	UCPU_BENCH_ENTRY(motor_start_speed_for_degrees_dual),
+	UCPU_BENCH_ENTRY(motor_goto_absolute_position_dual),
+	UCPU_BENCH_ENTRY(motor_preset_encoder),
+	UCPU_BENCH_ENTRY(motor_preset_encoder_dual),
+};
+
+static void ucpu_bench_print(const char *name, uint64_t iterations, uint64_t elapsed_ns)
+{
+	printf("benchmark=%s iterations=%llu total_ns=%llu ns_per_op=%.2f ops_per_sec=%.0f\n",
+		name, (unsigned long long)iterations, (unsigned long long)elapsed_ns,
+		(double)elapsed_ns / (double)iterations, (double)iterations * 1e9 / (double)elapsed_ns);
+}
+
+static int ucpu_bench_encode(uint32_t iterations)
+{
+	ucpu_connection_t ucpu_connection;
+	char name[64];
+	uint64_t start_ns, elapsed_ns;
+	uint32_t i, j;
+
+	ucpu_transport_open(&ucpu_connection, &ucpu_bench_null_transport, NULL);
+	ucpu_connection.handle[0] = 0x0e;
+	ucpu_connection.handle[1] = 0x00;
+
+	for (i = 0; i < sizeof(ucpu_bench_commands) / sizeof(ucpu_bench_commands[0]); i++) {
+		ucpu_bench_sent_bytes = 0;
+		start_ns = ucpu_get_time_ns();
+
+		for (j = 0; j < iterations; j++) {
+			if (ucpu_bench_commands[i].command(&ucpu_connection, j) != 0) {
+				fprintf(stderr, "encode.%s failed\n", ucpu_bench_commands[i].name);
+				return 1;
+			}
+		}
+
+		elapsed_ns = ucpu_get_time_ns() - start_ns;
+		snprintf(name, sizeof(name), "encode.%s", ucpu_bench_commands[i].name);
+		ucpu_bench_print(name, iterations, elapsed_ns);
+	}
+
+	ucpu_disconnect(&ucpu_connection);
+	return 0;
+}
+
+/* Notifications. */
+
+static void ucpu_bench_add_packet(ucpu_bench_packets_t *packets, const uint8_t *data, int length)
+{
+	const hub_port_value_single_t *port_value_single = (const hub_port_value_single_t*)data;
+	int value_size;
+
+	if (packets->count >= UCPU_BENCH_MAX_PACKETS || length > UCPU_RECORD_MAX_LENGTH
+			|| length < sizeof(hub_common_message_header_t)
+			|| data[0] != ATT_HANDLE_VALUE_NTF) {
+		return;
+	}
+
+	memcpy(packets->packets[packets->count], data, (size_t)length);
+	packets->lengths[packets->count] = length;
+	packets->count++;
+
+	if (ucpu_is_port_value_single_packet(data, length) < 0
+			|| packets->decoders[port_value_single->port_id].decode != NULL) {
+		return;
+	}
+
+	/* The value format of a port is guessed from its first value. */
+	value_size = length - (int)sizeof(hub_port_value_single_t);
+	switch (value_size) {
+	case 2:
+		ucpu_value_decoder_init(&packets->decoders[port_value_single->port_id], HUB_DATASET_TYPE_INT16, 1);
+		break;
+	case 4:
+		ucpu_value_decoder_init(&packets->decoders[port_value_single->port_id], HUB_DATASET_TYPE_INT32, 1);
+		break;
+	case 6:
+		ucpu_value_decoder_init(&packets->decoders[port_value_single->port_id], HUB_DATASET_TYPE_INT16, 3);
+		break;
+	default:
+		ucpu_value_decoder_init(&packets->decoders[port_value_single->port_id], HUB_DATASET_TYPE_INT8, (uint8_t)value_size);
+		break;
+	}
+}
+
+static void ucpu_bench_set_header(uint8_t *packet, int length)
+{
+	hub_common_message_header_t *common_message_header = (hub_common_message_header_t*)packet;
+
+	common_message_header->opcode = ATT_HANDLE_VALUE_NTF;
+	common_message_header->handle[0] = 0x0e;
+	common_message_header->handle[1] = 0x00;
+	common_message_header->length = (uint8_t)(length - 3);
+	common_message_header->hub_id = 0;
+}
+
+/* A typical stream: mostly sensor values, and a few feedback and attached io messages. */
+static void ucpu_bench_generate_packets(ucpu_bench_packets_t *packets)
+{
+	uint8_t packet[UCPU_RECORD_MAX_LENGTH];
+	hub_attached_io_attached_t *attached_io_attached = (hub_attached_io_attached_t*)packet;
+	hub_port_output_command_feedback_t *port_output_command_feedback = (hub_port_output_command_feedback_t*)packet;
+	hub_port_value_single_t *port_value_single = (hub_port_value_single_t*)packet;
+	int i, length;
+
+	for (i = 0; i < 1024; i++) {
+		memset(packet, 0, sizeof(packet));
+
+		if ((i & 0xff) == 0) {
+			length = sizeof(hub_attached_io_attached_t);
+			attached_io_attached->attached_io.common_message_header.message_type = HUB_ATTACHED_IO;
+			attached_io_attached->attached_io.port_id = 0;
+			attached_io_attached->attached_io.event = HUB_ATTACHED_IO_ATTACHED;
+			attached_io_attached->io_type_id[0] = 0x30;
+		} else if ((i & 0xf) == 0) {
+			length = sizeof(hub_port_output_command_feedback_t);
+			port_output_command_feedback->common_message_header.message_type = PORT_OUTPUT_COMMAND_FEEDBACK;
+			port_output_command_feedback->port_id = 0;
+			port_output_command_feedback->feedback = PORT_FEEDBACK_BUFFER_EMPTY_COMPLETED | PORT_FEEDBACK_IDLE;
+		} else if (i & 0x1) {
+			/* Tilt sensor: three 16 bit values. */
+			length = sizeof(hub_port_value_single_t) + 6;
+			port_value_single->common_message_header.message_type = HUB_PORT_VALUE_SINGLE;
+			port_value_single->port_id = 99;
+			packet[length - 6] = (uint8_t)i;
+			packet[length - 3] = (uint8_t)-i;
+		} else {
+			/* Motor position: one 32 bit value. */
+			length = sizeof(hub_port_value_single_t) + 4;
+			port_value_single->common_message_header.message_type = HUB_PORT_VALUE_SINGLE;
+			port_value_single->port_id = 0;
+			packet[length - 4] = (uint8_t)i;
+			packet[length - 3] = (uint8_t)(i >> 8);
+		}
+
+		ucpu_bench_set_header(packet, length);
+		ucpu_bench_add_packet(packets, packet, length);
+	}
+}
+
+static int ucpu_bench_load_packets(ucpu_bench_packets_t *packets, const char *path)
+{
+	ucpu_record_reader_t record_reader;
+	const ucpu_record_t *record;
+
+	if (ucpu_record_reader_open(&record_reader, path) != 0) {
+		fprintf(stderr, "Cannot open recording: %s\n", path);
+		return 1;
+	}
+
+	while ((record = ucpu_record_reader_next(&record_reader)) != NULL) {
+		if (record->direction == UCPU_RECORD_RECEIVED) {
+			ucpu_bench_add_packet(packets, (const uint8_t*)(record + 1), record->length);
+		}
+	}
+
+	ucpu_record_reader_close(&record_reader);
+
+	if (packets->count == 0) {
+		fprintf(stderr, "No notifications in recording: %s\n", path);
+		return 1;
+	}
+	return 0;
+}
+
+static void ucpu_bench_port_value(ucpu_connection_t *ucpu_connection,
+	const hub_common_message_header_t *message, int message_length, void *user_data)
+{
+	ucpu_bench_packets_t *packets = (ucpu_bench_packets_t*)user_data;
+	const ucpu_value_decoder_t *value_decoder = packets->decoders + ((const hub_port_value_single_t*)message)->port_id;
+	int32_t values[UCPU_MAX_DATASETS];
+	int i, count;
+
+	packets->dispatched++;
+
+	if (value_decoder->decode == NULL) {
+		return;
+	}
+
+	count = ucpu_decode_port_value(value_decoder, (const uint8_t*)message, message_length, values);
+	for (i = 0; i < count; i++) {
+		packets->checksum += values[i];
+	}
+	if (count > 0) {
+		packets->values += (uint64_t)count;
+	}
+}
+
+static void ucpu_bench_other(ucpu_connection_t *ucpu_connection,
+	const hub_common_message_header_t *message, int message_length, void *user_data)
+{
+	((ucpu_bench_packets_t*)user_data)->dispatched++;
+}
+
+static int ucpu_bench_dispatch(uint32_t iterations, const char *recording)
+{
+	ucpu_bench_packets_t *packets;
+	ucpu_connection_t ucpu_connection;
+	ucpu_dispatcher_t dispatcher;
+	uint64_t start_ns, elapsed_ns, total;
+	int i, count;
+
+	packets = (ucpu_bench_packets_t*)calloc(1, sizeof(ucpu_bench_packets_t));
+	if (packets == NULL) {
+		return 1;
+	}
+
+	if (recording != NULL) {
+		if (ucpu_bench_load_packets(packets, recording) != 0) {
+			free(packets);
+			return 1;
+		}
+	} else {
+		ucpu_bench_generate_packets(packets);
+	}
+
+	ucpu_transport_open(&ucpu_connection, &ucpu_bench_null_transport, NULL);
+	/* All packets are sent by the same Hub. */
+	ucpu_connection.handle[0] = packets->packets[0][1];
+	ucpu_connection.handle[1] = packets->packets[0][2];
+
+	ucpu_dispatcher_init(&dispatcher);
+	for (i = 0; i < 256; i++) {
+		ucpu_dispatcher_set_handler(&dispatcher, (uint8_t)i, ucpu_bench_other, packets);
+	}
+	ucpu_dispatcher_set_handler(&dispatcher, HUB_PORT_VALUE_SINGLE, ucpu_bench_port_value, packets);
+
+	count = 0;
+	for (i = 0; i < packets->count; i++) {
+		count += ucpu_is_notification_packet(&ucpu_connection, packets->packets[i], packets->lengths[i]);
+	}
+
+	/* Validation only. */
+	total = 0;
+	start_ns = ucpu_get_time_ns();
+	while (total < iterations) {
+		for (i = 0; i < packets->count; i++) {
+			packets->valid += ucpu_is_notification_packet(&ucpu_connection, packets->packets[i], packets->lengths[i]);
+		}
+		total += (uint64_t)packets->count;
+	}
+	elapsed_ns = ucpu_get_time_ns() - start_ns;
+	ucpu_bench_print("dispatch.parse", total, elapsed_ns);
+
+	/* Validation, handler lookup, and decoding of the port values. */
+	total = 0;
+	start_ns = ucpu_get_time_ns();
+	while (total < iterations) {
+		for (i = 0; i < packets->count; i++) {
+			ucpu_dispatch(&dispatcher, &ucpu_connection, packets->packets[i], packets->lengths[i]);
+		}
+		total += (uint64_t)packets->count;
+	}
+	elapsed_ns = ucpu_get_time_ns() - start_ns;
+	ucpu_bench_print("dispatch.dispatch", total, elapsed_ns);
+
+	printf("benchmark=dispatch.summary packets=%d valid=%d dispatched=%llu values=%llu checksum=%d\n",
+		packets->count, count,
+		(unsigned long long)packets->dispatched, (unsigned long long)packets->values, (int)packets->checksum);
+
+	ucpu_disconnect(&ucpu_connection);
+	free(packets);
+	return 0;
+}
+
+/* Round trip latency against the simulator. */
+
+static int ucpu_bench_compare(const void *a, const void *b)
+{
+	uint64_t value_a = *(const uint64_t*)a;
+	uint64_t value_b = *(const uint64_t*)b;
+
+	return (value_a > value_b) - (value_a < value_b);
+}
+
+/* Percentiles are given in tenths of a percent. */
+static void ucpu_bench_print_latency(const char *name, uint64_t *samples, uint32_t count)
+{
+	qsort(samples, count, sizeof(uint64_t), ucpu_bench_compare);
+
+	printf("benchmark=%s samples=%u min_ns=%llu p50_ns=%llu p90_ns=%llu p99_ns=%llu p999_ns=%llu max_ns=%llu\n",
+		name, count, (unsigned long long)samples[0],
+		(unsigned long long)samples[(uint64_t)(count - 1) * 500 / 1000],
+		(unsigned long long)samples[(uint64_t)(count - 1) * 900 / 1000],
+		(unsigned long long)samples[(uint64_t)(count - 1) * 990 / 1000],
+		(unsigned long long)samples[(uint64_t)(count - 1) * 999 / 1000],
+		(unsigned long long)samples[count - 1]);
+}
+
+static int ucpu_bench_roundtrip(uint32_t samples)
+{
+	ucpu_simulator_t simulator;
+	ucpu_connection_t ucpu_connection;
+	ucpu_feedback_tracker_t feedback_tracker;
+	uint64_t *feedback_ns, *completed_ns;
+	uint64_t start_ns, now_ns;
+	uint32_t i, token;
+	int status, result = 1;
+
+	feedback_ns = (uint64_t*)malloc(samples * sizeof(uint64_t));
+	completed_ns = (uint64_t*)malloc(samples * sizeof(uint64_t));
+	if (feedback_ns == NULL || completed_ns == NULL) {
+		free(feedback_ns);
+		free(completed_ns);
+		return 1;
+	}
+
+	/* The commands are completed immediately by the simulator, so the
+	 * measured time is the overhead of the library and the kernel. */
+	ucpu_simulator_init(&simulator);
+	simulator.command_duration_us = 0;
+	ucpu_simulator_add_device(&simulator, 0, 0x30, 4, 0);
+
+	if (ucpu_simulator_start(&simulator, &ucpu_connection) != 0) {
+		free(feedback_ns);
+		free(completed_ns);
+		return 1;
+	}
+
+	ucpu_feedback_tracker_init(&feedback_tracker);
+	ucpu_connection.feedback_tracker = &feedback_tracker;
+
+	for (i = 0; i < samples; i++) {
+		start_ns = ucpu_get_time_ns();
+		feedback_ns[i] = 0;
+
+		if (ucpu_motor_start_speed(&ucpu_connection, 0, (int8_t)(i & 0x3f), 100, 0) != 0) {
+			goto done;
+		}
+		token = ucpu_feedback_last_token(&ucpu_connection, 0);
+
+		while (1) {
+			status = ucpu_feedback_status(&ucpu_connection, 0, token);
+			now_ns = ucpu_get_time_ns();
+
+			if (status != UCPU_COMMAND_PENDING && feedback_ns[i] == 0) {
+				feedback_ns[i] = now_ns - start_ns;
+			}
+			if (status >= UCPU_COMMAND_COMPLETED) {
+				completed_ns[i] = now_ns - start_ns;
+				break;
+			}
+
+			if (ucpu_wait_for_notification(&ucpu_connection, 1000) <= 0
+					|| ucpu_att_receive(&ucpu_connection) < 0) {
+				fprintf(stderr, "roundtrip: no feedback from the simulator\n");
+				goto done;
+			}
+		}
+	}
+
+	ucpu_bench_print_latency("roundtrip.feedback", feedback_ns, samples);
+	ucpu_bench_print_latency("roundtrip.completed", completed_ns, samples);
+	result = 0;
+
+done:
+	ucpu_simulator_stop(&simulator);
+	ucpu_disconnect(&ucpu_connection);
+	free(feedback_ns);
+	free(completed_ns);
+	return result;
+}
+
+static void ucpu_bench_usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-n iterations] [-s samples] [-r recording] [encode|dispatch|roundtrip]...\n", name);
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t iterations = 1000000;
+	uint32_t samples = 10000;
+	const char *recording = NULL;
+	int i, option, result = 0;
+
+	while ((option = getopt(argc, argv, "n:s:r:")) != -1) {
+		switch (option) {
+		case 'n':
+			iterations = (uint32_t)strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			samples = (uint32_t)strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			recording = optarg;
+			break;
+		default:
+			ucpu_bench_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (iterations == 0 || samples == 0) {
+		ucpu_bench_usage(argv[0]);
+		return 1;
+	}
+
+	/* All benchmarks are executed when none is selected. */
+	if (optind == argc) {
+		return ucpu_bench_encode(iterations) | ucpu_bench_dispatch(iterations, recording)
+			| ucpu_bench_roundtrip(samples);
+	}
+
+	for (i = optind; i < argc; i++) {
+		if (strcmp(argv[i], "encode") == 0) {
+			result |= ucpu_bench_encode(iterations);
+		} else if (strcmp(argv[i], "dispatch") == 0) {
+			result |= ucpu_bench_dispatch(iterations, recording);
+		} else if (strcmp(argv[i], "roundtrip") == 0) {
+			result |= ucpu_bench_roundtrip(samples);
+		} else {
+			ucpu_bench_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	return result;
+}
@@ -0,0 +1,662 @@
+/*
+ *    uc-powered-up (micro/universal c implementation of powered up, you see powered up, ...)
+ *
+ *    Copyright Zoltan Herczeg (hzmester@freemail.hu). All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright notice, this list of
+ *      conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *      of conditions and the following disclaimer in the documentation and/or other materials
+ *      provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER(S) AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER(S) OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Hub broker daemon: shares the Hub connections between local clients (see src/broker.h). */
+
+#define _GNU_SOURCE
+
+#include "broker.h"
+#include "simulator.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define BROKER_MAX_CLIENTS 32
+/* Maximum number of unfinished commands tracked for each port. */
+#define BROKER_MAX_PORT_COMMANDS 16
+/* Owner of the commands sent by disconnected clients. */
+#define BROKER_NO_CLIENT 0xfe
+
+typedef struct {
+	int fd;
+	/* Set after the hello message is received. */
+	uint8_t ready;
+	uint8_t hub_index;
+} broker_client_t;
+
+/* Clients of the unfinished commands of a port (which request feedback), in the
+ * order they were sent to the Hub. Updated like the feedback tracker of a client. */
+typedef struct {
+	uint8_t clients[BROKER_MAX_PORT_COMMANDS];
+	uint8_t first;
+	uint8_t count;
+	uint8_t in_progress;
+} broker_port_commands_t;
+
+typedef struct {
+	int hub_count;
+	int listen_fd;
+	int signal_fd;
+	int ring_fd;
+	ucpu_broker_ring_t *ring;
+	ucpu_event_loop_t event_loop;
+	ucpu_rx_ring_t rx_ring;
+	/* Bit n is set when the Hub n received notifications in the current batch. */
+	uint32_t updated_hubs;
+	uint64_t dropped_commands;
+	broker_client_t clients[BROKER_MAX_CLIENTS];
+	ucpu_tx_queue_t tx_queues[UCPU_MAX_HUBS];
+	ucpu_connection_t connections[UCPU_MAX_HUBS];
+	broker_port_commands_t port_commands[UCPU_MAX_HUBS][256];
+} broker_t;
+
+static broker_t broker;
+
+static int broker_create_ring(void)
+{
+	int i;
+
+	broker.ring_fd = memfd_create("ucpu-broker", MFD_CLOEXEC);
+	if (broker.ring_fd < 0 || ftruncate(broker.ring_fd, sizeof(ucpu_broker_ring_t)) != 0) {
+		return 1;
+	}
+
+	broker.ring = (ucpu_broker_ring_t*)mmap(NULL, sizeof(ucpu_broker_ring_t),
+		PROT_READ | PROT_WRITE, MAP_SHARED, broker.ring_fd, 0);
+	if (broker.ring == MAP_FAILED) {
+		return 1;
+	}
+
+	broker.ring->size = UCPU_BROKER_RING_SIZE;
+	atomic_init(&broker.ring->tail, 0);
+	for (i = 0; i < UCPU_BROKER_RING_SIZE; i++) {
+		atomic_init(&broker.ring->slots[i].sequence, 0);
+	}
+
+	atomic_thread_fence(memory_order_release);
+	memcpy(broker.ring->magic, ucpu_broker_magic, sizeof(ucpu_broker_magic));
+	return 0;
+}
+
+static void broker_ring_write(uint8_t hub_index, uint8_t client_index, uint64_t timestamp_ns,
+	const uint8_t *data, int length)
+{
+	uint64_t position = atomic_load_explicit(&broker.ring->tail, memory_order_relaxed);
+	ucpu_broker_slot_t *slot = broker.ring->slots + (position & (UCPU_BROKER_RING_SIZE - 1));
+
+	/* Readers detect the change of the sequence. */
+	atomic_store_explicit(&slot->sequence, 0, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	slot->timestamp_ns = timestamp_ns;
+	slot->hub_index = hub_index;
+	slot->client_index = client_index;
+	slot->length = (uint8_t)length;
+	memcpy(slot->data, data, (size_t)length);
+
+	atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+	atomic_store_explicit(&broker.ring->tail, position + 1, memory_order_release);
+}
+
+/* Writes a feedback message of a single port for one client. */
+static void broker_write_feedback(uint8_t hub_index, uint8_t client_index, uint64_t timestamp_ns,
+	uint8_t port_id, uint8_t feedback)
+{
+	hub_port_output_command_feedback_t port_output_command_feedback;
+
+	if (client_index == BROKER_NO_CLIENT || feedback == 0) {
+		return;
+	}
+
+	port_output_command_feedback.common_message_header.opcode = ATT_HANDLE_VALUE_NTF;
+	port_output_command_feedback.common_message_header.handle[0] = broker.connections[hub_index].handle[0];
+	port_output_command_feedback.common_message_header.handle[1] = broker.connections[hub_index].handle[1];
+	port_output_command_feedback.common_message_header.length = sizeof(hub_port_output_command_feedback_t) - 3;
+	port_output_command_feedback.common_message_header.hub_id = 0;
+	port_output_command_feedback.common_message_header.message_type = PORT_OUTPUT_COMMAND_FEEDBACK;
+	port_output_command_feedback.port_id = port_id;
+	port_output_command_feedback.feedback = feedback;
+
+	broker_ring_write(hub_index, client_index, timestamp_ns,
+		(const uint8_t*)&port_output_command_feedback, sizeof(hub_port_output_command_feedback_t));
+}
+
+/* Removes the oldest command of a port. Returns with its client. */
+static uint8_t broker_finish_command(broker_port_commands_t *port_commands)
+{
+	uint8_t client_index;
+
+	if (port_commands->count == 0) {
+		return BROKER_NO_CLIENT;
+	}
+
+	client_index = port_commands->clients[port_commands->first];
+	port_commands->first = (port_commands->first + 1) % BROKER_MAX_PORT_COMMANDS;
+	port_commands->count--;
+	port_commands->in_progress = 0;
+	return client_index;
+}
+
+static void broker_register_command(broker_client_t *client, const uint8_t *message, int message_length,
+	int superseded)
+{
+	const hub_port_output_command_t *port_output_command = (const hub_port_output_command_t*)message;
+	broker_port_commands_t *port_commands;
+	uint8_t client_index = (uint8_t)(client - broker.clients);
+	uint8_t *last, feedback;
+
+	if (message_length < sizeof(hub_port_output_command_t)
+			|| port_output_command->common_message_header.message_type != PORT_OUTPUT_COMMAND) {
+		return;
+	}
+
+	feedback = port_output_command->startup_and_complete & PORT_OUTPUT_COMPLETION_FEEDBACK;
+	port_commands = broker.port_commands[client->hub_index] + port_output_command->port_id;
+
+	/* The coalesced command replaced the last queued command of the port, which is
+	 * never sent, so its client is notified by the daemon. Only commands with the
+	 * same flags are coalesced, so the replaced command is tracked only when the
+	 * new one requests feedback. */
+	if (superseded) {
+		if (feedback && port_commands->count > 0) {
+			last = port_commands->clients
+				+ (port_commands->first + port_commands->count - 1) % BROKER_MAX_PORT_COMMANDS;
+			broker_write_feedback(client->hub_index, *last, ucpu_get_time_ns(),
+				port_output_command->port_id, PORT_FEEDBACK_DISCARDED);
+			*last = client_index;
+		}
+		return;
+	}
+
+	if (!feedback) {
+		return;
+	}
+
+	/* Too many unfinished commands: the oldest one is forgotten. */
+	if (port_commands->count == BROKER_MAX_PORT_COMMANDS) {
+		broker_finish_command(port_commands);
+	}
+
+	port_commands->clients[(port_commands->first + port_commands->count) % BROKER_MAX_PORT_COMMANDS] = client_index;
+	port_commands->count++;
+}
+
+/* Splits a feedback message into messages for the clients of the reported commands. */
+static void broker_route_feedback(uint8_t hub_index, const ucpu_rx_packet_t *packet)
+{
+	const uint8_t *src = packet->data + sizeof(hub_common_message_header_t);
+	const uint8_t *src_end = packet->data + packet->length;
+	broker_port_commands_t *port_commands;
+	uint8_t port_id, feedback, client_index;
+
+	for (; src + 2 <= src_end; src += 2) {
+		port_id = src[0];
+		feedback = src[1];
+		port_commands = broker.port_commands[hub_index] + port_id;
+
+		/* Without tracked commands, the feedback does not finish a command of any client. */
+		client_index = UCPU_BROKER_ALL_CLIENTS;
+
+		if (feedback & PORT_FEEDBACK_DISCARDED) {
+			client_index = broker_finish_command(port_commands);
+			broker_write_feedback(hub_index, client_index, packet->timestamp_ns, port_id, PORT_FEEDBACK_DISCARDED);
+		}
+
+		if (feedback & PORT_FEEDBACK_BUFFER_EMPTY_COMPLETED) {
+			client_index = broker_finish_command(port_commands);
+			broker_write_feedback(hub_index, client_index, packet->timestamp_ns, port_id,
+				PORT_FEEDBACK_BUFFER_EMPTY_COMPLETED);
+		}
+
+		feedback &= ~(PORT_FEEDBACK_DISCARDED | PORT_FEEDBACK_BUFFER_EMPTY_COMPLETED);
+
+		/* The rest of the flags describe the oldest unfinished command, or the
+		 * state of the port after the last finished one. */
+		if (port_commands->count > 0) {
+			client_index = port_commands->clients[port_commands->first];
+		}
+
+		if (feedback & PORT_FEEDBACK_BUFFER_EMPTY_IN_PROGRESS) {
+			port_commands->in_progress = port_commands->count > 0;
+		} else if ((feedback & PORT_FEEDBACK_IDLE) && port_commands->in_progress) {
+			broker_finish_command(port_commands);
+		}
+
+		broker_write_feedback(hub_index, client_index, packet->timestamp_ns, port_id, feedback);
+	}
+}
+
+static void broker_forget_client(broker_client_t *client)
+{
+	broker_port_commands_t *port_commands = broker.port_commands[client->hub_index];
+	uint8_t client_index = (uint8_t)(client - broker.clients);
+	int i, j;
+
+	for (i = 0; i < 256; i++) {
+		for (j = 0; j < BROKER_MAX_PORT_COMMANDS; j++) {
+			if (port_commands[i].clients[j] == client_index) {
+				port_commands[i].clients[j] = BROKER_NO_CLIENT;
+			}
+		}
+	}
+}
+
+static int broker_listen(const char *path)
+{
+	struct sockaddr_un address;
+
+	if (strlen(path) >= sizeof(address.sun_path)) {
+		return 1;
+	}
+
+	broker.listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (broker.listen_fd < 0) {
+		return 1;
+	}
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+
+	/* The socket of a stopped daemon is replaced. */
+	unlink(path);
+
+	if (bind(broker.listen_fd, (struct sockaddr*)&address, sizeof(address)) != 0
+			|| listen(broker.listen_fd, 16) != 0) {
+		return 1;
+	}
+
+	return ucpu_event_loop_add_fd(&broker.event_loop, broker.listen_fd, UCPU_EVENT_READABLE, NULL);
+}
+
+static void broker_close_client(broker_client_t *client)
+{
+	/* A new client with the same index must not receive the remaining feedbacks. */
+	if (client->ready) {
+		broker_forget_client(client);
+	}
+
+	ucpu_event_loop_remove_fd(&broker.event_loop, client->fd);
+	close(client->fd);
+	client->fd = -1;
+	client->ready = 0;
+}
+
+static void broker_accept(void)
+{
+	broker_client_t *client = NULL;
+	int i, fd;
+
+	fd = accept4(broker.listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (fd < 0) {
+		return;
+	}
+
+	for (i = 0; i < BROKER_MAX_CLIENTS; i++) {
+		if (broker.clients[i].fd < 0) {
+			client = broker.clients + i;
+			break;
+		}
+	}
+
+	if (client == NULL || ucpu_event_loop_add_fd(&broker.event_loop, fd, UCPU_EVENT_READABLE, client) != 0) {
+		close(fd);
+		return;
+	}
+
+	client->fd = fd;
+	client->ready = 0;
+}
+
+static void broker_wakeup(broker_client_t *client)
+{
+	ucpu_broker_wakeup_t wakeup;
+
+	/* When the socket buffer is full, the client has unread wakeups anyway. */
+	wakeup.wakeup = 1;
+	send(client->fd, &wakeup, sizeof(wakeup), MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+static int broker_hello(broker_client_t *client, const uint8_t *message, int message_length)
+{
+	ucpu_broker_hello_t hello;
+	struct msghdr msg;
+	struct iovec iovec;
+	struct cmsghdr *cmsg;
+	union {
+		char buffer[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} control;
+
+	if (message_length != sizeof(ucpu_broker_hello_t)
+			|| memcmp(message, ucpu_broker_magic, sizeof(hello.magic)) != 0) {
+		return 1;
+	}
+
+	memcpy(&hello, message, sizeof(hello));
+	hello.status = UCPU_BROKER_STATUS_OK;
+
+	if (hello.hub_index >= broker.hub_count || broker.connections[hello.hub_index].sock < 0) {
+		hello.status = UCPU_BROKER_STATUS_INVALID_HUB;
+	} else {
+		hello.handle[0] = broker.connections[hello.hub_index].handle[0];
+		hello.handle[1] = broker.connections[hello.hub_index].handle[1];
+		hello.client_index = (uint8_t)(client - broker.clients);
+	}
+
+	iovec.iov_base = &hello;
+	iovec.iov_len = sizeof(hello);
+
+	memset(&msg, 0, sizeof(msg));
+	memset(&control, 0, sizeof(control));
+	msg.msg_iov = &iovec;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buffer;
+	msg.msg_controllen = sizeof(control.buffer);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &broker.ring_fd, sizeof(int));
+
+	if (sendmsg(client->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL) != sizeof(hello)
+			|| hello.status != UCPU_BROKER_STATUS_OK) {
+		return 1;
+	}
+
+	client->hub_index = hello.hub_index;
+	client->ready = 1;
+	return 0;
+}
+
+static void broker_client_readable(broker_client_t *client)
+{
+	uint8_t message[UCPU_BROKER_MESSAGE_LENGTH];
+	ucpu_connection_t *ucpu_connection;
+	uint32_t superseded;
+	ssize_t ret;
+
+	while (1) {
+		/* Returns with the real length of the packet, even if it is truncated. */
+		ret = recv(client->fd, message, sizeof(message), MSG_DONTWAIT | MSG_TRUNC);
+
+		if (ret < 0 && (errno == EWOULDBLOCK || errno == EAGAIN || errno == EINTR)) {
+			return;
+		}
+
+		if (ret <= 0) {
+			broker_close_client(client);
+			return;
+		}
+
+		if (ret > sizeof(message)) {
+			broker.dropped_commands++;
+			continue;
+		}
+
+		if (!client->ready) {
+			if (broker_hello(client, message, (int)ret) != 0) {
+				broker_close_client(client);
+				return;
+			}
+			continue;
+		}
+
+		if (ret == sizeof(ucpu_broker_wakeup_t)) {
+			broker_wakeup(client);
+			continue;
+		}
+
+		ucpu_connection = broker.connections + client->hub_index;
+		superseded = ucpu_connection->tx_queue->superseded;
+
+		/* The commands of all clients are merged by the transmit queue. */
+		if (ret < sizeof(hub_common_message_header_t) || ucpu_connection->sock < 0
+				|| ucpu_send_command(ucpu_connection, (hub_common_message_header_t*)message, (uint16_t)ret) != 0) {
+			broker.dropped_commands++;
+			continue;
+		}
+
+		broker_register_command(client, message, (int)ret, ucpu_connection->tx_queue->superseded != superseded);
+	}
+}
+
+static void broker_hub_failed(int hub_index)
+{
+	int i;
+
+	fprintf(stderr, "Connection to Hub %d is lost\n", hub_index);
+	ucpu_disconnect(broker.connections + hub_index);
+	memset(broker.port_commands[hub_index], 0, sizeof(broker.port_commands[hub_index]));
+
+	for (i = 0; i < BROKER_MAX_CLIENTS; i++) {
+		if (broker.clients[i].fd >= 0 && broker.clients[i].hub_index == hub_index) {
+			broker_close_client(broker.clients + i);
+		}
+	}
+}
+
+static void broker_hub_readable(ucpu_connection_t *ucpu_connection)
+{
+	int hub_index = (int)(ucpu_connection - broker.connections);
+	ucpu_rx_packet_t *packet;
+	int i, count, ret;
+
+	ret = ucpu_att_receive_batch(ucpu_connection, &broker.rx_ring);
+	count = UCPU_RX_RING_COUNT(&broker.rx_ring);
+
+	for (i = 0; i < count; i++) {
+		packet = UCPU_RX_RING_PEEK(&broker.rx_ring, i);
+
+		if (packet->length > UCPU_BROKER_MESSAGE_LENGTH
+				|| !ucpu_is_notification_packet(ucpu_connection, packet->data, packet->length)) {
+			continue;
+		}
+
+		if (((const hub_common_message_header_t*)packet->data)->message_type == PORT_OUTPUT_COMMAND_FEEDBACK) {
+			broker_route_feedback((uint8_t)hub_index, packet);
+		} else {
+			broker_ring_write((uint8_t)hub_index, UCPU_BROKER_ALL_CLIENTS, packet->timestamp_ns,
+				packet->data, packet->length);
+		}
+		broker.updated_hubs |= 1u << hub_index;
+	}
+
+	UCPU_RX_RING_CONSUME(&broker.rx_ring, count);
+
+	if (ret < 0) {
+		broker_hub_failed(hub_index);
+	}
+}
+
+static int broker_run(void)
+{
+	ucpu_event_t events[16];
+	int i, count;
+
+	while (1) {
+		count = ucpu_event_loop_wait(&broker.event_loop, events, 16, -1);
+		if (count < 0) {
+			return 1;
+		}
+
+		broker.updated_hubs = 0;
+
+		for (i = 0; i < count; i++) {
+			if (events[i].connection != NULL) {
+				if (events[i].events & (UCPU_EVENT_READABLE | UCPU_EVENT_ERROR)) {
+					broker_hub_readable(events[i].connection);
+				}
+			} else if (events[i].fd == broker.signal_fd) {
+				return 0;
+			} else if (events[i].fd == broker.listen_fd) {
+				broker_accept();
+			} else {
+				broker_client_readable((broker_client_t*)events[i].user_data);
+			}
+		}
+
+		/* Clients are woken once per batch. */
+		if (broker.updated_hubs != 0) {
+			for (i = 0; i < BROKER_MAX_CLIENTS; i++) {
+				if (broker.clients[i].fd >= 0 && broker.clients[i].ready
+						&& (broker.updated_hubs & (1u << broker.clients[i].hub_index))) {
+					broker_wakeup(broker.clients + i);
+				}
+			}
+		}
+	}
+}
+
+static int broker_connect_hubs(int argc, char **argv)
+{
+	ucpu_hub_manager_t manager;
+	ucpu_hub_address_t hub;
+	int i;
+
+	/* Without addresses, all Hubs found by scanning are used. */
+	if (argc == 0) {
+		broker.hub_count = ucpu_hub_manager_connect(&manager, broker.connections, UCPU_MAX_HUBS, 5000, 10000);
+		return broker.hub_count <= 0;
+	}
+
+	for (i = 0; i < argc && i < UCPU_MAX_HUBS; i++) {
+		if (ucpu_parse_hub_address(argv[i], UCPU_ADDRESS_PUBLIC, &hub) != 0
+				|| ucpu_connect_to_hub_address(broker.connections + i, &hub) != 0) {
+			fprintf(stderr, "Cannot connect to %s\n", argv[i]);
+			return 1;
+		}
+		broker.hub_count++;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = UCPU_BROKER_DEFAULT_PATH;
+	ucpu_simulator_t simulator;
+	sigset_t signals;
+	int i, option, simulated = 0, result;
+
+	while ((option = getopt(argc, argv, "p:s")) != -1) {
+		switch (option) {
+		case 'p':
+			path = optarg;
+			break;
+		case 's':
+			simulated = 1;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-p socket path] [-s] [Hub address]...\n"
+				"    -s: use a simulated Hub instead of real Hubs\n", argv[0]);
+			return 1;
+		}
+	}
+
+	for (i = 0; i < BROKER_MAX_CLIENTS; i++) {
+		broker.clients[i].fd = -1;
+	}
+
+	/* The signals are received by the event loop. They are blocked before
+	 * any thread is started, so the threads inherit the signal mask. */
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+	broker.signal_fd = signalfd(-1, &signals, SFD_CLOEXEC);
+
+	if (simulated) {
+		ucpu_simulator_init(&simulator);
+		ucpu_simulator_add_device(&simulator, 0, 0x30, 4, 0);
+		ucpu_simulator_add_device(&simulator, 99, 0x3b, 6, 1000);
+
+		if (ucpu_simulator_start(&simulator, broker.connections) != 0) {
+			return 1;
+		}
+		broker.hub_count = 1;
+	} else if (broker_connect_hubs(argc - optind, argv + optind) != 0) {
+		return 1;
+	}
+
+	ucpu_rx_ring_init(&broker.rx_ring);
+
+	if (broker.signal_fd < 0 || broker_create_ring() != 0
+			|| ucpu_event_loop_init(&broker.event_loop) != 0
+			|| ucpu_event_loop_add_fd(&broker.event_loop, broker.signal_fd, UCPU_EVENT_READABLE, NULL) != 0) {
+		return 1;
+	}
+
+	for (i = 0; i < broker.hub_count; i++) {
+		ucpu_tx_queue_init(broker.tx_queues + i, UCPU_TX_QUEUE_SIZE * 3 / 4, UCPU_TX_QUEUE_SIZE / 4);
+		ucpu_tx_queue_set_coalescing(broker.tx_queues + i, UCPU_TX_COALESCE_SETPOINTS);
+		ucpu_set_tx_queue(broker.connections + i, broker.tx_queues + i);
+
+		if (ucpu_event_loop_add(&broker.event_loop, broker.connections + i) != 0) {
+			return 1;
+		}
+	}
+
+	if (broker_listen(path) != 0) {
+		fprintf(stderr, "Cannot listen on %s\n", path);
+		return 1;
+	}
+
+	printf("Serving %d Hub(s) on %s\n", broker.hub_count, path);
+	fflush(stdout);
+
+	result = broker_run();
+
+	for (i = 0; i < BROKER_MAX_CLIENTS; i++) {
+		if (broker.clients[i].fd >= 0) {
+			broker_close_client(broker.clients + i);
+		}
+	}
+
+	close(broker.listen_fd);
+	unlink(path);
+
+	if (simulated) {
+		ucpu_simulator_stop(&simulator);
+	}
+
+	for (i = 0; i < broker.hub_count; i++) {
+		ucpu_disconnect(broker.connections + i);
+	}
+
+	ucpu_event_loop_free(&broker.event_loop);
+	printf("Stopped: %llu notifications, %llu dropped commands\n",
+		(unsigned long long)atomic_load(&broker.ring->tail), (unsigned long long)broker.dropped_commands);
+	return result;
+}